@@ -1,5 +1,6 @@
 #include "asic.h"
 #include "cpu.h"
+#include "jit.h"
 #include "misc.h"
 #include "mem.h"
 #include "lcd.h"
@@ -26,12 +27,12 @@
 #include <time.h>
 
 /* Global ASIC state */
-asic_state_t asic;
+EMU_LOCAL asic_state_t asic;
 
 #define MAX_RESET_PROCS 20
 
-static void (*reset_procs[MAX_RESET_PROCS])(void);
-static unsigned int reset_proc_count;
+static EMU_LOCAL void (*reset_procs[MAX_RESET_PROCS])(void);
+static EMU_LOCAL unsigned int reset_proc_count;
 
 static void add_reset_proc(void (*proc)(void)) {
     if (reset_proc_count == MAX_RESET_PROCS) {
@@ -95,9 +96,10 @@ void asic_init(void) {
 }
 
 void asic_free(void) {
-    usb_init_device(0, NULL, NULL, NULL);
+    usb_init_device(0, NULL, NULL, NULL, false);
     lcd_free();
     mem_free();
+    jit_free();
     gui_console_printf("[CEmu] Freed ASIC.\n");
 }
 
@@ -121,47 +123,63 @@ void set_cpu_clock(uint32_t new_rate) {
    sched_set_clock(CLOCK_CPU, new_rate);
 }
 
-bool asic_restore(FILE *image) {
-    return fread(&asic.device, sizeof(asic.device), 1, image) == 1
-           && backlight_restore(image)
-           && control_restore(image)
-           && cpu_restore(image)
-           && flash_restore(image)
-           && intrpt_restore(image)
-           && keypad_restore(image)
-           && lcd_restore(image)
-           && mem_restore(image)
-           && watchdog_restore(image)
-           && protect_restore(image)
-           && rtc_restore(image)
-           && sha256_restore(image)
-           && gpt_restore(image)
-           && usb_restore(image)
-           && cxxx_restore(image)
-           && spi_restore(image)
-           && exxx_restore(image)
-           && sched_restore(image)
-           && fgetc(image) == EOF;
+static bool asic_device_restore(image_t *image) {
+    return image_read(image, &asic.device, sizeof(asic.device));
 }
 
-bool asic_save(FILE *image) {
-    return fwrite(&asic.device, sizeof(asic.device), 1, image) == 1
-           && backlight_save(image)
-           && control_save(image)
-           && cpu_save(image)
-           && flash_save(image)
-           && intrpt_save(image)
-           && keypad_save(image)
-           && lcd_save(image)
-           && mem_save(image)
-           && watchdog_save(image)
-           && protect_save(image)
-           && rtc_save(image)
-           && sha256_save(image)
-           && gpt_save(image)
-           && usb_save(image)
-           && cxxx_save(image)
-           && spi_save(image)
-           && exxx_save(image)
-           && sched_save(image);
+static bool asic_device_save(image_t *image) {
+    return image_write(image, &asic.device, sizeof(asic.device));
+}
+
+/* chunked images store each module in its own chunk, in this order */
+/* bump the version of a chunk whenever the state that module saves changes */
+static const struct asic_chunk {
+    uint32_t tag;
+    uint16_t version;
+    bool (*restore)(image_t *image);
+    bool (*save)(image_t *image);
+} asic_chunks[] = {
+    { IMAGE_TAG_ASIC,       1, asic_device_restore, asic_device_save },
+    { IMAGE_TAG_BACKLIGHT,  1, backlight_restore,   backlight_save   },
+    { IMAGE_TAG_CONTROL,    1, control_restore,     control_save     },
+    { IMAGE_TAG_CPU,        1, cpu_restore,         cpu_save         },
+    { IMAGE_TAG_FLASH_CTRL, 1, flash_restore,       flash_save       },
+    { IMAGE_TAG_INTERRUPT,  1, intrpt_restore,      intrpt_save      },
+    { IMAGE_TAG_KEYPAD,     1, keypad_restore,      keypad_save      },
+    { IMAGE_TAG_LCD,        1, lcd_restore,         lcd_save         },
+    { IMAGE_TAG_MEM,        1, mem_restore,         mem_save         },
+    { IMAGE_TAG_WATCHDOG,   1, watchdog_restore,    watchdog_save    },
+    { IMAGE_TAG_PROTECT,    1, protect_restore,     protect_save     },
+    { IMAGE_TAG_RTC,        1, rtc_restore,         rtc_save         },
+    { IMAGE_TAG_SHA256,     1, sha256_restore,      sha256_save      },
+    { IMAGE_TAG_GPT,        1, gpt_restore,         gpt_save         },
+    { IMAGE_TAG_USB,        1, usb_restore,         usb_save         },
+    { IMAGE_TAG_CXXX,       1, cxxx_restore,        cxxx_save        },
+    { IMAGE_TAG_SPI,        1, spi_restore,         spi_save         },
+    { IMAGE_TAG_EXXX,       1, exxx_restore,        exxx_save        },
+    { IMAGE_TAG_SCHED,      1, sched_restore,       sched_save       },
+};
+
+bool asic_restore(image_t *image) {
+    size_t i;
+
+    for (i = 0; i < sizeof(asic_chunks) / sizeof(asic_chunks[0]); i++) {
+        if (!image_read_chunk(image, asic_chunks[i].tag, asic_chunks[i].version) ||
+            !asic_chunks[i].restore(image)) {
+            return false;
+        }
+    }
+    return image_end(image);
+}
+
+bool asic_save(image_t *image) {
+    size_t i;
+
+    for (i = 0; i < sizeof(asic_chunks) / sizeof(asic_chunks[0]); i++) {
+        if (!image_write_chunk(image, asic_chunks[i].tag, asic_chunks[i].version) ||
+            !asic_chunks[i].save(image)) {
+            return false;
+        }
+    }
+    return true;
 }
@@ -5,6 +5,8 @@
 extern "C" {
 #endif
 
+#include "image.h"
+#include "defines.h"
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -18,13 +20,13 @@ typedef struct asic_state {
     ti_device_t device;
 } asic_state_t;
 
-extern asic_state_t asic;
+extern EMU_LOCAL asic_state_t asic;
 
 void asic_init(void);
 void asic_free(void);
 void asic_reset(void);
-bool asic_restore(FILE *image);
-bool asic_save(FILE *image);
+bool asic_restore(image_t *image);
+bool asic_save(image_t *image);
 void set_cpu_clock(uint32_t new_rate);
 void set_device_type(ti_device_t device);
 ti_device_t get_device_type(void);
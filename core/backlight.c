@@ -5,7 +5,7 @@
 #include <string.h>
 
 /* Global BACKLIGHT state */
-backlight_state_t backlight;
+EMU_LOCAL backlight_state_t backlight;
 
 /* Read from the 0xBXXX range of ports */
 static uint8_t backlight_read(const uint16_t pio, bool peek) {
@@ -82,10 +82,10 @@ void backlight_reset(void) {
     backlight.brightness = 0xFF;  /* backlight level (PWM)             */
 }
 
-bool backlight_save(FILE *image) {
-    return fwrite(&backlight, sizeof(backlight), 1, image) == 1;
+bool backlight_save(image_t *image) {
+    return image_write(image, &backlight, sizeof(backlight));
 }
 
-bool backlight_restore(FILE *image) {
-    return fread(&backlight, sizeof(backlight), 1, image) == 1;
+bool backlight_restore(image_t *image) {
+    return image_read(image, &backlight, sizeof(backlight));
 }
@@ -5,6 +5,7 @@
 extern "C" {
 #endif
 
+#include "image.h"
 #include "port.h"
 #include <stdio.h>
 
@@ -14,12 +15,12 @@ typedef struct backlight_state {
     float factor;
 } backlight_state_t;
 
-extern backlight_state_t backlight;
+extern EMU_LOCAL backlight_state_t backlight;
 
 eZ80portrange_t init_backlight(void);
 void backlight_reset(void);
-bool backlight_restore(FILE *image);
-bool backlight_save(FILE *image);
+bool backlight_restore(image_t *image);
+bool backlight_save(image_t *image);
 
 #ifdef __cplusplus
 }
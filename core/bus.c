@@ -1,11 +1,12 @@
 #include "bus.h"
+#include "defines.h"
 #include <stdint.h>
 
 /* derivation source:
  * https://www.electro-tech-online.com/threads/ultra-fast-pseudorandom-number-generator-for-8-bit.124249/
  */
 
-static uint8_t a, b, c, x = 0;
+static EMU_LOCAL uint8_t a, b, c, x = 0;
 
 void bus_init_rand(uint8_t s1, uint8_t s2, uint8_t s3) {
     a = s1;
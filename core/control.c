@@ -13,7 +13,7 @@
 #include <stdlib.h>
 
 /* Global CONTROL state */
-control_state_t control;
+EMU_LOCAL control_state_t control;
 
 /* Read from the 0x0XXX range of ports */
 static uint8_t control_read(const uint16_t pio, bool peek) {
@@ -75,6 +75,7 @@ static uint8_t control_read(const uint16_t pio, bool peek) {
 /* Write to the 0x0XXX range of ports */
 static void control_write(const uint16_t pio, const uint8_t byte, bool poke) {
     unsigned int i;
+    uint32_t old;
     uint8_t index = (uint8_t)pio;
     (void)poke;
 
@@ -171,6 +172,7 @@ static void control_write(const uint16_t pio, const uint8_t byte, bool poke) {
                 for (i = LCD_RAM_OFFSET; i < LCD_RAM_OFFSET + LCD_BYTE_SIZE; i++) {
                     mem.ram.block[i] = bus_rand();
                 }
+                mem_invalidate_ptr(&mem.ram.block[LCD_RAM_OFFSET], LCD_BYTE_SIZE);
             } else {
                 lcd_update();
             }
@@ -183,10 +185,14 @@ static void control_write(const uint16_t pio, const uint8_t byte, bool poke) {
             write8(control.privileged, (index - 0x1D) << 3, byte);
             break;
         case 0x20: case 0x21: case 0x22:
+            old = control.protectedStart;
             write8(control.protectedStart, (index - 0x20) << 3, byte);
+            mem_update_page_range(old, control.protectedStart);
             break;
         case 0x23: case 0x24: case 0x25:
+            old = control.protectedEnd;
             write8(control.protectedEnd, (index - 0x23) << 3, byte);
+            mem_update_page_range(old, control.protectedEnd);
             break;
         case 0x28:
             control.flashUnlocked = (control.flashUnlocked | 5) & byte;
@@ -195,7 +201,10 @@ static void control_write(const uint16_t pio, const uint8_t byte, bool poke) {
             control.ports[index] = byte & 1;
             break;
         case 0x3A: case 0x3B: case 0x3C:
+            old = control.stackLimit;
             write8(control.stackLimit, (index - 0x3A) << 3, byte);
+            mem_update_page_range(old, old);
+            mem_update_page_range(control.stackLimit, control.stackLimit);
             break;
         case 0x3E:
             control.protectionStatus &= ~byte;
@@ -237,16 +246,17 @@ void control_reset(void) {
     control.protectedPortsUnlocked = false;
     control.off = false;
     control.ports[0xF] = 0x2;
+    mem_update_pages();
 
     gui_console_printf("[CEmu] Control reset.\n");
 }
 
-bool control_save(FILE *image) {
-    return fwrite(&control, sizeof(control), 1, image) == 1;
+bool control_save(image_t *image) {
+    return image_write(image, &control, sizeof(control));
 }
 
-bool control_restore(FILE *image) {
-    return fread(&control, sizeof(control), 1, image) == 1;
+bool control_restore(image_t *image) {
+    return image_read(image, &control, sizeof(control));
 }
 
 bool protected_ports_unlocked(void) {
@@ -5,6 +5,7 @@
 extern "C" {
 #endif
 
+#include "image.h"
 #include "port.h"
 
 #include <stdio.h>
@@ -41,12 +42,12 @@ typedef struct control_state {
     bool off;
 } control_state_t;
 
-extern control_state_t control;
+extern EMU_LOCAL control_state_t control;
 
 eZ80portrange_t init_control(void);
 void control_reset(void);
-bool control_restore(FILE *image);
-bool control_save(FILE *image);
+bool control_restore(image_t *image);
+bool control_save(image_t *image);
 bool protected_ports_unlocked(void);
 bool flash_unlocked(void);
 bool unprivileged_code(void);
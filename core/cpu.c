@@ -21,19 +21,22 @@
 #include "emu.h"
 #include "mem.h"
 #include "bus.h"
+#include "flash.h"
+#include "jit.h"
 #include "defines.h"
 #include "control.h"
 #include "registers.h"
 #include "schedule.h"
 #include "interrupt.h"
 #include "debug/debug.h"
+#include "usb/usb.h"
 
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 
 /* Global CPU state */
-eZ80cpu_t cpu;
+EMU_LOCAL eZ80cpu_t cpu;
 
 static void cpu_clear_context(void) {
     cpu.PREFIX = cpu.SUFFIX = 0;
@@ -44,27 +47,269 @@ static void cpu_clear_context(void) {
 static void cpu_inst_start(void) {
     cpu_clear_context();
 #ifdef DEBUG_SUPPORT
-    debug_inst_start();
+    if (unlikely(debug.active)) {
+        debug_inst_start();
+    } else {
+        debug.addr[cpu.registers.PC] |= DBG_INST_START_MARKER;
+    }
 #endif
 }
 
+/* Bulk block instructions and idle loop skipping bypass the debugger hooks, so they are only used
+ * while no breakpoints, watchpoints or steps are set. Instruction markers and the call stack are
+ * still kept up to date, the disassembler and step out rely on them once the debugger opens.
+ * They can also be turned off, to check them against running every iteration. */
+static EMU_LOCAL bool shortcuts = true;
+
+#ifdef DEBUG_SUPPORT
+#define cpu_plain() likely(shortcuts && !debug.active)
+#else
+#define cpu_plain() likely(shortcuts)
+#endif
+
 uint32_t cpu_address_mode(uint32_t address, bool mode) {
     if (mode) {
         return address & 0xFFFFFF;
     }
     return (cpu.registers.MBASE << 16) | (address & 0xFFFF);
 }
+
+/* Idle loop detection: a short backward branch that is taken twice in a row with the same cpu
+ * state, without any side effects in between, will keep looping until something external
+ * happens, so the remaining iterations up to the next event can be skipped. */
+#define CPU_IDLE_LOOP_SIZE 0x40
+#define CPU_IDLE_REPEATS   8
+
+static EMU_LOCAL struct {
+    bool valid;
+    uint8_t repeats, R, fetch, flashUnlocked, modes;
+    uint32_t start, end, seconds, cycles, events, dma;
+    int32_t maSecond;
+    uint32_t maTick;
+    eZ80registers_t registers;
+} idle;
+
+void cpu_set_shortcuts(bool enabled) {
+    shortcuts = enabled;
+    idle.valid = false;
+}
+
+void cpu_idle_break(void) {
+    idle.valid = false;
+}
+
+/* Instruction cache: remembers the opcode bytes fetched sequentially after the first byte of an
+ * instruction, so that they can be replayed without going through the memory decoder. Wait states
+ * and fetch side effects are still applied per byte at the same point in the pipeline. */
+#define CPU_CACHE_SIZE    0x400
+#define CPU_CACHE_BYTES   7
+#define CPU_CACHE_INVALID 0xFFFFFFFF
+#define cpu_cache_page(address) (cache.pages[(address) >> 11 & 0x1FFF] & 1 << ((address) >> 8 & 7))
+
+typedef struct {
+    uint32_t start;
+    uint8_t length;
+    uint8_t bytes[CPU_CACHE_BYTES];
+} cpu_cache_entry_t;
+
+static EMU_LOCAL struct {
+    cpu_cache_entry_t entries[CPU_CACHE_SIZE];
+    uint8_t pages[0x1000000 >> 8 >> 3];
+    cpu_cache_entry_t *entry;
+    uint32_t next;
+    uint8_t index;
+    bool record;
+    cpu_cache_mode_t mode;
+    uint32_t mismatches;
+} cache = { .mode = CPU_CACHE_ON };
+
+/* Recompiler: translated blocks run in place of the interpreter, see jit.h. The verifying mode
+ * runs a block, takes it back, lets the interpreter run the same instructions and compares. */
+static EMU_LOCAL struct {
+    cpu_jit_mode_t mode;
+    uint32_t mismatches;
+    uint32_t steps;     /* instructions the interpreter has left to run before comparing */
+    uint32_t start;
+    bool adl;
+    eZ80cpu_t cpu;      /* state the block left */
+    uint8_t fetch, flashUnlocked, buffer[sizeof(mem.buffer)];
+} jit;
+
+/* whether fetching from address is a plain read of flash or ram, see mem_read_cpu */
+static inline bool cpu_cache_plain(uint32_t address) {
+    if (address < 0x800000) {
+        return flash.mapped && address <= flash.mask && flash.waitStates != 6 &&
+               mem.flash.command == FLASH_NO_COMMAND;
+    }
+    return address - 0xD00000 < SIZE_RAM;
+}
+
+static inline bool cpu_cache_replay(uint32_t address, uint8_t value) {
+    /* let mem_read_cpu check for the flash unlock sequence */
+    if (value == 0x57 || !cpu_cache_plain(address)) {
+        return false;
+    }
+    if (address < 0x800000) {
+        cpu.cycles += flash.waitStates;
+    } else {
+        sched_process_pending_dma(4);
+    }
+    mem.buffer[++mem.fetch] = value;
+    if (control.flashUnlocked & 1 << 3 && unprivileged_code()) {
+        control.flashUnlocked &= ~(1 << 3);
+    }
+    return true;
+}
+
+/* self-check of the fetch cache: compare a cached byte with the backing memory */
+static bool cpu_cache_verify(uint32_t address, uint8_t value) {
+    uint8_t actual;
+    if (!cpu_cache_plain(address)) {
+        return true;
+    }
+    actual = address < 0x800000 ? mem.flash.block[address] : mem.ram.block[address - 0xD00000];
+    if (actual == value) {
+        return true;
+    }
+    cache.mismatches++;
+    gui_console_err_printf("[CEmu] Instruction cache mismatch at 0x%06X: cached 0x%02X, memory 0x%02X.\n", address, value, actual);
+    cpu_cache_flush();
+    return false;
+}
+
+static void cpu_cache_end(void) {
+    cpu_cache_entry_t *entry = cache.entry;
+    if (entry && cache.record && cache.index) {
+        entry->start = cache.next - cache.index - 1;
+        entry->length = cache.index;
+        cache.pages[entry->start >> 11] |= 1 << (entry->start >> 8 & 7);
+    }
+    cache.entry = NULL;
+}
+
+static void cpu_cache_begin(void) {
+    uint32_t address = cpu.registers.PC;
+    cpu_cache_entry_t *entry = &cache.entries[address & (CPU_CACHE_SIZE - 1)];
+    cpu_cache_end();
+    if (cache.mode == CPU_CACHE_OFF) {
+        return;
+    }
+    cache.entry = entry;
+    cache.next = address + 1;
+    cache.index = 0;
+    if ((cache.record = entry->start != address)) {
+        entry->start = CPU_CACHE_INVALID;
+    }
+}
+
+static uint8_t cpu_cache_miss(uint32_t address) {
+    cpu_cache_entry_t *entry = cache.entry;
+    uint8_t value;
+    if (entry && address == cache.next) {
+        if (!cache.record) {
+            /* this path is longer than the recorded one, so extend the entry */
+            entry->start = CPU_CACHE_INVALID;
+            cache.record = true;
+        }
+        if (cache.index < CPU_CACHE_BYTES && cpu_cache_plain(address)) {
+            value = mem_read_cpu(address, true);
+            if (cache.entry == entry) {
+                entry->bytes[cache.index++] = value;
+                cache.next++;
+            }
+            return value;
+        }
+    }
+    cpu_cache_end();
+    return mem_read_cpu(address, true);
+}
+
+static inline uint8_t cpu_cache_fetch(uint32_t address) {
+    cpu_cache_entry_t *entry = cache.entry;
+    if (entry && address == cache.next && !cache.record && cache.index < entry->length) {
+        uint8_t value = entry->bytes[cache.index];
+        if (unlikely(cache.mode == CPU_CACHE_VERIFY) && !cpu_cache_verify(address, value)) {
+            return mem_read_cpu(address, true);
+        }
+        if (likely(cpu_cache_replay(address, value))) {
+            cache.index++;
+            cache.next++;
+            return value;
+        }
+        cache.entry = NULL;
+        return mem_read_cpu(address, true);
+    }
+    return cpu_cache_miss(address);
+}
+
+static void cpu_cache_clear(void) {
+    memset(cache.entries, 0xFF, sizeof cache.entries);
+    memset(cache.pages, 0, sizeof cache.pages);
+    cache.entry = NULL;
+    idle.valid = false;
+}
+
+void cpu_cache_flush(void) {
+    cpu_cache_clear();
+    jit_flush();
+    jit.steps = 0;
+}
+
+void cpu_set_cache_mode(cpu_cache_mode_t mode) {
+    cpu_cache_flush();
+    cache.mode = mode;
+    cache.mismatches = 0;
+}
+
+uint32_t cpu_cache_mismatches(void) {
+    return cache.mismatches;
+}
+
+void cpu_cache_invalidate(uint32_t address, uint32_t size) {
+    uint32_t start = (address - CPU_CACHE_BYTES) & 0xFFFFFF;
+    uint32_t count = size + CPU_CACHE_BYTES;
+    uint32_t end = (start + count - 1) & 0xFFFFFF;
+
+    idle.valid = false;
+    jit_invalidate(address, size);
+
+    /* entries cover the bytes after their start address */
+    if (cache.entry && ((cache.next - cache.index - 1 - start) & 0xFFFFFF) < count) {
+        cache.entry = NULL;
+    }
+    if (size > CPU_CACHE_SIZE) {
+        cpu_cache_clear();
+        return;
+    }
+    if (count <= 0x100 && !cpu_cache_page(start) && !cpu_cache_page(end)) {
+        return;
+    }
+    while (count--) {
+        if (cpu_cache_page(start)) {
+            cpu_cache_entry_t *entry = &cache.entries[start & (CPU_CACHE_SIZE - 1)];
+            if (entry->start == start) {
+                entry->start = CPU_CACHE_INVALID;
+            }
+        }
+        start = (start + 1) & 0xFFFFFF;
+    }
+}
+
 static void cpu_prefetch(uint32_t address, bool mode) {
     cpu.ADL = mode;
     /* rawPC the PC after the next prefetch (which we do late), before adding MBASE. */
     cpu.registers.rawPC = cpu_mask_mode(address + 1, mode);
     cpu.registers.PC = cpu_address_mode(address, mode);
-    cpu.prefetch = mem_read_cpu(cpu.registers.PC, true);
+    cpu.prefetch = cpu_cache_fetch(cpu.registers.PC);
 }
 static uint8_t cpu_fetch_byte(void) {
     uint8_t value;
 #ifdef DEBUG_SUPPORT
-    debug_inst_fetch();
+    if (unlikely(debug.active)) {
+        debug_inst_fetch();
+    } else {
+        debug.addr[cpu.registers.PC] |= DBG_INST_MARKER;
+    }
 #endif
     value = cpu.prefetch;
     cpu_prefetch(cpu.registers.PC + 1, cpu.ADL);
@@ -101,6 +346,7 @@ static uint8_t cpu_read_byte(uint32_t address) {
 }
 static void cpu_write_byte(uint32_t address, uint8_t value) {
     uint32_t cpuAddress = cpu_address_mode(address, cpu.L);
+    idle.valid = false;
     mem_write_cpu(cpuAddress, value);
 }
 
@@ -127,6 +373,7 @@ static uint8_t cpu_pop_byte(void) {
     return cpu_pop_byte_mode(cpu.L);
 }
 static void cpu_push_byte_mode(uint8_t value, bool mode) {
+    idle.valid = false;
     mem_write_cpu(cpu_address_mode(--cpu.registers.stack[mode].hl, mode), value);
 }
 static void cpu_push_byte(uint8_t value) {
@@ -382,8 +629,8 @@ static void cpu_execute_daa(void) {
     }
 }
 
-static uint32_t cpu_dec_bc_partial_mode() {
-    uint32_t value = cpu_mask_mode((int32_t)cpu.registers.BC - 1, cpu.L);
+static uint32_t cpu_sub_bc_partial_mode(uint32_t count) {
+    uint32_t value = cpu_mask_mode((int32_t)cpu.registers.BC - (int32_t)count, cpu.L);
     if (cpu.L) {
         cpu.registers.BC = value;
     } else {
@@ -392,6 +639,10 @@ static uint32_t cpu_dec_bc_partial_mode() {
     return value;
 }
 
+static uint32_t cpu_dec_bc_partial_mode() {
+    return cpu_sub_bc_partial_mode(1);
+}
+
 static void cpu_rst(uint32_t address, bool stack, bool mode, bool mixed) {
 #ifdef DEBUG_SUPPORT
     debug_record_call(cpu.registers.PC, cpu.L);
@@ -541,13 +792,12 @@ static void cpu_execute_alu(int i, uint8_t v) {
     }
 }
 
-static void cpu_execute_rot(int y, int z, uint32_t address, uint8_t value) {
+uint8_t cpu_rot(int y, uint8_t value) {
     eZ80registers_t *r = &cpu.registers;
     uint8_t old_7 = (value & 0x80) != 0;
     uint8_t old_0 = (value & 0x01) != 0;
     uint8_t old_c = r->flags.C;
     uint8_t new_c;
-    cpu.cycles += z == 6;
     switch (y) {
         case 0: /* RLC value[z] */
             value <<= 1;
@@ -585,12 +835,17 @@ static void cpu_execute_rot(int y, int z, uint32_t address, uint8_t value) {
         default:
             abort();
     }
-    cpu_write_reg_prefetched(z, address, value);
     r->F = cpuflag_c(new_c) | cpuflag_sign_b(value) | cpuflag_parity(value)
         | cpuflag_undef(r->F) | cpuflag_zero(value);
+    return value;
+}
+
+static void cpu_execute_rot(int y, int z, uint32_t address, uint8_t value) {
+    cpu.cycles += z == 6;
+    cpu_write_reg_prefetched(z, address, cpu_rot(y, value));
 }
 
-static void cpu_execute_rot_acc(int y)
+void cpu_execute_rot_acc(int y)
 {
     eZ80registers_t *r = &cpu.registers;
     uint8_t old;
@@ -642,6 +897,153 @@ static void cpu_execute_rot_acc(int y)
     }
 }
 
+/* Number of iterations of a block instruction that can run before BC or the address wraps out of a page */
+static uint32_t cpu_bulk_span(uint32_t address, int_fast8_t delta, uint32_t count) {
+    uint32_t offset = address & (MEM_PAGE_SIZE - 1);
+    uint32_t span = delta > 0 ? MEM_PAGE_SIZE - offset : offset + 1;
+    return span < count ? span : count;
+}
+
+/* Limits count to the iterations that can run before the block is interrupted or a dma transfer is due */
+static uint32_t cpu_bulk_limit(uint32_t count, uint32_t cost, bool dma) {
+    uint32_t cycles = cpu.cycles, limit;
+    if (cpu.next <= cycles) {
+        return 1;
+    }
+    limit = (cpu.next - cycles - 1) / cost + 1;
+    if (limit < count) {
+        count = limit;
+    }
+    if (dma) {
+        limit = sched_dma_next_cycle();
+        limit = limit > cycles ? (limit - cycles) / cost : 0;
+        if (limit < count) {
+            count = limit;
+        }
+    }
+    return count;
+}
+
+static uint32_t cpu_bulk_bc(void) {
+    uint32_t value = cpu_mask_mode(cpu.registers.BC, cpu.L);
+    return value ? value : cpu.L ? 0x1000000 : 0x10000;
+}
+
+/* Runs as many LDIR/LDDR iterations as possible at once when both addresses are plain memory */
+static bool cpu_execute_bulk_ld(int_fast8_t delta) {
+    eZ80registers_t *r = &cpu.registers;
+    uint32_t src = cpu_address_mode(r->HL, cpu.L);
+    uint32_t dst = cpu_address_mode(r->DE, cpu.L);
+    uint32_t count, cost, i;
+    uint8_t *from, *to;
+    if (!(from = mem_page_ptr(src, false)) || !(to = mem_page_ptr(dst, true))) {
+        return false;
+    }
+    count = cpu_bulk_span(dst, delta, cpu_bulk_span(src, delta, cpu_bulk_bc()));
+    cost = (src < 0xD00000 ? flash.waitStates : 4) + 2 + 1;
+    count = cpu_bulk_limit(count, cost, true);
+    if (count < 2) {
+        return false;
+    }
+    if (delta < 0) {
+        from -= count - 1;
+        to -= count - 1;
+        src -= count - 1;
+        dst -= count - 1;
+    }
+#ifdef DEBUG_SUPPORT
+    if (debug_stack_reads(src, count)) {
+        return false;
+    }
+    debug_clear_markers(dst, count);
+#endif
+    if (src >= 0xD00000 && (delta > 0 ? to > from && to < from + count : from > to && from < to + count)) {
+        /* overlapping copies in the direction of the block replicate a pattern */
+        if (delta > 0) {
+            if (to == from + 1) {
+                memset(to, *from, count);
+            } else {
+                for (i = 0; i < count; i++) {
+                    to[i] = from[i];
+                }
+            }
+        } else {
+            if (from == to + 1) {
+                memset(to, from[count - 1], count);
+            } else {
+                for (i = count; i--;) {
+                    to[i] = from[i];
+                }
+            }
+        }
+    } else {
+        memmove(to, from, count);
+    }
+    mem_invalidate_ptr(to, count);
+    r->HL = cpu_mask_mode((int32_t)r->HL + delta * (int32_t)count, cpu.L);
+    r->DE = cpu_mask_mode((int32_t)r->DE + delta * (int32_t)count, cpu.L);
+    r->flags.H = 0;
+    r->flags.PV = cpu_sub_bc_partial_mode(count) != 0; /* Do not mask BC */
+    r->flags.N = 0;
+    r->R += 4 * (count - !r->flags.PV);
+    /* the last memory access was a ram write, followed by one internal cycle */
+    cpu.cycles += count * cost - 1;
+    sched_process_pending_dma(0);
+    cpu.cycles++;
+    return true;
+}
+
+/* Runs as many CPIR/CPDR iterations as possible at once when the address is plain memory */
+static bool cpu_execute_bulk_cp(int_fast8_t delta) {
+    eZ80registers_t *r = &cpu.registers;
+    uint32_t src = cpu_address_mode(r->HL, cpu.L);
+    uint32_t count, cost, i;
+    uint8_t *from, *match, old, new;
+    bool ram = src >= 0xD00000, repeat;
+    if (!(from = mem_page_ptr(src, false))) {
+        return false;
+    }
+    count = cpu_bulk_span(src, delta, cpu_bulk_bc());
+    cost = (ram ? 4 : flash.waitStates) + 2;
+    count = cpu_bulk_limit(count, cost, ram);
+    if (count < 2) {
+        return false;
+    }
+#ifdef DEBUG_SUPPORT
+    if (debug_stack_reads(delta > 0 ? src : src - (count - 1), count)) {
+        return false;
+    }
+#endif
+    if (delta > 0) {
+        if ((match = memchr(from, r->A, count))) {
+            count = match - from + 1;
+        }
+        old = from[count - 1];
+    } else {
+        for (i = 0; i < count && from[-(int32_t)i] != r->A; i++);
+        if (i < count) {
+            count = i + 1;
+        }
+        old = from[-(int32_t)(count - 1)];
+    }
+    new = r->A - old;
+    r->F = cpuflag_sign_b(new) | cpuflag_zero(new)
+        | cpuflag_halfcarry_b_sub(r->A, old, 0)
+        | cpuflag_pv(cpu_sub_bc_partial_mode(count)) /* Do not mask BC */
+        | cpuflag_subtract(1) | cpuflag_c(r->flags.C)
+        | cpuflag_undef(r->F);
+    repeat = !r->flags.Z && r->flags.PV;
+    r->R += 4 * (count - !repeat);
+    r->HL = cpu_mask_mode((int32_t)r->HL + delta * (int32_t)count, cpu.L);
+    /* the last memory access was a read, followed by one or two internal cycles */
+    cpu.cycles += count * cost - 2;
+    if (ram) {
+        sched_process_pending_dma(0);
+    }
+    cpu.cycles += 1 + repeat;
+    return true;
+}
+
 static void cpu_execute_bli() {
     eZ80registers_t *r = &cpu.registers;
     uint8_t old, new = 0;
@@ -651,7 +1053,7 @@ static void cpu_execute_bli() {
     bool repeat = (cpu.context.x | cpu.context.p) & 1;
     do {
 #ifdef DEBUG_SUPPORT
-        if (cpu.inBlock) {
+        if (cpu.inBlock && unlikely(debug.active)) {
             debug_inst_repeat();
         }
 #endif
@@ -666,6 +1068,10 @@ static void cpu_execute_bli() {
                         return;
                 }
                 /* LDI, LDD, LDIR, LDDR */
+                if (repeat && cpu_plain() && cpu_execute_bulk_ld(delta)) {
+                    repeat = r->flags.PV;
+                    continue;
+                }
                 cpu_write_byte(r->DE, cpu_read_byte(r->HL));
                 r->DE = cpu_mask_mode((int32_t)r->DE + delta, cpu.L);
                 r->flags.H = 0;
@@ -685,6 +1091,10 @@ static void cpu_execute_bli() {
                         return;
                 }
                 /* CPI, CPD, CPIR, CPDR */
+                if (repeat && cpu_plain() && cpu_execute_bulk_cp(delta)) {
+                    repeat = !r->flags.Z && r->flags.PV;
+                    continue;
+                }
                 old = cpu_read_byte(r->HL);
                 new = r->A - old;
                 r->F = cpuflag_sign_b(new) | cpuflag_zero(new)
@@ -809,6 +1219,7 @@ static void cpu_execute_bli() {
 
 void cpu_init(void) {
     memset(&cpu, 0, sizeof(eZ80cpu_t));
+    cpu_cache_flush();
     cpu.abort = CPU_ABORT_NONE;
     gui_console_printf("[CEmu] Initialized CPU...\n");
 }
@@ -818,11 +1229,14 @@ void cpu_reset(void) {
     memset(&cpu, 0, sizeof(cpu));
     cpu.preI = preI;
     cpu_restore_next();
+    cpu_cache_flush();
     cpu_flush(0, false);
     gui_console_printf("[CEmu] CPU reset.\n");
 }
 
 void cpu_flush(uint32_t address, bool mode) {
+    cpu_cache_end();
+    idle.valid = false;
     cpu_prefetch(address, mode);
     cpu_inst_start();
     cpu.inBlock = false;
@@ -855,6 +1269,9 @@ void cpu_crash(const char *msg) {
 static void cpu_halt(void) {
     cpu.halted = true;
     cpu_restore_next();
+    if (cpu.cycles < cpu.next && usb_fast_forward()) {
+        cpu_restore_next();
+    }
 #ifdef DEBUG_SUPPORT
     while (cpu.cycles < cpu.next && !cpu.IEF1 && debug.step) {
         cpu.haltCycles++;
@@ -868,6 +1285,217 @@ static void cpu_halt(void) {
     }
 }
 
+static uint8_t cpu_idle_modes(void) {
+    return cpu.ADL | cpu.MADL << 1 | cpu.IEF1 << 2 | cpu.IEF2 << 3 | cpu.IM << 4 | cpu.IEF_wait << 6;
+}
+
+static void cpu_idle_record(uint32_t end) {
+    idle.valid = true;
+    idle.start = cpu.registers.PC;
+    idle.end = end;
+    idle.seconds = cpu.seconds;
+    idle.cycles = cpu.cycles;
+    idle.events = sched_event_next_cycle();
+    idle.dma = sched_dma_next_cycle();
+    idle.maSecond = sched.items[SCHED_PREV_MA].second;
+    idle.maTick = sched.items[SCHED_PREV_MA].tick;
+    idle.R = cpu.registers.R;
+    idle.fetch = mem.fetch;
+    idle.flashUnlocked = control.flashUnlocked;
+    idle.modes = cpu_idle_modes();
+    memcpy(&idle.registers, &cpu.registers, sizeof(idle.registers));
+}
+
+static void cpu_idle_skip(uint32_t end) {
+    eZ80registers_t *r = &cpu.registers;
+    uint32_t cycles = cpu.cycles, period, limit, count, shift, i;
+    uint8_t buffer[sizeof(mem.buffer)];
+    bool dma;
+    if (!idle.valid || idle.start != r->PC || idle.end != end || idle.seconds != cpu.seconds ||
+        cycles >= idle.events || idle.flashUnlocked != control.flashUnlocked || idle.modes != cpu_idle_modes()) {
+        idle.repeats = 0;
+        cpu_idle_record(end);
+        return;
+    }
+    idle.registers.R = r->R;
+    if (memcmp(&idle.registers, r, sizeof(idle.registers))) {
+        idle.repeats = 0;
+        cpu_idle_record(end);
+        return;
+    }
+    /* ram accesses and lcd reads process dma, so such loops have to stop before the next transfer
+     * and leave one iteration to bring the memory access time up to date */
+    dma = idle.maSecond != sched.items[SCHED_PREV_MA].second || idle.maTick != sched.items[SCHED_PREV_MA].tick;
+    if (dma && cycles >= idle.dma) {
+        idle.repeats = 0;
+        cpu_idle_record(end);
+        return;
+    }
+    period = cycles - idle.cycles;
+    limit = cpu.next;
+    if (dma) {
+        if (limit > idle.dma) {
+            limit = idle.dma;
+        }
+        limit = limit > cycles + period ? limit - period : cycles;
+    }
+    /* after enough repeats, the fetch buffer only holds bytes from the loop */
+    if (idle.repeats < CPU_IDLE_REPEATS) {
+        idle.repeats++;
+    } else if (limit > cycles && (count = (limit - cycles) / period)) {
+        cpu.cycles += count * period;
+        r->R += count * (uint8_t)(r->R - idle.R);
+        if ((shift = count * (uint8_t)(mem.fetch - idle.fetch) % sizeof(mem.buffer))) {
+            memcpy(buffer, mem.buffer, sizeof(buffer));
+            for (i = 0; i < sizeof(buffer); i++) {
+                mem.buffer[(i + shift) % sizeof(buffer)] = buffer[i];
+            }
+            mem.fetch += shift;
+        }
+    }
+    cpu_idle_record(end);
+}
+
+/* Called after a taken branch, end being the address following the branch instruction */
+static inline void cpu_idle_loop(uint32_t end) {
+    if (unlikely(end - cpu.registers.PC - 1 < CPU_IDLE_LOOP_SIZE) && cpu_plain()) {
+        cpu_idle_skip(end);
+    }
+}
+
+bool cpu_set_jit_mode(cpu_jit_mode_t mode) {
+    jit.steps = 0;
+    jit.mismatches = 0;
+    if (mode == CPU_JIT_OFF) {
+        jit_free();
+    } else {
+        jit_set_verify(mode == CPU_JIT_VERIFY);
+        if (!jit_supported()) {
+            jit.mode = CPU_JIT_OFF;
+            return false;
+        }
+    }
+    jit.mode = mode;
+    return true;
+}
+
+uint32_t cpu_jit_mismatches(void) {
+    return jit.mismatches;
+}
+
+/* everything a block can change, besides ram which jit_log_undo takes care of */
+typedef struct {
+    eZ80cpu_t cpu;
+    sched_state_t sched;
+    uint8_t idle[sizeof(idle)], buffer[sizeof(mem.buffer)], fetch, flashUnlocked;
+#ifdef DEBUG_SUPPORT
+    debug_stack_entry_t stack[DBG_STACK_SIZE];
+    uint32_t stackIndex, stackSize, stepOut;
+#endif
+} cpu_jit_state_t;
+
+static void cpu_jit_save(cpu_jit_state_t *state) {
+    memcpy(&state->cpu, &cpu, sizeof(cpu));
+    memcpy(&state->sched, &sched, sizeof(sched));
+    memcpy(state->idle, &idle, sizeof(idle));
+    memcpy(state->buffer, mem.buffer, sizeof(mem.buffer));
+    state->fetch = mem.fetch;
+    state->flashUnlocked = control.flashUnlocked;
+#ifdef DEBUG_SUPPORT
+    memcpy(state->stack, debug.stack, sizeof(state->stack));
+    state->stackIndex = debug.stackIndex;
+    state->stackSize = debug.stackSize;
+    state->stepOut = debug.stepOut;
+#endif
+}
+
+static void cpu_jit_restore(const cpu_jit_state_t *state) {
+    uint8_t abort = cpu.abort;
+    memcpy(&cpu, &state->cpu, sizeof(cpu));
+    cpu.abort = abort;
+    memcpy(&sched, &state->sched, sizeof(sched));
+    memcpy(&idle, state->idle, sizeof(idle));
+    memcpy(mem.buffer, state->buffer, sizeof(mem.buffer));
+    mem.fetch = state->fetch;
+    control.flashUnlocked = state->flashUnlocked;
+#ifdef DEBUG_SUPPORT
+    memcpy(debug.stack, state->stack, sizeof(state->stack));
+    debug.stackIndex = state->stackIndex;
+    debug.stackSize = state->stackSize;
+    debug.stepOut = state->stepOut;
+#endif
+}
+
+/* runs the block at pc and takes it back, leaving the same instructions to the interpreter */
+static void cpu_jit_verify(void) {
+    cpu_jit_state_t state;
+    uint32_t dma = sched_dma_next_cycle(), limit = JIT_COUNT, result, end;
+
+    /* dma can't be taken back, so leave room for the last instruction to go past cpu.next */
+    if (dma <= cpu.next || dma - cpu.next < 16 * (flash.waitStates + 4u)) {
+        return;
+    }
+    cpu_jit_save(&state);
+    while (true) {
+        jit_log_start();
+        result = jit_run(limit, &end);
+        if (!(result & JIT_ABORT)) {
+            break;
+        }
+        /* stopped before an access that can't be taken back, so run up to the instruction doing it */
+        jit_log_undo();
+        cpu_jit_restore(&state);
+        if (!(limit = result & JIT_COUNT)) {
+            jit_log_stop();
+            return;
+        }
+    }
+    if (!(result & JIT_COUNT)) {
+        jit_log_stop();
+        return;
+    }
+    if (result & JIT_TAKEN) {
+        cpu_idle_loop(end);
+    }
+    cpu_inst_start();
+    memcpy(&jit.cpu, &cpu, sizeof(cpu));
+    memcpy(jit.buffer, mem.buffer, sizeof(mem.buffer));
+    jit.fetch = mem.fetch;
+    jit.flashUnlocked = control.flashUnlocked;
+    jit_log_undo();
+    cpu_jit_restore(&state);
+    jit.steps = result & JIT_COUNT;
+    jit.start = cpu.registers.PC;
+    jit.adl = cpu.ADL;
+}
+
+/* called once the interpreter ran the instructions of the verified block */
+static void cpu_jit_check(void) {
+    bool match = jit_log_check();
+    jit.cpu.abort = cpu.abort;
+    if (!match || memcmp(&jit.cpu, &cpu, sizeof(cpu)) || jit.fetch != mem.fetch ||
+        jit.flashUnlocked != control.flashUnlocked || memcmp(jit.buffer, mem.buffer, sizeof(mem.buffer))) {
+        jit.mismatches++;
+        gui_console_err_printf("[CEmu] Recompiler mismatch in the block at 0x%06X.\n", jit.start);
+        jit_discard(jit.start, jit.adl);
+    }
+}
+
+/* returns true if a translated block ran instead of the next instruction */
+static bool cpu_jit(void) {
+    uint32_t result, end;
+    cpu_cache_end();
+    if (jit.mode == CPU_JIT_VERIFY) {
+        cpu_jit_verify();
+        return false;
+    }
+    result = jit_run(JIT_COUNT, &end);
+    if (result & JIT_TAKEN) {
+        cpu_idle_loop(end);
+    }
+    return result & JIT_COUNT;
+}
+
 void cpu_restore_next(void) {
     if (cpu.NMI || (cpu.IEF1 && (intrpt->status & intrpt->enabled)) || cpu.abort != CPU_ABORT_NONE) {
         cpu.next = cpu.cycles;
@@ -936,6 +1564,13 @@ void cpu_execute(void) {
             goto cpu_execute_bli_continue;
         }
         do {
+            if (!cpu.PREFIX && !cpu.SUFFIX) {
+                if (unlikely(jit.mode != CPU_JIT_OFF) && !jit.steps && cpu_plain() && cpu_jit()) {
+                    cpu_inst_start();
+                    continue;
+                }
+                cpu_cache_begin();
+            }
             /* fetch opcode */
             context.opcode = cpu_fetch_byte();
             r->R += 2;
@@ -964,7 +1599,9 @@ void cpu_execute(void) {
                                     break;
                                 case 3: /* JR d */
                                     s = cpu_fetch_offset();
+                                    w = r->PC;
                                     cpu_prefetch(cpu_mask_mode((int32_t)r->PC + s, cpu.L), cpu.ADL);
+                                    cpu_idle_loop(w);
                                     break;
                                 case 4:
                                 case 5:
@@ -973,7 +1610,9 @@ void cpu_execute(void) {
                                     s = cpu_fetch_offset();
                                     if (cpu_read_cc(context.y - 4)) {
                                         cpu.cycles++;
+                                        w = r->PC;
                                         cpu_prefetch(cpu_mask_mode((int32_t)r->PC + s, cpu.L), cpu.ADL);
+                                        cpu_idle_loop(w);
                                     }
                                     break;
                             }
@@ -1205,7 +1844,10 @@ void cpu_execute(void) {
                         case 2: /* JP cc[y], nn */
                             if (cpu_read_cc(context.y)) {
                                 cpu.cycles++;
-                                cpu_jump(cpu_fetch_word_no_prefetch(), cpu.L);
+                                w = cpu_fetch_word_no_prefetch();
+                                old_word = r->PC;
+                                cpu_jump(w, cpu.L);
+                                cpu_idle_loop(old_word);
                             } else {
                                 cpu_fetch_word();
                             }
@@ -1218,7 +1860,10 @@ void cpu_execute(void) {
                             switch (context.y) {
                                 case 0: /* JP nn */
                                     cpu.cycles++;
-                                    cpu_jump(cpu_fetch_word_no_prefetch(), cpu.L);
+                                    w = cpu_fetch_word_no_prefetch();
+                                    old_word = r->PC;
+                                    cpu_jump(w, cpu.L);
+                                    cpu_idle_loop(old_word);
                                     break;
                                 case 1: /* 0xCB prefixed opcodes */
                                     w = cpu_index_address();
@@ -1622,14 +2267,18 @@ void cpu_execute(void) {
                     break;
             }
             cpu_inst_start();
+            if (unlikely(jit.steps) && !--jit.steps) {
+                cpu_jit_check();
+            }
         } while (cpu.PREFIX || cpu.SUFFIX || cpu.cycles < cpu.next);
     }
 }
 
-bool cpu_restore(FILE *image) {
-    return fread(&cpu, sizeof(cpu), 1, image) == 1;
+bool cpu_restore(image_t *image) {
+    cpu_cache_flush();
+    return image_read(image, &cpu, sizeof(cpu));
 }
 
-bool cpu_save(FILE *image) {
-    return fwrite(&cpu, sizeof(cpu), 1, image) == 1;
+bool cpu_save(image_t *image) {
+    return image_write(image, &cpu, sizeof(cpu));
 }
@@ -20,6 +20,7 @@
 #ifndef CPU_H
 #define CPU_H
 
+#include "image.h"
 #include "atomics.h"
 #include "defines.h"
 
@@ -35,6 +36,20 @@ extern "C" {
 
 #define cpu_mask_mode(address, mode) ((uint32_t)((address) & ((mode) ? 0xFFFFFF : 0xFFFF)))
 
+/* modes of the instruction fetch cache, the interpreter runs every instruction in all of them */
+typedef enum cpu_cache_mode {
+    CPU_CACHE_OFF,     /* fetch everything through the memory decoder (reference behavior) */
+    CPU_CACHE_ON,
+    CPU_CACHE_VERIFY,  /* self-check: compare every cached byte with memory before using it */
+} cpu_cache_mode_t;
+
+/* modes of the recompiler, see jit.h */
+typedef enum cpu_jit_mode {
+    CPU_JIT_OFF,
+    CPU_JIT_ON,
+    CPU_JIT_VERIFY,    /* self-check: run each block, take it back and compare with the interpreter */
+} cpu_jit_mode_t;
+
 typedef enum eZ80abort {
     CPU_ABORT_NONE,
     CPU_ABORT_RESET,
@@ -87,7 +102,7 @@ typedef struct eZ80cpu {
     };
 } eZ80cpu_t;
 
-extern eZ80cpu_t cpu;
+extern EMU_LOCAL eZ80cpu_t cpu;
 
 uint32_t cpu_address_mode(uint32_t address, bool mode);
 void cpu_init(void);
@@ -98,8 +113,16 @@ void cpu_execute(void);
 void cpu_restore_next(void);
 void cpu_transition_abort(uint8_t from, uint8_t to);
 void cpu_crash(const char *msg);
-bool cpu_restore(FILE *image);
-bool cpu_save(FILE *image);
+void cpu_cache_flush(void);
+void cpu_cache_invalidate(uint32_t address, uint32_t size);
+void cpu_set_cache_mode(cpu_cache_mode_t mode);
+uint32_t cpu_cache_mismatches(void);
+bool cpu_set_jit_mode(cpu_jit_mode_t mode);   /* false if there is no recompiler for this host */
+uint32_t cpu_jit_mismatches(void);
+void cpu_set_shortcuts(bool enabled);   /* bulk block instructions and idle loop skipping, on by default */
+void cpu_idle_break(void);   /* call on accesses with side effects */
+bool cpu_restore(image_t *image);
+bool cpu_save(image_t *image);
 
 #ifdef __cplusplus
 }
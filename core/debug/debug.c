@@ -2,6 +2,7 @@
 
 #include "debug.h"
 #include "../mem.h"
+#include "../lcd.h"
 #include "../emu.h"
 #include "../cpu.h"
 #include "../vat.h"
@@ -10,9 +11,15 @@
 #include <string.h>
 #include <stdlib.h>
 
-debug_state_t debug;
+EMU_LOCAL debug_state_t debug;
+
+static void debug_update(void) {
+    debug.active = debug.numWatches || debug.numPorts || debug.step || debug.stepOver ||
+                   debug.tempExec != ~0u || debug.stepOut != ~0u || debug.stepBasic || debug.stepBasicNext;
+}
 
 void debug_init(void) {
+    debug.numWatches = debug.numPorts = 0;
     debug_clear_step();
     debug.stackIndex = debug.stackSize = 0;
     debug.stack = (debug_stack_entry_t*)calloc(DBG_STACK_SIZE, sizeof(debug_stack_entry_t));
@@ -41,6 +48,7 @@ void debug_open(int reason, uint32_t data) {
     }
 
     debug_clear_step();
+    lcd_flush_panel();
 
     /* fixup reason for basic debugger */
     if (debug.basicMode == true) {
@@ -90,24 +98,33 @@ void debug_open(int reason, uint32_t data) {
     cpu.haltCycles = debug.cpuHaltCycles;
     debug.dmaCycles -= cpu.dmaCycles;
     debug.totalCycles -= sched_total_cycles();
+    cpu_idle_break();
 }
 
 void debug_watch(uint32_t addr, int mask, bool set) {
+    bool old;
     addr &= 0xFFFFFF;
+    old = debug.addr[addr] & DBG_MASK_RWX;
     if (set) {
         debug.addr[addr] |= mask;
     } else {
         debug.addr[addr] &= ~mask;
     }
+    debug.numWatches += (bool)(debug.addr[addr] & DBG_MASK_RWX) - old;
+    debug_update();
 }
 
 void debug_ports(uint16_t addr, int mask, bool set) {
+    bool old;
     addr &= 0xFFFF;
+    old = debug.port[addr];
     if (set) {
         debug.port[addr] |= mask;
     } else {
         debug.port[addr] &= ~mask;
     }
+    debug.numPorts += (bool)debug.port[addr] - old;
+    debug_update();
 }
 
 void debug_flag(int mask, bool set) {
@@ -148,11 +165,34 @@ void debug_step(int mode, uint32_t addr) {
             debug.stepBasicNextAddr = addr;
             break;
     }
+    debug_update();
 }
 
 void debug_clear_step(void) {
     debug.step = debug.stepOver = false;
     debug.tempExec = debug.stepOut = ~0u;
+    debug_update();
+}
+
+void debug_clear_basic_step(void) {
+    debug.stepBasic = debug.stepBasicNext = false;
+    debug_update();
+}
+
+bool debug_stack_reads(uint32_t addr, uint32_t count) {
+    debug_stack_entry_t *entry = &debug.stack[debug.stackIndex];
+    uint32_t low = entry->stack - 2 - entry->mode;
+    if (entry->mode != cpu.L) {
+        return false;
+    }
+    return (addr <= entry->stack && addr + count > low) ||
+           (uint32_t)entry->retAddr + entry->range - addr < count;
+}
+
+void debug_clear_markers(uint32_t addr, uint32_t count) {
+    while (count--) {
+        debug.addr[addr++ & 0xFFFFFF] &= ~(DBG_INST_START_MARKER | DBG_INST_MARKER);
+    }
 }
 
 void debug_inst_start(void) {
@@ -160,6 +200,7 @@ void debug_inst_start(void) {
     debug.addr[pc] |= DBG_INST_START_MARKER;
     if (debug.step && !(debug.addr[pc] & DBG_MASK_EXEC) && pc != debug.tempExec) {
         debug.step = debug.stepOver = false;
+        debug_update();
         debug_open(DBG_STEP, cpu.registers.PC);
     }
 }
@@ -180,6 +221,7 @@ void debug_inst_repeat(void) {
             gui_debug_close();
         } else {
             debug.step = false;
+            debug_update();
             debug_open(DBG_STEP, cpu.registers.PC);
         }
     }
@@ -202,6 +244,7 @@ void debug_record_call(uint32_t retAddr, bool mode) {
         gui_debug_close();
         debug.step = debug.stepOver = false;
         debug.stepOut = index;
+        debug_update();
     }
 }
 
@@ -227,6 +270,7 @@ void debug_record_ret(uint32_t retAddr, bool mode) {
     if (found && stepOut) {
         debug.step = true;
         debug.stepOut = ~0u;
+        debug_update();
     }
 }
 
@@ -74,6 +74,7 @@ void debug_watch(uint32_t addr, int mask, bool set); /* set a breakpoint or a wa
 void debug_ports(uint16_t addr, int mask, bool set); /* set port monitor flags */
 void debug_flag(int mask, bool set);                 /* configure setup of debug core */
 void debug_step(int mode, uint32_t addr);            /* set a step mode, addr points to the instruction after pc */
+void debug_clear_basic_step(void);                   /* stop a basic step once it was reached */
 void debug_open(int reason, uint32_t data);          /* open the debugger (Should only be called from gui_do_stuff) */
 bool debug_is_open(void);                            /* returns the status of the core debugger */
 void debug_enable_basic_mode(bool fetches);
@@ -96,6 +97,7 @@ bool debug_get_executing_basic_prgm(char *name);
 #define DBG_MASK_WRITE        (1 << 1)   /* write watchpoint */
 #define DBG_MASK_EXEC         (1 << 2)   /* breakpoint */
 #define DBG_MASK_RW           ((DBG_MASK_READ) | (DBG_MASK_WRITE))
+#define DBG_MASK_RWX          ((DBG_MASK_RW) | (DBG_MASK_EXEC))
 
 
 /* internal items below this line */
@@ -151,6 +153,8 @@ typedef struct {
 
     uint8_t *addr;
     uint8_t *port;
+    uint32_t numWatches, numPorts;
+    bool active;   /* breakpoints, watchpoints, port monitors or steps need the instrumented paths */
     _Atomic(int) flags;
     _Atomic(bool) open;
     _Atomic(bool) ignore;
@@ -162,7 +166,7 @@ typedef struct {
     uint32_t stepBasicNextAddr;
 } debug_state_t;
 
-extern debug_state_t debug;
+extern EMU_LOCAL debug_state_t debug;
 
 enum {
     DBG_STEP_IN=DBG_STEP+1,
@@ -177,6 +181,8 @@ enum {
 /* internal core functions */
 void debug_step_switch(void);
 void debug_clear_step(void);
+bool debug_stack_reads(uint32_t addr, uint32_t count);   /* true if reading the range would update the call stack */
+void debug_clear_markers(uint32_t addr, uint32_t count); /* instruction markers are stale once written */
 
 #ifdef __cplusplus
 }
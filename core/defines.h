@@ -39,6 +39,21 @@
 # define EMSCRIPTEN_KEEPALIVE
 #endif
 
+/* define MULTI_INSTANCE to give every thread its own emulator state */
+/* the state then belongs to the thread that loaded it, so frontends that */
+/* inspect the core from another thread (like the Qt gui) must not use it */
+#ifdef MULTI_INSTANCE
+# if defined(__cplusplus)
+#  define EMU_LOCAL thread_local
+# elif defined(_MSC_VER)
+#  define EMU_LOCAL __declspec(thread)
+# else
+#  define EMU_LOCAL _Thread_local
+# endif
+#else
+# define EMU_LOCAL
+#endif
+
 #define GETMASK(index, size) (((1U << (size)) - 1) << (index))
 #define READFROM(data, index, size) (((data) & GETMASK((index), (size))) >> (index))
 #define WRITE(data, index, size, value) ((data) = ((data) & (~GETMASK((index), (size)))) | ((uint32_t)(value) << (index)))
@@ -18,6 +18,10 @@
 #endif
 
 #define IMAGE_VERSION 0xCECE0015
+#define IMAGE_CHUNKED 0xCECE0100 /* image files, each chunk has its own version */
+
+/* store flash so that loading the image can map it rather than read it */
+static EMU_LOCAL bool image_mappable;
 
 void EMSCRIPTEN_KEEPALIVE emu_exit(void) {
     cpu.abort = CPU_ABORT_EXIT;
@@ -27,6 +31,50 @@ void EMSCRIPTEN_KEEPALIVE emu_reset(void) {
     asic_reset();
 }
 
+image_t *emu_save_capture(const char *path) {
+    image_t *image;
+
+    if (mem.flash.block == NULL || mem.ram.block == NULL || path == NULL) {
+        return NULL;
+    }
+
+    /* the capture copies flash out of the mapping, unless the image is written over the file it maps */
+    if ((mem_flash_mapped_from(path) && !mem_unshare_flash()) || !(image = (image_t*)malloc(sizeof(image_t)))) {
+        return NULL;
+    }
+
+    image_open_capture(image);
+    image->mapped = image_mappable ? IMAGE_TAG_FLASH : 0;
+    if (!asic_save(image)) {
+        image_close(image);
+        free(image);
+        return NULL;
+    }
+
+    return image;
+}
+
+bool emu_save_finish(image_t *image, const char *path) {
+    uint32_t version = IMAGE_CHUNKED;
+    bool success = false;
+    FILE *file;
+
+    if (image == NULL) {
+        return false;
+    }
+
+    if (path != NULL && (file = fopen_utf8(path, "wb"))) {
+        success = fwrite(&version, sizeof version, 1, file) == 1 &&
+                  image_save_capture(image, file) &&
+                  os_sync(file);
+        success = !fclose(file) && success;
+    }
+
+    image_close(image);
+    free(image);
+    return success;
+}
+
 bool emu_save(emu_data_t type, const char *path) {
     FILE *file = NULL;
     bool success = false;
@@ -35,18 +83,25 @@ bool emu_save(emu_data_t type, const char *path) {
         return false;
     }
 
+    if (type == EMU_DATA_IMAGE) {
+        return emu_save_finish(emu_save_capture(path), path);
+    }
+
+    /* the path may be the rom file that flash is mapped from */
+    if (mem_flash_mapped_from(path) && !mem_unshare_flash()) {
+        return false;
+    }
+
     if ((file = fopen_utf8(path, "wb"))) {
-        uint32_t version = IMAGE_VERSION;
         switch (type) {
-            case EMU_DATA_IMAGE:
-                success = fwrite(&version, sizeof version, 1, file) == 1 && asic_save(file);
-                break;
             case EMU_DATA_ROM:
                 success = fwrite(mem.flash.block, 1, SIZE_FLASH, file) == SIZE_FLASH;
                 break;
             case EMU_DATA_RAM:
                 success = fwrite(mem.ram.block, 1, SIZE_RAM, file) == SIZE_RAM;
                 break;
+            default:
+                break;
         }
         fclose(file);
     }
@@ -58,6 +113,8 @@ emu_state_t emu_load(emu_data_t type, const char *path) {
     uint32_t version;
     emu_state_t state = EMU_STATE_INVALID;
     FILE *file = NULL;
+    image_t image;
+    long mapped = -1;
 
     if (!path) {
         return state;
@@ -75,19 +132,36 @@ emu_state_t emu_load(emu_data_t type, const char *path) {
 
         if (fread(&version, sizeof(version), 1, file) != 1) goto rerr;
 
-        if (version != IMAGE_VERSION) {
+        /* flat images from older versions still load if nothing changed since */
+        if (version == IMAGE_CHUNKED) {
+            image_open_chunked(&image, file);
+            mapped = image_find_mapped(file, IMAGE_TAG_FLASH, SIZE_FLASH);
+            if (fseek(file, sizeof(version), SEEK_SET) < 0) goto rerr;
+        } else if (version == IMAGE_VERSION) {
+            image_open_file(&image, file);
+        } else {
             gui_console_printf("[CEmu] Error in versioning.\n");
             goto rerr;
         }
 
         asic_free();
+        if (mapped > 0 && mem_share_flash(file, (size_t)mapped)) {
+            image.mapped = IMAGE_TAG_FLASH;
+        }
         asic_init();
         asic_reset();
 
-        if (!asic_restore(file)) {
-            gui_console_printf("[CEmu] Error reading image.\n");
+        if (!asic_restore(&image)) {
+            if (image.chunked && image.tag) {
+                gui_console_printf("[CEmu] Error reading image chunk '%c%c%c%c'.\n",
+                                   (char)image.tag, (char)(image.tag >> 8), (char)(image.tag >> 16), (char)(image.tag >> 24));
+            } else {
+                gui_console_printf("[CEmu] Error reading image.\n");
+            }
+            image_close(&image);
             goto rerr;
         }
+        image_close(&image);
 
         gui_console_printf("[CEmu] Loaded Emulator Image.\n");
 
@@ -103,6 +177,7 @@ emu_state_t emu_load(emu_data_t type, const char *path) {
         ti_device_t device_type = TI84PCE;
         uint32_t offset;
         size_t size;
+        bool shared;
 
         gui_console_printf("[CEmu] Loading ROM Image...\n");
 
@@ -122,9 +197,10 @@ emu_state_t emu_load(emu_data_t type, const char *path) {
         rewind(file);
 
         asic_free();
+        shared = size == SIZE_FLASH && mem_share_flash(file, 0);
         asic_init();
 
-        if (fread(mem.flash.block, size, 1, file) != 1) {
+        if (!shared && fread(mem.flash.block, size, 1, file) != 1) {
             gui_console_printf("[CEmu] Error reading ROM image\n");
             goto rerr;
         }
@@ -222,6 +298,7 @@ emu_state_t emu_load(emu_data_t type, const char *path) {
             gui_console_printf("[CEmu] Error reading RAM image.\n", (unsigned int)size, SIZE_RAM);
             goto rerr;
         }
+        mem_invalidate_ptr(mem.ram.block, SIZE_RAM);
 
         gui_console_printf("[CEmu] Loaded RAM Image.\n");
     }
@@ -238,6 +315,106 @@ rerr:
     return state;
 }
 
+static bool emu_snapshot_write(image_t *image, bool delta) {
+    uint32_t version = IMAGE_VERSION;
+    uint32_t serial = mem_base_serial();
+
+    image->delta = delta;
+    return image_write(image, &version, sizeof version)
+           && (!delta || image_write(image, &serial, sizeof serial))
+           && asic_save(image);
+}
+
+static bool emu_snapshot_ready(bool delta) {
+    return mem.flash.block != NULL && mem.ram.block != NULL && (!delta || mem_base_serial());
+}
+
+static size_t emu_snapshot_count(bool delta) {
+    image_t image;
+
+    if (!emu_snapshot_ready(delta)) {
+        return 0;
+    }
+
+    image_open_mem(&image, NULL, 0);
+    return emu_snapshot_write(&image, delta) ? image.offset : 0;
+}
+
+static bool emu_snapshot_save_mode(void *buffer, size_t size, bool delta) {
+    image_t image;
+
+    if (buffer == NULL || !emu_snapshot_ready(delta)) {
+        return false;
+    }
+
+    image_open_mem(&image, buffer, size);
+    return emu_snapshot_write(&image, delta);
+}
+
+size_t emu_snapshot_size(void) {
+    return emu_snapshot_count(false);
+}
+
+bool emu_snapshot_save(void *buffer, size_t size) {
+    return emu_snapshot_save_mode(buffer, size, false);
+}
+
+bool emu_snapshot_restore(const void *buffer, size_t size) {
+    uint32_t version;
+    image_t image;
+
+    if (buffer == NULL || size != emu_snapshot_size()) {
+        return false;
+    }
+
+    image_open_mem(&image, (void *)buffer, size);
+    if (!image_read(&image, &version, sizeof version) || version != IMAGE_VERSION) {
+        return false;
+    }
+
+    return asic_restore(&image);
+}
+
+bool emu_snapshot_set_base(void) {
+    return emu_snapshot_ready(false) && mem_set_base();
+}
+
+size_t emu_snapshot_delta_size(void) {
+    return emu_snapshot_count(true);
+}
+
+bool emu_snapshot_save_delta(void *buffer, size_t size) {
+    return emu_snapshot_save_mode(buffer, size, true);
+}
+
+static bool emu_snapshot_apply_delta(const void *buffer, size_t size, bool rebased) {
+    uint32_t version, serial;
+    image_t image;
+
+    if (buffer == NULL || !emu_snapshot_ready(true)) {
+        return false;
+    }
+
+    image_open_mem(&image, (void *)buffer, size);
+    image.delta = true;
+    if (!image_read(&image, &version, sizeof version) || version != IMAGE_VERSION ||
+        !image_read(&image, &serial, sizeof serial) || !serial || (!rebased && serial != mem_base_serial())) {
+        return false;
+    }
+
+    return asic_restore(&image);
+}
+
+bool emu_snapshot_restore_delta(const void *buffer, size_t size) {
+    return emu_snapshot_apply_delta(buffer, size, false);
+}
+
+bool emu_snapshot_restore_delta_from(const void *base, size_t base_size, const void *buffer, size_t size) {
+    /* the base memory is back exactly as it was, only its serial is new */
+    return emu_snapshot_restore(base, base_size) && emu_snapshot_set_base() &&
+           emu_snapshot_apply_delta(buffer, size, true);
+}
+
 void emu_run(uint64_t ticks) {
     sched.run_event_triggered = false;
     sched_repeat(SCHED_RUN, ticks);
@@ -258,6 +435,10 @@ void emu_run(uint64_t ticks) {
     }
 }
 
+void emu_set_image_mappable(bool mappable) {
+    image_mappable = mappable;
+}
+
 void emu_set_run_rate(uint32_t rate) {
     sched_set_clock(CLOCK_RUN, rate);
 }
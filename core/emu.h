@@ -11,6 +11,7 @@ extern "C" {
 #include "asic.h"
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
 
 typedef enum {
@@ -27,8 +28,20 @@ typedef enum {
 
 /* emulator functions for frontend use */
 /* these should only be called from the emulation thread if multithreaded */
+/* with MULTI_INSTANCE an emulator belongs to the thread that loaded it, other threads see their own */
 emu_state_t emu_load(emu_data_t type, const char *path);  /* load an emulator state */
 bool emu_save(emu_data_t type, const char *path);         /* save an emulator state */
+image_t *emu_save_capture(const char *path);              /* copy the state for emu_save_finish to write to path, quick enough to call between frames */
+bool emu_save_finish(image_t *capture, const char *path); /* compress, write and sync a capture to an image file, then free it, safe from any thread */
+void emu_set_image_mappable(bool mappable);                /* save flash uncompressed in images, so loading maps it in lazily instead of reading it */
+size_t emu_snapshot_size(void);                           /* buffer size needed for a snapshot, 0 if nothing is loaded */
+bool emu_snapshot_save(void *buffer, size_t size);        /* save the emulator state to memory */
+bool emu_snapshot_restore(const void *buffer, size_t size); /* restore a snapshot in place, without reallocating memory */
+bool emu_snapshot_set_base(void);                         /* use the current memory as the base for delta snapshots */
+size_t emu_snapshot_delta_size(void);                     /* buffer size needed for a delta snapshot, 0 if there is no base */
+bool emu_snapshot_save_delta(void *buffer, size_t size);  /* save the state, storing only memory pages written since the base */
+bool emu_snapshot_restore_delta(const void *buffer, size_t size); /* restore a delta snapshot taken against the current base */
+bool emu_snapshot_restore_delta_from(const void *base, size_t base_size, const void *buffer, size_t size); /* same against an older base, given the snapshot saved right after setting it */
 void emu_run(uint64_t ticks);                             /* core emulation function, call after emu_load */
 void emu_set_run_rate(uint32_t rate);                     /* how many ticks per second for emu_run */
 uint32_t emu_get_run_rate(void);                          /* getter for the above */
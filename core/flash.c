@@ -1,12 +1,13 @@
 #include "flash.h"
 #include "emu.h"
+#include "mem.h"
 #include "os/os.h"
 
 #include <string.h>
 #include <stdio.h>
 
 /* Global flash state */
-flash_state_t flash;
+EMU_LOCAL flash_state_t flash;
 
 static void flash_set_map(uint8_t map) {
     flash.map = map & 0x0F;
@@ -63,14 +64,16 @@ static void flash_write(const uint16_t pio, const uint8_t byte, bool poke) {
             break;
         case 0x08:
             flash.ports[index] = byte & 1;
-            break;
+            return;
         case 0x10:
             flash.ports[index] = byte & 1;
-            break;
+            return;
         default:
             flash.ports[index] = byte;
-            break;
+            return;
     }
+    /* only the mapping and wait states decide which flash pages are direct */
+    mem_update_page_range(0, 0x7FFFFF);
 }
 
 static const eZ80portrange_t device = {
@@ -86,15 +89,16 @@ eZ80portrange_t init_flash(void) {
     flash.waitStates = 10;
     flash.mapped = 1;
     flash_set_map(6);
+    mem_update_pages();
 
     gui_console_printf("[CEmu] Initialized Flash...\n");
     return device;
 }
 
-bool flash_save(FILE *image) {
-    return fwrite(&flash, sizeof(flash), 1, image) == 1;
+bool flash_save(image_t *image) {
+    return image_write(image, &flash, sizeof(flash));
 }
 
-bool flash_restore(FILE *image) {
-    return fread(&flash, sizeof(flash), 1, image) == 1;
+bool flash_restore(image_t *image) {
+    return image_read(image, &flash, sizeof(flash));
 }
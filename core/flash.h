@@ -5,6 +5,7 @@
 extern "C" {
 #endif
 
+#include "image.h"
 #include "port.h"
 #include <stdint.h>
 #include <stdbool.h>
@@ -18,11 +19,11 @@ typedef struct flash_state {
     uint8_t map    : 4;
 } flash_state_t;
 
-extern flash_state_t flash;
+extern EMU_LOCAL flash_state_t flash;
 
 eZ80portrange_t init_flash(void);
-bool flash_restore(FILE *image);
-bool flash_save(FILE *image);
+bool flash_restore(image_t *image);
+bool flash_save(image_t *image);
 
 #ifdef __cplusplus
 }
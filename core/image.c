@@ -0,0 +1,505 @@
+#include "image.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* chunk header: tag, version, flags, stored and uncompressed sizes, and crc32 of the stored data, little endian */
+#define IMAGE_CHUNK_HEADER 20
+#define IMAGE_CHUNK_COMPRESSED 1
+#define IMAGE_CHUNK_ALIGNED 2 /* stored data starts at a multiple of IMAGE_ALIGNMENT in the file */
+#define IMAGE_ALIGNMENT 0x10000
+
+#define IMAGE_HASH_BITS 12
+#define IMAGE_MIN_MATCH 4
+
+typedef struct image_chunk {
+    uint32_t tag;
+    uint16_t version;
+    uint16_t flags;
+    uint32_t stored;
+    uint32_t size;
+    uint32_t crc;
+} image_chunk_t;
+
+void image_open_file(image_t *image, FILE *file) {
+    image->file = file;
+    image->data = NULL;
+    image->size = 0;
+    image->offset = 0;
+    image->capacity = 0;
+    image->delta = false;
+    image->chunked = false;
+    image->writing = false;
+    image->tag = 0;
+    image->version = 0;
+    image->mapped = 0;
+}
+
+void image_open_mem(image_t *image, void *data, size_t size) {
+    image_open_file(image, NULL);
+    image->data = data;
+    image->size = size;
+}
+
+void image_open_chunked(image_t *image, FILE *file) {
+    image_open_file(image, file);
+    image->chunked = true;
+}
+
+void image_open_capture(image_t *image) {
+    image_open_file(image, NULL);
+    image->chunked = true;
+    image->writing = true;
+}
+
+static bool image_reserve(image_t *image, size_t size) {
+    uint8_t *data;
+    size_t capacity = image->capacity ? image->capacity : 4096;
+
+    if (size <= image->capacity) {
+        return true;
+    }
+    while (capacity < size) {
+        capacity *= 2;
+    }
+    if (!(data = realloc(image->data, capacity))) {
+        return false;
+    }
+    image->data = data;
+    image->capacity = capacity;
+    return true;
+}
+
+bool image_write(image_t *image, const void *src, size_t size) {
+    if (image->chunked) {
+        if (!image->tag || !image_reserve(image, image->offset + size)) {
+            return false;
+        }
+        memcpy(image->data + image->offset, src, size);
+        image->offset += size;
+        return true;
+    }
+    if (image->file) {
+        return fwrite(src, size, 1, image->file) == 1;
+    }
+    if (image->data) {
+        if (size > image->size - image->offset) {
+            return false;
+        }
+        memcpy(image->data + image->offset, src, size);
+    }
+    image->offset += size;
+    return true;
+}
+
+bool image_read(image_t *image, void *dst, size_t size) {
+    if (image->file && !image->chunked) {
+        return fread(dst, size, 1, image->file) == 1;
+    }
+    if (size > image->size - image->offset || (size && !image->data)) {
+        return false;
+    }
+    if (size) {
+        memcpy(dst, image->data + image->offset, size);
+    }
+    image->offset += size;
+    return true;
+}
+
+static uint32_t image_crc32(const uint8_t *data, size_t size) {
+    static const uint32_t table[256] = {
+        0x00000000, 0x77073096, 0xEE0E612C, 0x990951BA, 0x076DC419, 0x706AF48F, 0xE963A535, 0x9E6495A3,
+        0x0EDB8832, 0x79DCB8A4, 0xE0D5E91E, 0x97D2D988, 0x09B64C2B, 0x7EB17CBD, 0xE7B82D07, 0x90BF1D91,
+        0x1DB71064, 0x6AB020F2, 0xF3B97148, 0x84BE41DE, 0x1ADAD47D, 0x6DDDE4EB, 0xF4D4B551, 0x83D385C7,
+        0x136C9856, 0x646BA8C0, 0xFD62F97A, 0x8A65C9EC, 0x14015C4F, 0x63066CD9, 0xFA0F3D63, 0x8D080DF5,
+        0x3B6E20C8, 0x4C69105E, 0xD56041E4, 0xA2677172, 0x3C03E4D1, 0x4B04D447, 0xD20D85FD, 0xA50AB56B,
+        0x35B5A8FA, 0x42B2986C, 0xDBBBC9D6, 0xACBCF940, 0x32D86CE3, 0x45DF5C75, 0xDCD60DCF, 0xABD13D59,
+        0x26D930AC, 0x51DE003A, 0xC8D75180, 0xBFD06116, 0x21B4F4B5, 0x56B3C423, 0xCFBA9599, 0xB8BDA50F,
+        0x2802B89E, 0x5F058808, 0xC60CD9B2, 0xB10BE924, 0x2F6F7C87, 0x58684C11, 0xC1611DAB, 0xB6662D3D,
+        0x76DC4190, 0x01DB7106, 0x98D220BC, 0xEFD5102A, 0x71B18589, 0x06B6B51F, 0x9FBFE4A5, 0xE8B8D433,
+        0x7807C9A2, 0x0F00F934, 0x9609A88E, 0xE10E9818, 0x7F6A0DBB, 0x086D3D2D, 0x91646C97, 0xE6635C01,
+        0x6B6B51F4, 0x1C6C6162, 0x856530D8, 0xF262004E, 0x6C0695ED, 0x1B01A57B, 0x8208F4C1, 0xF50FC457,
+        0x65B0D9C6, 0x12B7E950, 0x8BBEB8EA, 0xFCB9887C, 0x62DD1DDF, 0x15DA2D49, 0x8CD37CF3, 0xFBD44C65,
+        0x4DB26158, 0x3AB551CE, 0xA3BC0074, 0xD4BB30E2, 0x4ADFA541, 0x3DD895D7, 0xA4D1C46D, 0xD3D6F4FB,
+        0x4369E96A, 0x346ED9FC, 0xAD678846, 0xDA60B8D0, 0x44042D73, 0x33031DE5, 0xAA0A4C5F, 0xDD0D7CC9,
+        0x5005713C, 0x270241AA, 0xBE0B1010, 0xC90C2086, 0x5768B525, 0x206F85B3, 0xB966D409, 0xCE61E49F,
+        0x5EDEF90E, 0x29D9C998, 0xB0D09822, 0xC7D7A8B4, 0x59B33D17, 0x2EB40D81, 0xB7BD5C3B, 0xC0BA6CAD,
+        0xEDB88320, 0x9ABFB3B6, 0x03B6E20C, 0x74B1D29A, 0xEAD54739, 0x9DD277AF, 0x04DB2615, 0x73DC1683,
+        0xE3630B12, 0x94643B84, 0x0D6D6A3E, 0x7A6A5AA8, 0xE40ECF0B, 0x9309FF9D, 0x0A00AE27, 0x7D079EB1,
+        0xF00F9344, 0x8708A3D2, 0x1E01F268, 0x6906C2FE, 0xF762575D, 0x806567CB, 0x196C3671, 0x6E6B06E7,
+        0xFED41B76, 0x89D32BE0, 0x10DA7A5A, 0x67DD4ACC, 0xF9B9DF6F, 0x8EBEEFF9, 0x17B7BE43, 0x60B08ED5,
+        0xD6D6A3E8, 0xA1D1937E, 0x38D8C2C4, 0x4FDFF252, 0xD1BB67F1, 0xA6BC5767, 0x3FB506DD, 0x48B2364B,
+        0xD80D2BDA, 0xAF0A1B4C, 0x36034AF6, 0x41047A60, 0xDF60EFC3, 0xA867DF55, 0x316E8EEF, 0x4669BE79,
+        0xCB61B38C, 0xBC66831A, 0x256FD2A0, 0x5268E236, 0xCC0C7795, 0xBB0B4703, 0x220216B9, 0x5505262F,
+        0xC5BA3BBE, 0xB2BD0B28, 0x2BB45A92, 0x5CB36A04, 0xC2D7FFA7, 0xB5D0CF31, 0x2CD99E8B, 0x5BDEAE1D,
+        0x9B64C2B0, 0xEC63F226, 0x756AA39C, 0x026D930A, 0x9C0906A9, 0xEB0E363F, 0x72076785, 0x05005713,
+        0x95BF4A82, 0xE2B87A14, 0x7BB12BAE, 0x0CB61B38, 0x92D28E9B, 0xE5D5BE0D, 0x7CDCEFB7, 0x0BDBDF21,
+        0x86D3D2D4, 0xF1D4E242, 0x68DDB3F8, 0x1FDA836E, 0x81BE16CD, 0xF6B9265B, 0x6FB077E1, 0x18B74777,
+        0x88085AE6, 0xFF0F6A70, 0x66063BCA, 0x11010B5C, 0x8F659EFF, 0xF862AE69, 0x616BFFD3, 0x166CCF45,
+        0xA00AE278, 0xD70DD2EE, 0x4E048354, 0x3903B3C2, 0xA7672661, 0xD06016F7, 0x4969474D, 0x3E6E77DB,
+        0xAED16A4A, 0xD9D65ADC, 0x40DF0B66, 0x37D83BF0, 0xA9BCAE53, 0xDEBB9EC5, 0x47B2CF7F, 0x30B5FFE9,
+        0xBDBDF21C, 0xCABAC28A, 0x53B39330, 0x24B4A3A6, 0xBAD03605, 0xCDD70693, 0x54DE5729, 0x23D967BF,
+        0xB3667A2E, 0xC4614AB8, 0x5D681B02, 0x2A6F2B94, 0xB40BBE37, 0xC30C8EA1, 0x5A05DF1B, 0x2D02EF8D
+    };
+    uint32_t crc = ~UINT32_C(0);
+
+    while (size--) {
+        crc = crc >> 8 ^ table[(crc ^ *data++) & 0xFF];
+    }
+    return ~crc;
+}
+
+/* lz4 style sequences: a token holding the literal and match length nibbles, any extra literal */
+/* length bytes, the literals, a 16 bit match offset and any extra match length bytes */
+/* the last sequence only has literals */
+static uint32_t image_load32(const uint8_t *ptr) {
+    uint32_t value;
+    memcpy(&value, ptr, sizeof(value));
+    return value;
+}
+
+static size_t image_put_length(uint8_t *dst, size_t pos, size_t length) {
+    if (length >= 15) {
+        for (length -= 15; length >= 255; length -= 255) {
+            dst[pos++] = 255;
+        }
+        dst[pos++] = (uint8_t)length;
+    }
+    return pos;
+}
+
+static bool image_get_length(const uint8_t *src, size_t size, size_t *pos, size_t *length) {
+    uint8_t byte;
+
+    if (*length == 15) {
+        do {
+            if (*pos == size) {
+                return false;
+            }
+            byte = src[(*pos)++];
+            *length += byte;
+        } while (byte == 255);
+    }
+    return true;
+}
+
+/* returns the new output position, or 0 if the sequence doesn't fit */
+static size_t image_put_sequence(uint8_t *dst, size_t pos, size_t capacity, const uint8_t *literals, size_t count, size_t offset, size_t length) {
+    size_t match = length ? length - IMAGE_MIN_MATCH : 0;
+
+    if (1 + count + count / 255 + 1 + (length ? 3 + match / 255 : 0) > capacity - pos) {
+        return 0;
+    }
+    dst[pos++] = (uint8_t)((count < 15 ? count : 15) << 4 | (match < 15 ? match : 15));
+    pos = image_put_length(dst, pos, count);
+    memcpy(dst + pos, literals, count);
+    pos += count;
+    if (length) {
+        dst[pos++] = (uint8_t)offset;
+        dst[pos++] = (uint8_t)(offset >> 8);
+        pos = image_put_length(dst, pos, match);
+    }
+    return pos;
+}
+
+/* returns the compressed size, or 0 if it would not fit in capacity */
+static size_t image_compress(const uint8_t *src, size_t size, uint8_t *dst, size_t capacity) {
+    uint32_t table[1 << IMAGE_HASH_BITS] = { 0 }; /* positions plus one, so 0 is empty */
+    size_t pos = 0, anchor = 0, out = 0;
+
+    while (pos + IMAGE_MIN_MATCH <= size) {
+        uint32_t sequence = image_load32(src + pos);
+        uint32_t hash = (sequence * UINT32_C(2654435761)) >> (32 - IMAGE_HASH_BITS);
+        size_t ref = table[hash] ? table[hash] - 1 : pos;
+
+        table[hash] = (uint32_t)pos + 1;
+        if (ref < pos && pos - ref <= UINT16_MAX && image_load32(src + ref) == sequence) {
+            size_t length = IMAGE_MIN_MATCH;
+            while (pos + length < size && src[ref + length] == src[pos + length]) {
+                length++;
+            }
+            if (!(out = image_put_sequence(dst, out, capacity, src + anchor, pos - anchor, pos - ref, length))) {
+                return 0;
+            }
+            pos += length;
+            anchor = pos;
+        } else {
+            pos++;
+        }
+    }
+    return image_put_sequence(dst, out, capacity, src + anchor, size - anchor, 0, 0);
+}
+
+static bool image_decompress(const uint8_t *src, size_t size, uint8_t *dst, size_t expected) {
+    size_t in = 0, out = 0, count, offset;
+    uint8_t token;
+
+    while (in < size) {
+        token = src[in++];
+        count = token >> 4;
+        if (!image_get_length(src, size, &in, &count) || count > size - in || count > expected - out) {
+            return false;
+        }
+        memcpy(dst + out, src + in, count);
+        in += count;
+        out += count;
+        if (in == size) {
+            break;
+        }
+        if (size - in < 2) {
+            return false;
+        }
+        offset = src[in] | (size_t)src[in + 1] << 8;
+        in += 2;
+        count = token & 15;
+        if (!image_get_length(src, size, &in, &count)) {
+            return false;
+        }
+        count += IMAGE_MIN_MATCH;
+        if (!offset || offset > out || count > expected - out) {
+            return false;
+        }
+        /* overlapping matches repeat the last offset bytes, which is how runs are stored */
+        /* every copy doubles the length of the repeated pattern */
+        while (count > offset) {
+            memcpy(dst + out, dst + out - offset, offset);
+            out += offset;
+            count -= offset;
+            offset *= 2;
+        }
+        memcpy(dst + out, dst + out - offset, count);
+        out += count;
+    }
+    return out == expected;
+}
+
+static void image_put32(uint8_t *ptr, uint32_t value) {
+    ptr[0] = (uint8_t)value;
+    ptr[1] = (uint8_t)(value >> 8);
+    ptr[2] = (uint8_t)(value >> 16);
+    ptr[3] = (uint8_t)(value >> 24);
+}
+
+static uint32_t image_get32(const uint8_t *ptr) {
+    return ptr[0] | (uint32_t)ptr[1] << 8 | (uint32_t)ptr[2] << 16 | (uint32_t)ptr[3] << 24;
+}
+
+static bool image_read_header(FILE *file, image_chunk_t *chunk) {
+    uint8_t header[IMAGE_CHUNK_HEADER];
+
+    if (fread(header, sizeof(header), 1, file) != 1) {
+        return false;
+    }
+    chunk->tag = image_get32(header);
+    chunk->version = header[4] | header[5] << 8;
+    chunk->flags = header[6] | header[7] << 8;
+    chunk->stored = image_get32(header + 8);
+    chunk->size = image_get32(header + 12);
+    chunk->crc = image_get32(header + 16);
+    return true;
+}
+
+/* reads the data following a header, dst has to hold chunk->size bytes */
+static bool image_read_data(FILE *file, const image_chunk_t *chunk, uint8_t *dst) {
+    uint8_t *packed;
+    bool success;
+
+    if (chunk->flags & IMAGE_CHUNK_COMPRESSED) {
+        if (!(packed = malloc(chunk->stored ? chunk->stored : 1))) {
+            return false;
+        }
+        success = fread(packed, 1, chunk->stored, file) == chunk->stored &&
+                  image_crc32(packed, chunk->stored) == chunk->crc &&
+                  image_decompress(packed, chunk->stored, dst, chunk->size);
+        free(packed);
+    } else {
+        success = chunk->stored == chunk->size &&
+                  fread(dst, 1, chunk->size, file) == chunk->size &&
+                  image_crc32(dst, chunk->size) == chunk->crc;
+    }
+    return success;
+}
+
+static bool image_write_data(FILE *file, const image_chunk_t *chunk, const uint8_t *data) {
+    uint8_t header[IMAGE_CHUNK_HEADER];
+
+    image_put32(header, chunk->tag);
+    header[4] = (uint8_t)chunk->version;
+    header[5] = (uint8_t)(chunk->version >> 8);
+    header[6] = (uint8_t)chunk->flags;
+    header[7] = (uint8_t)(chunk->flags >> 8);
+    image_put32(header + 8, chunk->stored);
+    image_put32(header + 12, chunk->size);
+    image_put32(header + 16, chunk->crc);
+
+    return fwrite(header, sizeof(header), 1, file) == 1 &&
+           fwrite(data, 1, chunk->stored, file) == chunk->stored;
+}
+
+/* writes a padding chunk so that the data of the next chunk starts aligned */
+static bool image_write_padding(FILE *file) {
+    image_chunk_t chunk;
+    uint8_t *padding;
+    long pos = ftell(file);
+    bool success;
+
+    if (pos < 0) {
+        return false;
+    }
+    chunk.tag = IMAGE_TAG_PAD;
+    chunk.version = 1;
+    chunk.flags = 0;
+    chunk.size = chunk.stored = (IMAGE_ALIGNMENT - ((size_t)pos + 2 * IMAGE_CHUNK_HEADER) % IMAGE_ALIGNMENT) % IMAGE_ALIGNMENT;
+    if (!(padding = calloc(chunk.size ? chunk.size : 1, 1))) {
+        return false;
+    }
+    chunk.crc = image_crc32(padding, chunk.size);
+    success = image_write_data(file, &chunk, padding);
+    free(padding);
+    return success;
+}
+
+static bool image_flush_chunk(FILE *file, const image_chunk_t *raw, const uint8_t *data, uint32_t mapped) {
+    image_chunk_t chunk = *raw;
+    uint8_t *packed = NULL;
+    bool success;
+
+    chunk.flags = 0;
+    chunk.stored = chunk.size;
+
+    if (chunk.tag == mapped) {
+        chunk.flags = IMAGE_CHUNK_ALIGNED;
+        if (!image_write_padding(file)) {
+            return false;
+        }
+    } else if ((packed = malloc(chunk.size ? chunk.size : 1))) {
+        size_t stored = image_compress(data, chunk.size, packed, chunk.size);
+        if (stored && stored < chunk.size) {
+            chunk.flags = IMAGE_CHUNK_COMPRESSED;
+            chunk.stored = (uint32_t)stored;
+            data = packed;
+        }
+    }
+
+    chunk.crc = image_crc32(data, chunk.stored);
+    success = image_write_data(file, &chunk, data);
+    free(packed);
+    return success;
+}
+
+/* captured chunks are kept uncompressed, each after a native image_chunk_t holding its size */
+static void image_end_chunk(image_t *image) {
+    image_chunk_t chunk;
+
+    if (image->tag) {
+        memcpy(&chunk, image->data + image->size, sizeof(chunk));
+        chunk.size = (uint32_t)(image->offset - image->size - sizeof(chunk));
+        memcpy(image->data + image->size, &chunk, sizeof(chunk));
+    }
+}
+
+bool image_write_chunk(image_t *image, uint32_t tag, uint16_t version) {
+    image_chunk_t chunk;
+
+    if (!image->chunked) {
+        return true;
+    }
+    image_end_chunk(image);
+    chunk.tag = tag;
+    chunk.version = version;
+    chunk.flags = 0;
+    chunk.stored = chunk.size = chunk.crc = 0;
+    if (!image_reserve(image, image->offset + sizeof(chunk))) {
+        return false;
+    }
+    memcpy(image->data + image->offset, &chunk, sizeof(chunk));
+    image->tag = tag;
+    image->version = version;
+    image->size = image->offset; /* start of the chunk */
+    image->offset += sizeof(chunk);
+    return true;
+}
+
+bool image_save_capture(image_t *image, FILE *file) {
+    image_chunk_t chunk;
+    size_t pos;
+
+    image_end_chunk(image);
+    image->tag = 0;
+    for (pos = 0; pos < image->offset; pos += chunk.size) {
+        memcpy(&chunk, image->data + pos, sizeof(chunk));
+        pos += sizeof(chunk);
+        if (!image_flush_chunk(file, &chunk, image->data + pos, image->mapped)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool image_read_chunk(image_t *image, uint32_t tag, uint16_t version) {
+    image_chunk_t chunk;
+
+    if (!image->chunked) {
+        return true;
+    }
+    /* anything left over means the layout changed without a version bump */
+    if (image->tag && image->offset != image->size) {
+        return false;
+    }
+    image->tag = tag;
+    image->version = version;
+    image->size = image->offset = 0;
+    do {
+        if (!image_read_header(image->file, &chunk)) {
+            return false;
+        }
+    } while (chunk.tag == IMAGE_TAG_PAD && !fseek(image->file, (long)chunk.stored, SEEK_CUR));
+    if (chunk.tag != tag || chunk.version != version) {
+        return false;
+    }
+    /* the caller mapped the data of this chunk, so it doesn't need to be read */
+    if (tag == image->mapped) {
+        return (chunk.flags & IMAGE_CHUNK_ALIGNED) && !fseek(image->file, (long)chunk.stored, SEEK_CUR);
+    }
+    if (!image_reserve(image, chunk.size) || !image_read_data(image->file, &chunk, image->data)) {
+        return false;
+    }
+    image->size = chunk.size;
+    return true;
+}
+
+long image_find_mapped(FILE *file, uint32_t tag, size_t size) {
+    image_chunk_t chunk;
+
+    while (image_read_header(file, &chunk)) {
+        if (chunk.tag == tag) {
+            if (chunk.flags & IMAGE_CHUNK_ALIGNED && chunk.size == size) {
+                return ftell(file);
+            }
+            break;
+        }
+        if (fseek(file, (long)chunk.stored, SEEK_CUR)) {
+            break;
+        }
+    }
+    return -1;
+}
+
+bool image_end(image_t *image) {
+    if (image->chunked) {
+        return image->offset == image->size && fgetc(image->file) == EOF;
+    }
+    if (image->file) {
+        return fgetc(image->file) == EOF;
+    }
+    return image->offset == image->size;
+}
+
+void image_close(image_t *image) {
+    if (image->chunked) {
+        free(image->data);
+        image->data = NULL;
+        image->capacity = 0;
+    }
+}
+
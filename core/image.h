@@ -0,0 +1,74 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/* chunk tags are four characters, stored so they show up as text in a hex dump */
+#define IMAGE_TAG(a, b, c, d) ((uint32_t)(a) | (uint32_t)(b) << 8 | (uint32_t)(c) << 16 | (uint32_t)(d) << 24)
+
+#define IMAGE_TAG_ASIC IMAGE_TAG('A', 'S', 'I', 'C')
+#define IMAGE_TAG_BACKLIGHT IMAGE_TAG('B', 'K', 'L', 'T')
+#define IMAGE_TAG_CONTROL IMAGE_TAG('C', 'T', 'R', 'L')
+#define IMAGE_TAG_CPU IMAGE_TAG('C', 'P', 'U', ' ')
+#define IMAGE_TAG_FLASH_CTRL IMAGE_TAG('F', 'C', 'T', 'L')
+#define IMAGE_TAG_INTERRUPT IMAGE_TAG('I', 'N', 'T', 'R')
+#define IMAGE_TAG_KEYPAD IMAGE_TAG('K', 'E', 'Y', 'P')
+#define IMAGE_TAG_LCD IMAGE_TAG('L', 'C', 'D', ' ')
+#define IMAGE_TAG_MEM IMAGE_TAG('M', 'E', 'M', ' ')
+#define IMAGE_TAG_FLASH IMAGE_TAG('F', 'L', 'S', 'H')
+#define IMAGE_TAG_RAM IMAGE_TAG('R', 'A', 'M', ' ')
+#define IMAGE_TAG_WATCHDOG IMAGE_TAG('W', 'D', 'O', 'G')
+#define IMAGE_TAG_PROTECT IMAGE_TAG('P', 'R', 'O', 'T')
+#define IMAGE_TAG_RTC IMAGE_TAG('R', 'T', 'C', ' ')
+#define IMAGE_TAG_SHA256 IMAGE_TAG('S', 'H', 'A', ' ')
+#define IMAGE_TAG_GPT IMAGE_TAG('G', 'P', 'T', ' ')
+#define IMAGE_TAG_USB IMAGE_TAG('U', 'S', 'B', ' ')
+#define IMAGE_TAG_CXXX IMAGE_TAG('C', 'X', 'X', 'X')
+#define IMAGE_TAG_SPI IMAGE_TAG('S', 'P', 'I', ' ')
+#define IMAGE_TAG_EXXX IMAGE_TAG('E', 'X', 'X', 'X')
+#define IMAGE_TAG_SCHED IMAGE_TAG('S', 'C', 'H', 'D')
+#define IMAGE_TAG_PAD IMAGE_TAG('P', 'A', 'D', ' ')
+
+/* stream used by the state save and restore functions */
+/* backed by a file, a caller provided buffer, or nothing to just count bytes */
+/* chunked files hold one compressed and checksummed chunk per module, the chunk being read is buffered in data */
+/* captures collect the chunks uncompressed in data, so they can be compressed and written out later on any thread */
+typedef struct image {
+    FILE *file;
+    uint8_t *data;
+    size_t size;
+    size_t offset;
+    size_t capacity;
+    bool delta;   /* memory only stores the pages written since mem_set_base */
+    bool chunked;
+    bool writing;
+    uint32_t tag; /* chunk being accessed, still set after a chunk fails to load */
+    uint16_t version;
+    uint32_t mapped; /* chunk stored uncompressed and aligned when writing, or already mapped by the caller when reading */
+} image_t;
+
+void image_open_file(image_t *image, FILE *file);
+void image_open_mem(image_t *image, void *data, size_t size);
+void image_open_chunked(image_t *image, FILE *file); /* for reading */
+void image_open_capture(image_t *image);
+bool image_write(image_t *image, const void *src, size_t size);
+bool image_read(image_t *image, void *dst, size_t size);
+bool image_write_chunk(image_t *image, uint32_t tag, uint16_t version); /* start the next chunk, does nothing unless chunked */
+bool image_read_chunk(image_t *image, uint32_t tag, uint16_t version);  /* load the next chunk, which has to match */
+bool image_end(image_t *image);   /* true if nothing is left to read */
+bool image_save_capture(image_t *image, FILE *file); /* compress and write the chunks of a capture */
+void image_close(image_t *image); /* free the buffer of a chunked image or capture */
+long image_find_mapped(FILE *file, uint32_t tag, size_t size); /* file offset of the data of a chunk that can be mapped, or -1 */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -6,7 +6,7 @@
 #include <string.h>
 #include <stdio.h>
 
-interrupt_state_t intrpt[2];
+EMU_LOCAL interrupt_state_t intrpt[2];
 
 void intrpt_pulse(uint32_t mask) {
     intrpt_set(mask, true);
@@ -122,20 +122,20 @@ eZ80portrange_t init_intrpt(void) {
     return device;
 }
 
-bool intrpt_save(FILE *image) {
+bool intrpt_save(image_t *image) {
     bool ret = false;
     size_t request;
     for (request = 0; request < sizeof(intrpt) / sizeof(*intrpt); request++) {
-        ret |= fwrite(&intrpt[request], sizeof(intrpt[request]), 1, image) == 1;
+        ret |= image_write(image, &intrpt[request], sizeof(intrpt[request]));
     }
     return ret;
 }
 
-bool intrpt_restore(FILE *image) {
+bool intrpt_restore(image_t *image) {
     bool ret = false;
     size_t request;
     for (request = 0; request < sizeof(intrpt) / sizeof(*intrpt); request++) {
-        ret |= fread(&intrpt[request], sizeof(intrpt[request]), 1, image) == 1;
+        ret |= image_read(image, &intrpt[request], sizeof(intrpt[request]));
     }
     return ret;
 }
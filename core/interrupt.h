@@ -5,6 +5,7 @@
 extern "C" {
 #endif
 
+#include "image.h"
 #include "port.h"
 #include <stdio.h>
 #include <stdint.h>
@@ -33,14 +34,14 @@ typedef struct interrupt_state {
     uint32_t          :  2;
 } interrupt_state_t;
 
-extern interrupt_state_t intrpt[2];
+extern EMU_LOCAL interrupt_state_t intrpt[2];
 
 eZ80portrange_t init_intrpt(void);
 void intrpt_reset(void);
 void intrpt_pulse(uint32_t int_num);
 void intrpt_set(uint32_t int_num, bool set);
-bool intrpt_restore(FILE *image);
-bool intrpt_save(FILE *image);
+bool intrpt_restore(image_t *image);
+bool intrpt_save(image_t *image);
 
 #ifdef __cplusplus
 }
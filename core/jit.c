@@ -0,0 +1,1470 @@
+#include "jit.h"
+#include "cpu.h"
+#include "mem.h"
+#include "defines.h"
+#include "registers.h"
+#include "os/os.h"
+#include "debug/debug.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64)
+
+/* Blocks start at an address that ran JIT_HOT times and end at the first unconditional branch,
+ * the first instruction that isn't translated, or the end of the 256 byte page. Translated code
+ * calls back into the memory decoder for every access, so wait states, dma and mmio behave as in
+ * the interpreter, and leaves at the next instruction boundary after anything the block can't
+ * assume, such as an mmio access, a write to translated code or reaching the next event. */
+#define JIT_BLOCKS      0x2000
+#define JIT_HOT         8
+#define JIT_HOT_SHIFT   10        /* pages with code that keeps changing need up to 8 << 10 runs */
+#define JIT_BLOCK_SIZE  32
+#define JIT_CODE_SIZE   0x400000
+#define JIT_CODE_LIMIT  0x8000    /* code one block can take at most */
+#define JIT_LOG_SIZE    0x100
+#define JIT_INVALID     0xFFFFFFFF
+#define JIT_MARKS       ((SIZE_FLASH + SIZE_RAM) >> 3)
+
+#define JIT_EXIT_STOP   1         /* leave at the next instruction boundary */
+#define JIT_EXIT_ABORT  2         /* verifying: leave now, the access didn't happen */
+
+typedef uint32_t (*jit_code_t)(eZ80cpu_t *state, void *context);
+
+typedef struct {
+    uint32_t key;       /* pc | adl << 24 */
+    uint16_t gen;       /* generation of the page when translated */
+    uint16_t hits;
+    uint8_t opcode;
+    bool failed;
+    jit_code_t code;
+} jit_block_t;
+
+typedef struct {
+    /* accessed by translated code, keep in front */
+    uint8_t exit, limit;
+    uint16_t unused;
+    uint32_t end;
+
+    bool verify, overflow;
+    uint8_t log;        /* 1 while the translated code runs, 2 while the interpreter does */
+    uint8_t *code;
+    uint32_t used;
+    jit_block_t blocks[JIT_BLOCKS];
+    uint16_t gen[0x10000];
+    uint8_t rewrites[0x10000];  /* times translated code in a page was overwritten */
+    uint8_t marks[JIT_MARKS];   /* translated bytes of flash, then of ram */
+    struct {
+        uint8_t *ptr;
+        uint8_t value;
+    } undo[JIT_LOG_SIZE];
+    struct {
+        uint32_t address;
+        uint8_t value;
+    } writes[2][JIT_LOG_SIZE];
+    uint32_t undoCount, writeCount[2];
+} jit_state_t;
+
+static EMU_LOCAL jit_state_t *jit;
+static EMU_LOCAL bool jitVerify, jitUnavailable;
+
+#define JIT_CPU(field) ((uint32_t)offsetof(eZ80cpu_t, field))
+#define JIT_REG(field) JIT_CPU(registers.field)
+
+/* index in the marks, or JIT_INVALID if code at address is never translated */
+static uint32_t jit_mark_index(uint32_t address) {
+    if (address < SIZE_FLASH) {
+        return address;
+    }
+    if (address - 0xD00000 < SIZE_RAM) {
+        return SIZE_FLASH + address - 0xD00000;
+    }
+    return JIT_INVALID;
+}
+
+static jit_block_t *jit_block(uint32_t key) {
+    return &jit->blocks[(key ^ key >> 13) & (JIT_BLOCKS - 1)];
+}
+
+static void jit_block_reset(jit_block_t *block, uint32_t key) {
+    block->key = key;
+    block->gen = jit->gen[key >> 8 & 0xFFFF];
+    block->hits = 0;
+    block->failed = false;
+    block->code = NULL;
+}
+
+void jit_flush(void) {
+    uint32_t i;
+    if (!jit) {
+        return;
+    }
+    for (i = 0; i < JIT_BLOCKS; i++) {
+        jit->blocks[i].key = JIT_INVALID;
+        jit->blocks[i].code = NULL;
+    }
+    memset(jit->gen, 0, sizeof(jit->gen));
+    memset(jit->rewrites, 0, sizeof(jit->rewrites));
+    memset(jit->marks, 0, sizeof(jit->marks));
+    jit->used = 0;
+    jit->exit |= JIT_EXIT_STOP;
+}
+
+static bool jit_alloc(void) {
+    if (jitUnavailable) {
+        return false;
+    }
+    if (!(jit = calloc(1, sizeof(jit_state_t)))) {
+        jitUnavailable = true;
+        return false;
+    }
+    if (!(jit->code = os_alloc_exec(JIT_CODE_SIZE))) {
+        free(jit);
+        jit = NULL;
+        jitUnavailable = true;
+        return false;
+    }
+    jit->verify = jitVerify;
+    jit_flush();
+    return true;
+}
+
+bool jit_supported(void) {
+    return jit || jit_alloc();
+}
+
+void jit_free(void) {
+    if (jit) {
+        os_free_exec(jit->code, JIT_CODE_SIZE);
+        free(jit);
+        jit = NULL;
+    }
+}
+
+void jit_set_verify(bool verify) {
+    jitVerify = verify;
+    if (jit && jit->verify != verify) {
+        jit->verify = verify;
+        jit_flush();
+    }
+}
+
+void jit_discard(uint32_t address, bool adl) {
+    uint32_t key = address | (uint32_t)adl << 24;
+    jit_block_t *block;
+    if (!jit) {
+        return;
+    }
+    block = jit_block(key);
+    jit_block_reset(block, key);
+    block->failed = true;
+}
+
+static void jit_log_write(uint32_t address, uint32_t size) {
+    uint32_t *count = &jit->writeCount[jit->log - 1];
+    while (size--) {
+        if (*count == JIT_LOG_SIZE) {
+            jit->overflow = true;
+            return;
+        }
+        jit->writes[jit->log - 1][(*count)++].address = address++;
+    }
+}
+
+void jit_invalidate(uint32_t address, uint32_t size) {
+    uint32_t index, page;
+    if (!jit) {
+        return;
+    }
+    if (jit->log) {
+        jit_log_write(address, size);
+    }
+    for (; size; size--, address++) {
+        index = jit_mark_index(address & 0xFFFFFF);
+        if (index == JIT_INVALID || !(jit->marks[index >> 3] & 1 << (index & 7))) {
+            continue;
+        }
+        /* drop every block of the page */
+        page = address >> 8 & 0xFFFF;
+        memset(&jit->marks[(index & ~0xFFu) >> 3], 0, 0x100 >> 3);
+        jit->exit |= JIT_EXIT_STOP;
+        if (jit->rewrites[page] < JIT_HOT_SHIFT) {
+            jit->rewrites[page]++;
+        }
+        if (!++jit->gen[page]) {
+            jit_flush();
+            return;
+        }
+    }
+}
+
+static uint8_t jit_log_value(uint32_t address) {
+    uint32_t index = jit_mark_index(address & 0xFFFFFF);
+    if (index == JIT_INVALID) {
+        return 0;
+    }
+    return index < SIZE_FLASH ? mem.flash.block[index] : mem.ram.block[index - SIZE_FLASH];
+}
+
+static void jit_log_values(int phase) {
+    uint32_t i;
+    for (i = 0; i < jit->writeCount[phase]; i++) {
+        jit->writes[phase][i].value = jit_log_value(jit->writes[phase][i].address);
+    }
+}
+
+void jit_log_start(void) {
+    if (jit) {
+        jit->log = 1;
+        jit->overflow = false;
+        jit->undoCount = jit->writeCount[0] = jit->writeCount[1] = 0;
+    }
+}
+
+void jit_log_undo(void) {
+    if (!jit) {
+        return;
+    }
+    jit_log_values(0);
+    jit->log = 0;
+    while (jit->undoCount) {
+        jit->undoCount--;
+        *jit->undo[jit->undoCount].ptr = jit->undo[jit->undoCount].value;
+        mem_invalidate_ptr(jit->undo[jit->undoCount].ptr, 1);
+    }
+    jit->log = 2;
+}
+
+void jit_log_stop(void) {
+    if (jit) {
+        jit->log = 0;
+    }
+}
+
+bool jit_log_check(void) {
+    uint32_t i;
+    if (!jit) {
+        return true;
+    }
+    jit_log_values(1);
+    jit->log = 0;
+    if (jit->overflow || jit->writeCount[0] != jit->writeCount[1]) {
+        return false;
+    }
+    for (i = 0; i < jit->writeCount[0]; i++) {
+        if (jit->writes[0][i].address != jit->writes[1][i].address ||
+            jit->writes[0][i].value != jit->writes[1][i].value) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Operations called by translated code, they do what the interpreter's version does. When
+ * verifying, an access that can't be taken back sets JIT_EXIT_ABORT instead of happening. */
+
+static bool jit_abort(uint32_t address, bool write) {
+    if (unlikely(jit->exit & JIT_EXIT_ABORT)) {
+        return true;
+    }
+    if (likely(!jit->verify) || mem_page_ptr(address, write)) {
+        return false;
+    }
+    jit->exit |= JIT_EXIT_ABORT;
+    return true;
+}
+
+/* cpu_prefetch */
+static void jit_prefetch(uint32_t address) {
+    uint32_t pc = cpu_address_mode(address, cpu.ADL);
+    if (jit_abort(pc, false)) {
+        return;
+    }
+    cpu.registers.rawPC = cpu_mask_mode(address + 1, cpu.ADL);
+    cpu.registers.PC = pc;
+    cpu.prefetch = mem_read_cpu(pc, true);
+}
+
+/* cpu_fetch_byte, count times */
+static uint32_t jit_fetch_more(uint32_t count) {
+    while (count--) {
+#ifdef DEBUG_SUPPORT
+        debug.addr[cpu.registers.PC] |= DBG_INST_MARKER;
+#endif
+        jit_prefetch(cpu.registers.PC + 1);
+    }
+    return 0;
+}
+
+/* the same at the start of an instruction */
+static uint32_t jit_fetch(uint32_t count) {
+#ifdef DEBUG_SUPPORT
+    debug.addr[cpu.registers.PC] |= DBG_INST_START_MARKER;
+#endif
+    return jit_fetch_more(count);
+}
+
+/* mem_read_cpu of data, the address already in cpu space */
+static uint32_t jit_read(uint32_t address) {
+    if (!mem_page_ptr(address, false)) {
+        if (jit_abort(address, false)) {
+            return 0;
+        }
+        jit->exit |= JIT_EXIT_STOP;
+    }
+    return mem_read_cpu(address, false);
+}
+
+static uint32_t jit_write(uint32_t address, uint32_t value) {
+    uint8_t *ptr = mem_page_ptr(address, true);
+    if (!ptr) {
+        if (jit_abort(address, true)) {
+            return 0;
+        }
+        jit->exit |= JIT_EXIT_STOP;
+    } else if (jit->log == 1) {
+        if (jit->undoCount == JIT_LOG_SIZE) {
+            jit->exit |= JIT_EXIT_ABORT;
+            return 0;
+        }
+        jit->undo[jit->undoCount].ptr = ptr;
+        jit->undo[jit->undoCount++].value = *ptr;
+    }
+    cpu_idle_break();
+    mem_write_cpu(address, value);
+    return 0;
+}
+
+/* cpu_push_word */
+static uint32_t jit_push(uint32_t value) {
+    uint32_t *sp = &cpu.registers.stack[cpu.L].hl;
+    if (cpu.L) {
+        jit_write(cpu_address_mode(--*sp, true), value >> 16);
+    }
+    if (!(jit->exit & JIT_EXIT_ABORT)) {
+        jit_write(cpu_address_mode(--*sp, cpu.L), value >> 8);
+    }
+    if (!(jit->exit & JIT_EXIT_ABORT)) {
+        jit_write(cpu_address_mode(--*sp, cpu.L), value);
+    }
+    return 0;
+}
+
+/* cpu_pop_word */
+static uint32_t jit_pop(void) {
+    uint32_t *sp = &cpu.registers.stack[cpu.L].hl;
+    uint32_t value = jit_read(cpu_address_mode(*sp, cpu.L));
+    if (jit->exit & JIT_EXIT_ABORT) {
+        return 0;
+    }
+    ++*sp;
+    value |= jit_read(cpu_address_mode(*sp, cpu.L)) << 8;
+    if (jit->exit & JIT_EXIT_ABORT) {
+        return 0;
+    }
+    ++*sp;
+    if (cpu.L) {
+        value |= jit_read(cpu_address_mode(*sp, true)) << 16;
+        if (jit->exit & JIT_EXIT_ABORT) {
+            return 0;
+        }
+        ++*sp;
+    }
+    return value;
+}
+
+/* the prefetch of a taken jr or djnz */
+static uint32_t jit_branch(uint32_t address) {
+    jit_prefetch(address);
+    return 0;
+}
+
+/* cpu_jump */
+static uint32_t jit_jump(uint32_t address) {
+    jit_prefetch(address);
+#ifdef DEBUG_SUPPORT
+    if (!(jit->exit & JIT_EXIT_ABORT)) {
+        debug_record_ret(address, cpu.ADL);
+    }
+#endif
+    return 0;
+}
+
+/* jp (hl) */
+static uint32_t jit_jump_index(uint32_t address) {
+    uint32_t discard = cpu_address_mode(cpu.registers.PC + 1, cpu.ADL);
+    if (jit_abort(discard, false)) {
+        return 0;
+    }
+    mem_read_cpu(discard, true);
+    return jit_jump(address);
+}
+
+/* cpu_call without a suffix */
+static uint32_t jit_call(uint32_t address) {
+#ifdef DEBUG_SUPPORT
+    debug_record_call(cpu.registers.PC, cpu.L);
+#endif
+    jit_push(cpu.registers.PC);
+    if (!(jit->exit & JIT_EXIT_ABORT)) {
+        jit_prefetch(address);
+    }
+    return 0;
+}
+
+/* cpu_return without a suffix */
+static uint32_t jit_ret(void) {
+    uint32_t address;
+    cpu.cycles++;
+    address = jit_pop();
+    if (!(jit->exit & JIT_EXIT_ABORT)) {
+        jit_jump(address);
+    }
+    return 0;
+}
+
+/* x86-64 emitter, rbx holds &cpu and rbp the jit state */
+enum { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+enum { X_ADD, X_OR, X_ADC, X_SBB, X_AND, X_SUB, X_XOR, X_CMP };
+enum { X_O, X_NO, X_B, X_AE, X_E, X_NE, X_BE, X_A };
+enum { X_SHL = 4, X_SHR = 5 };
+
+#ifdef _WIN32
+#define JIT_ARG0 RCX
+#define JIT_ARG1 RDX
+#else
+#define JIT_ARG0 RDI
+#define JIT_ARG1 RSI
+#endif
+
+typedef struct {
+    uint8_t *ptr;
+    uint32_t pc;        /* logical address of the instruction */
+    uint32_t mbase;
+    uint32_t index;     /* of the instruction in the block */
+    bool adl, verify, done;
+} jit_asm_t;
+
+static void x_byte(jit_asm_t *a, uint8_t value) {
+    *a->ptr++ = value;
+}
+
+static void x_long(jit_asm_t *a, uint32_t value) {
+    memcpy(a->ptr, &value, sizeof(value));
+    a->ptr += sizeof(value);
+}
+
+static void x_rex(jit_asm_t *a, int reg, int rm) {
+    if (reg >= R8 || rm >= R8) {
+        x_byte(a, 0x40 | (reg >> 3) << 2 | rm >> 3);
+    }
+}
+
+static void x_opcode(jit_asm_t *a, uint32_t op) {
+    if (op > 0xFF) {
+        x_byte(a, op >> 8);
+    }
+    x_byte(a, op);
+}
+
+/* op reg, [rbx + offset] */
+static void x_mem(jit_asm_t *a, uint32_t op, int reg, uint32_t offset) {
+    x_rex(a, reg, RAX);
+    x_opcode(a, op);
+    if (offset < 0x80) {
+        x_byte(a, 0x40 | (reg & 7) << 3 | RBX);
+        x_byte(a, offset);
+    } else {
+        x_byte(a, 0x80 | (reg & 7) << 3 | RBX);
+        x_long(a, offset);
+    }
+}
+
+/* op rm, reg */
+static void x_reg(jit_asm_t *a, uint32_t op, int reg, int rm) {
+    x_rex(a, reg, rm);
+    x_opcode(a, op);
+    x_byte(a, 0xC0 | (reg & 7) << 3 | (rm & 7));
+}
+
+static void x_load(jit_asm_t *a, int reg, uint32_t offset)    { x_mem(a, 0x8B, reg, offset); }
+static void x_load8(jit_asm_t *a, int reg, uint32_t offset)   { x_mem(a, 0x0FB6, reg, offset); }
+static void x_load16(jit_asm_t *a, int reg, uint32_t offset)  { x_mem(a, 0x0FB7, reg, offset); }
+static void x_store(jit_asm_t *a, int reg, uint32_t offset)   { x_mem(a, 0x89, reg, offset); }
+static void x_store8(jit_asm_t *a, int reg, uint32_t offset)  { x_mem(a, 0x88, reg, offset); }
+
+static void x_store16(jit_asm_t *a, int reg, uint32_t offset) {
+    x_byte(a, 0x66);
+    x_mem(a, 0x89, reg, offset);
+}
+
+static void x_mem_imm(jit_asm_t *a, int op, uint32_t offset, uint32_t imm) {
+    x_mem(a, 0x81, op, offset);
+    x_long(a, imm);
+}
+
+static void x_mem_imm8(jit_asm_t *a, int op, uint32_t offset, uint8_t imm) {
+    x_mem(a, 0x80, op, offset);
+    x_byte(a, imm);
+}
+
+static void x_store_imm(jit_asm_t *a, uint32_t offset, uint32_t imm) {
+    x_mem(a, 0xC7, 0, offset);
+    x_long(a, imm);
+}
+
+static void x_store8_imm(jit_asm_t *a, uint32_t offset, uint8_t imm) {
+    x_mem(a, 0xC6, 0, offset);
+    x_byte(a, imm);
+}
+
+static void x_test8_imm(jit_asm_t *a, uint32_t offset, uint8_t imm) {
+    x_mem(a, 0xF6, 0, offset);
+    x_byte(a, imm);
+}
+
+static void x_mov_imm(jit_asm_t *a, int reg, uint32_t imm) {
+    x_rex(a, RAX, reg);
+    x_byte(a, 0xB8 | (reg & 7));
+    x_long(a, imm);
+}
+
+static void x_mov(jit_asm_t *a, int dst, int src) {
+    if (dst != src) {
+        x_reg(a, 0x89, src, dst);
+    }
+}
+
+static void x_alu(jit_asm_t *a, int op, int dst, int src) {
+    x_reg(a, op << 3 | 1, src, dst);
+}
+
+static void x_alu8(jit_asm_t *a, int op, int dst, int src) {
+    x_reg(a, op << 3, src, dst);
+}
+
+static void x_alu_imm(jit_asm_t *a, int op, int reg, uint32_t imm) {
+    x_reg(a, 0x81, op, reg);
+    x_long(a, imm);
+}
+
+static void x_alu8_imm(jit_asm_t *a, int op, int reg, uint8_t imm) {
+    x_reg(a, 0x80, op, reg);
+    x_byte(a, imm);
+}
+
+static void x_shift(jit_asm_t *a, int op, int reg, uint8_t count) {
+    x_reg(a, 0xC1, op, reg);
+    x_byte(a, count);
+}
+
+/* pushfq, pop reg */
+static void x_flags(jit_asm_t *a, int reg) {
+    x_byte(a, 0x9C);
+    x_rex(a, RAX, reg);
+    x_byte(a, 0x58 | (reg & 7));
+}
+
+static void x_call(jit_asm_t *a, uintptr_t function) {
+    x_byte(a, 0x48);
+    x_byte(a, 0xB8);
+    memcpy(a->ptr, &function, sizeof(function));
+    a->ptr += sizeof(function);
+    x_byte(a, 0xFF);
+    x_byte(a, 0xD0);
+}
+
+/* returns the end of the jump, for x_patch */
+static uint8_t *x_jcc(jit_asm_t *a, int cc) {
+    x_byte(a, 0x0F);
+    x_byte(a, 0x80 | cc);
+    x_long(a, 0);
+    return a->ptr;
+}
+
+static uint8_t *x_jmp(jit_asm_t *a) {
+    x_byte(a, 0xE9);
+    x_long(a, 0);
+    return a->ptr;
+}
+
+/* let a jump land here */
+static void x_patch(jit_asm_t *a, uint8_t *jump) {
+    uint32_t offset = (uint32_t)(a->ptr - jump);
+    memcpy(jump - 4, &offset, sizeof(offset));
+}
+
+static void jit_emit_prologue(jit_asm_t *a) {
+    static const uint8_t code[] = {
+        0x53,                   /* push rbx */
+        0x55,                   /* push rbp */
+        0x41, 0x54,             /* push r12 */
+        0x41, 0x55,             /* push r13 */
+        0x56,                   /* push rsi */
+        0x57,                   /* push rdi */
+        0x48, 0x83, 0xEC, 0x28, /* sub rsp, 40 */
+    };
+    memcpy(a->ptr, code, sizeof(code));
+    a->ptr += sizeof(code);
+    x_byte(a, 0x48);            /* mov rbx, arg0 */
+    x_byte(a, 0x89);
+    x_byte(a, 0xC0 | JIT_ARG0 << 3 | RBX);
+    x_byte(a, 0x48);            /* mov rbp, arg1 */
+    x_byte(a, 0x89);
+    x_byte(a, 0xC0 | JIT_ARG1 << 3 | RBP);
+}
+
+static void jit_emit_return(jit_asm_t *a, uint32_t result) {
+    static const uint8_t code[] = {
+        0x48, 0x83, 0xC4, 0x28, /* add rsp, 40 */
+        0x5F,                   /* pop rdi */
+        0x5E,                   /* pop rsi */
+        0x41, 0x5D,             /* pop r13 */
+        0x41, 0x5C,             /* pop r12 */
+        0x5D,                   /* pop rbp */
+        0x5B,                   /* pop rbx */
+        0xC3,                   /* ret */
+    };
+    x_mov_imm(a, RAX, result);
+    memcpy(a->ptr, code, sizeof(code));
+    a->ptr += sizeof(code);
+}
+
+/* leave after a taken jr or jp, so that the caller can look for an idle loop */
+static void jit_emit_taken(jit_asm_t *a, uint32_t end) {
+    x_byte(a, 0xC7);            /* mov dword [rbp + 4], end */
+    x_byte(a, 0x45);
+    x_byte(a, offsetof(jit_state_t, end));
+    x_long(a, end);
+    jit_emit_return(a, (a->index + 1) | JIT_TAKEN);
+}
+
+static void jit_emit_call(jit_asm_t *a, uintptr_t function) {
+    uint8_t *jump;
+    x_call(a, function);
+    if (a->verify) {
+        x_byte(a, 0xF6);        /* test byte [rbp], JIT_EXIT_ABORT */
+        x_byte(a, 0x45);
+        x_byte(a, offsetof(jit_state_t, exit));
+        x_byte(a, JIT_EXIT_ABORT);
+        jump = x_jcc(a, X_E);
+        jit_emit_return(a, a->index | JIT_ABORT);
+        x_patch(a, jump);
+    }
+}
+
+/* checks between instructions, like the condition of the interpreter's loop */
+static void jit_emit_boundary(jit_asm_t *a) {
+    uint8_t *next, *exit[3];
+    x_load(a, RAX, JIT_CPU(cycles));
+    x_mem(a, 0x3B, RAX, JIT_CPU(next));     /* cmp eax, [next] */
+    exit[0] = x_jcc(a, X_AE);
+    x_byte(a, 0x80);                        /* cmp byte [rbp], 0 */
+    x_byte(a, 0x7D);
+    x_byte(a, offsetof(jit_state_t, exit));
+    x_byte(a, 0);
+    exit[1] = x_jcc(a, X_NE);
+    exit[2] = NULL;
+    if (a->verify) {
+        x_byte(a, 0x80);                    /* cmp byte [rbp + 1], index */
+        x_byte(a, 0x7D);
+        x_byte(a, offsetof(jit_state_t, limit));
+        x_byte(a, a->index);
+        exit[2] = x_jcc(a, X_BE);
+    }
+    next = x_jmp(a);
+    x_patch(a, exit[0]);
+    x_patch(a, exit[1]);
+    if (exit[2]) {
+        x_patch(a, exit[2]);
+    }
+    jit_emit_return(a, a->index);
+    x_patch(a, next);
+}
+
+static void jit_emit_fetch(jit_asm_t *a, uint32_t count, uint8_t r) {
+    x_mov_imm(a, JIT_ARG0, count);
+    jit_emit_call(a, (uintptr_t)jit_fetch);
+    if (r) {
+        x_mem_imm8(a, X_ADD, JIT_REG(R), r);
+    }
+}
+
+static void jit_emit_fetch_more(jit_asm_t *a, uint32_t count) {
+    if (count) {
+        x_mov_imm(a, JIT_ARG0, count);
+        jit_emit_call(a, (uintptr_t)jit_fetch_more);
+    }
+}
+
+static void jit_emit_cycle(jit_asm_t *a) {
+    x_mem_imm(a, X_ADD, JIT_CPU(cycles), 1);
+}
+
+static uint32_t jit_mask(jit_asm_t *a) {
+    return a->adl ? 0xFFFFFF : 0xFFFF;
+}
+
+/* cpu_address_mode at translation time, pc and mbase can't change inside a block */
+static uint32_t jit_address(jit_asm_t *a, uint32_t address) {
+    return a->mbase | (address & jit_mask(a));
+}
+
+static uint32_t jit_index(int prefix) {
+    return JIT_REG(index) + prefix * sizeof(long_reg_t);
+}
+
+/* r[i] except (hl), h and l being the index register halves of prefix */
+static uint32_t jit_reg(int i, int prefix) {
+    switch (i) {
+        case 0: return JIT_REG(B);
+        case 1: return JIT_REG(C);
+        case 2: return JIT_REG(D);
+        case 3: return JIT_REG(E);
+        case 4: return jit_index(prefix) + offsetof(long_reg_t, h);
+        case 5: return jit_index(prefix) + offsetof(long_reg_t, l);
+        default: return JIT_REG(A);
+    }
+}
+
+/* rp[p] */
+static uint32_t jit_rp(jit_asm_t *a, int p, int prefix) {
+    switch (p) {
+        case 0: return JIT_REG(BC);
+        case 1: return JIT_REG(DE);
+        case 2: return jit_index(prefix);
+        default: return JIT_REG(stack) + a->adl * sizeof(long_reg_t);
+    }
+}
+
+/* eax = cpu_address_mode(register + offset) */
+static void jit_emit_address(jit_asm_t *a, uint32_t reg, int8_t offset) {
+    x_load(a, RAX, reg);
+    if (offset) {
+        x_alu_imm(a, X_ADD, RAX, (uint32_t)(int32_t)offset);
+    }
+    x_alu_imm(a, X_AND, RAX, jit_mask(a));
+    if (a->mbase) {
+        x_alu_imm(a, X_OR, RAX, a->mbase);
+    }
+}
+
+/* eax = byte at the address in reg */
+static void jit_emit_read(jit_asm_t *a, int reg) {
+    x_mov(a, JIT_ARG0, reg);
+    jit_emit_call(a, (uintptr_t)jit_read);
+}
+
+/* write value to the address in reg, which is rax or r12 */
+static void jit_emit_write(jit_asm_t *a, int reg, int value) {
+    x_mov(a, JIT_ARG1, value);
+    x_mov(a, JIT_ARG0, reg);
+    jit_emit_call(a, (uintptr_t)jit_write);
+}
+
+/* eax = r[i], (hl) being at (index + offset) */
+static void jit_emit_get(jit_asm_t *a, int i, int prefix, int8_t offset) {
+    if (i == 6) {
+        jit_emit_address(a, jit_index(prefix), offset);
+        jit_emit_read(a, RAX);
+    } else {
+        x_load8(a, RAX, jit_reg(i, prefix));
+    }
+}
+
+/* r[i] = value, which is in eax, ecx or edx */
+static void jit_emit_set(jit_asm_t *a, int i, int prefix, int8_t offset, int value) {
+    if (i == 6) {
+        x_mov(a, JIT_ARG1, value);
+        jit_emit_address(a, jit_index(prefix), offset);
+        x_mov(a, JIT_ARG0, RAX);
+        jit_emit_call(a, (uintptr_t)jit_write);
+    } else {
+        x_store8(a, value, jit_reg(i, prefix));
+    }
+}
+
+/* ecx = F | the overflow flag of host flags in edx moved to pv */
+static void jit_emit_overflow(jit_asm_t *a) {
+    x_mov(a, RCX, RDX);
+    x_shift(a, X_SHR, RCX, 9);
+    x_alu_imm(a, X_AND, RCX, FLAG_PV);
+}
+
+/* cpu_execute_alu with the operand in ecx */
+static void jit_emit_alu(jit_asm_t *a, int y) {
+    static const uint8_t ops[8] = { X_ADD, X_ADC, X_SUB, X_SBB, X_AND, X_XOR, X_OR, X_CMP };
+    x_load8(a, RSI, JIT_REG(F));
+    x_load8(a, RAX, JIT_REG(A));
+    if (y == 1 || y == 3) {
+        x_mov(a, RDX, RSI);
+        x_shift(a, X_SHR, RDX, 1);          /* carry flag into the host's */
+    }
+    x_alu8(a, ops[y], RAX, RCX);
+    x_flags(a, RDX);
+    if (y != 7) {
+        x_store8(a, RAX, JIT_REG(A));
+    }
+    if (y < 4 || y == 7) {
+        jit_emit_overflow(a);
+        x_alu_imm(a, X_AND, RDX, FLAG_S | FLAG_Z | FLAG_H | FLAG_C);
+        x_alu(a, X_OR, RDX, RCX);
+        if (y >= 2) {
+            x_alu_imm(a, X_OR, RDX, FLAG_N);
+        }
+    } else {
+        x_alu_imm(a, X_AND, RDX, FLAG_S | FLAG_Z | FLAG_PV);
+        if (y == 4) {
+            x_alu_imm(a, X_OR, RDX, FLAG_H);
+        }
+    }
+    x_alu_imm(a, X_AND, RSI, FLAG_3 | FLAG_5);
+    x_alu(a, X_OR, RDX, RSI);
+    x_store8(a, RDX, JIT_REG(F));
+}
+
+/* inc or dec of al, with flags */
+static void jit_emit_inc(jit_asm_t *a, bool dec) {
+    x_load8(a, RSI, JIT_REG(F));
+    x_reg(a, 0xFE, dec, RAX);
+    x_flags(a, RDX);
+    jit_emit_overflow(a);
+    x_alu_imm(a, X_AND, RDX, FLAG_S | FLAG_Z | FLAG_H);
+    x_alu(a, X_OR, RDX, RCX);
+    x_alu_imm(a, X_AND, RSI, FLAG_3 | FLAG_5 | FLAG_C);
+    x_alu(a, X_OR, RDX, RSI);
+    if (dec) {
+        x_alu_imm(a, X_OR, RDX, FLAG_N);
+    }
+    x_store8(a, RDX, JIT_REG(F));
+}
+
+/* jumps if cc[i] is false */
+static uint8_t *jit_emit_cc(jit_asm_t *a, int i) {
+    static const uint8_t flags[4] = { FLAG_Z, FLAG_C, FLAG_PV, FLAG_S };
+    x_test8_imm(a, JIT_REG(F), flags[i >> 1]);
+    return x_jcc(a, i & 1 ? X_E : X_NE);
+}
+
+/* the target of jp, call or the like is taken while the last byte of its operand is still
+ * only prefetched, see cpu_fetch_word_no_prefetch */
+static void jit_emit_no_prefetch(jit_asm_t *a, uint32_t word) {
+    jit_emit_fetch_more(a, word - 1);
+    x_mem_imm(a, X_ADD, JIT_REG(PC), 1);
+}
+
+static uint32_t jit_word(jit_asm_t *a, const uint8_t *bytes) {
+    return bytes[0] | bytes[1] << 8 | (a->adl ? (uint32_t)bytes[2] << 16 : 0);
+}
+
+static uint32_t jit_translate_cb(jit_asm_t *a, const uint8_t *code, uint32_t avail, int prefix) {
+    uint32_t length = prefix ? 4 : 2;
+    int8_t offset;
+    uint8_t op;
+    int x, y, z;
+    if (length > avail) {
+        return 0;
+    }
+    offset = prefix ? (int8_t)code[2] : 0;
+    op = code[length - 1];
+    x = op >> 6;
+    y = op >> 3 & 7;
+    z = op & 7;
+    if ((prefix && z != 6) || (x == 0 && y == 6)) {
+        return 0;
+    }
+    jit_emit_fetch(a, length, 4);
+    if (z == 6) {
+        jit_emit_address(a, jit_index(prefix), offset);
+        x_mov(a, R12, RAX);
+        jit_emit_read(a, R12);
+    } else {
+        x_load8(a, RAX, jit_reg(z, 0));
+    }
+    switch (x) {
+        case 0: /* rot[y] r[z] */
+            if (z == 6) {
+                jit_emit_cycle(a);
+            }
+            x_mov(a, JIT_ARG1, RAX);
+            x_mov_imm(a, JIT_ARG0, y);
+            x_call(a, (uintptr_t)cpu_rot);
+            break;
+        case 1: /* BIT y, r[z] */
+            x_load8(a, RSI, JIT_REG(F));
+            x_alu8_imm(a, X_AND, RAX, 1 << y);
+            x_flags(a, RDX);
+            x_alu_imm(a, X_AND, RDX, FLAG_S | FLAG_Z | FLAG_PV);
+            x_alu_imm(a, X_AND, RSI, FLAG_3 | FLAG_5 | FLAG_C);
+            x_alu(a, X_OR, RDX, RSI);
+            x_alu_imm(a, X_OR, RDX, FLAG_H);
+            x_store8(a, RDX, JIT_REG(F));
+            return length;
+        case 2: /* RES y, r[z] */
+            if (z == 6) {
+                jit_emit_cycle(a);
+            }
+            x_alu8_imm(a, X_AND, RAX, ~(1 << y));
+            break;
+        case 3: /* SET y, r[z] */
+            if (z == 6) {
+                jit_emit_cycle(a);
+            }
+            x_alu8_imm(a, X_OR, RAX, 1 << y);
+            break;
+    }
+    if (z == 6) {
+        jit_emit_write(a, R12, RAX);
+    } else {
+        x_store8(a, RAX, jit_reg(z, 0));
+    }
+    return length;
+}
+
+/* emits one instruction, returns its length or 0 if it has to be left to the interpreter */
+static uint32_t jit_translate(jit_asm_t *a, const uint8_t *code, uint32_t avail) {
+    uint32_t word = a->adl ? 3 : 2, mask = jit_mask(a), length, address, end, i;
+    int prefix = 0, n = 0, x, y, z, p, q;
+    int8_t offset = 0;
+    const uint8_t *operand;
+    uint8_t *jump;
+    uint8_t op, r;
+
+    op = code[0];
+    if (op == 0xDD || op == 0xFD) {
+        if (avail < 2) {
+            return 0;
+        }
+        prefix = op == 0xDD ? 2 : 3;
+        op = code[n = 1];
+    }
+    operand = code + n + 1;
+    r = prefix ? 4 : 2;
+    x = op >> 6;
+    y = op >> 3 & 7;
+    z = op & 7;
+    p = y >> 1;
+    q = y & 1;
+
+/* the instruction has count bytes after the opcode */
+#define JIT_OPERANDS(count) do { length = n + 1 + (count); if (length > avail) return 0; } while (0)
+
+    switch (x) {
+        case 0:
+            switch (z) {
+                case 0:
+                    if (prefix) {
+                        return 0;
+                    }
+                    switch (y) {
+                        case 0: /* NOP */
+                            JIT_OPERANDS(0);
+                            jit_emit_fetch(a, length, r);
+                            return length;
+                        case 1: /* EX af,af' */
+                            JIT_OPERANDS(0);
+                            jit_emit_fetch(a, length, r);
+                            x_load16(a, RAX, JIT_REG(AF));
+                            x_load16(a, RCX, JIT_REG(_AF));
+                            x_store16(a, RCX, JIT_REG(AF));
+                            x_store16(a, RAX, JIT_REG(_AF));
+                            return length;
+                        case 2: /* DJNZ d */
+                            JIT_OPERANDS(1);
+                            address = (jit_address(a, a->pc + length) + (int8_t)operand[0]) & mask;
+                            jit_emit_fetch(a, length, r);
+                            x_mem_imm8(a, X_SUB, JIT_REG(B), 1);
+                            jump = x_jcc(a, X_E);
+                            jit_emit_cycle(a);
+                            x_mov_imm(a, JIT_ARG0, address);
+                            jit_emit_call(a, (uintptr_t)jit_branch);
+                            jit_emit_return(a, a->index + 1);
+                            x_patch(a, jump);
+                            return length;
+                        case 3: /* JR d */
+                            JIT_OPERANDS(1);
+                            end = jit_address(a, a->pc + length);
+                            jit_emit_fetch(a, length, r);
+                            x_mov_imm(a, JIT_ARG0, (end + (int8_t)operand[0]) & mask);
+                            jit_emit_call(a, (uintptr_t)jit_branch);
+                            jit_emit_taken(a, end);
+                            a->done = true;
+                            return length;
+                        default: /* JR cc[y-4], d */
+                            JIT_OPERANDS(1);
+                            end = jit_address(a, a->pc + length);
+                            jit_emit_fetch(a, length, r);
+                            jump = jit_emit_cc(a, y - 4);
+                            jit_emit_cycle(a);
+                            x_mov_imm(a, JIT_ARG0, (end + (int8_t)operand[0]) & mask);
+                            jit_emit_call(a, (uintptr_t)jit_branch);
+                            jit_emit_taken(a, end);
+                            x_patch(a, jump);
+                            return length;
+                    }
+                case 1:
+                    if (!q) { /* LD rr, Mmn */
+                        if (prefix && p != 2) {
+                            return 0;
+                        }
+                        JIT_OPERANDS(word);
+                        jit_emit_fetch(a, length, r);
+                        x_store_imm(a, jit_rp(a, p, prefix), jit_word(a, operand));
+                        return length;
+                    }
+                    /* ADD HL,rr */
+                    JIT_OPERANDS(0);
+                    jit_emit_fetch(a, length, r);
+                    x_load(a, RAX, jit_index(prefix));
+                    x_alu_imm(a, X_AND, RAX, mask);
+                    x_load(a, RCX, jit_rp(a, p, prefix));
+                    x_alu_imm(a, X_AND, RCX, mask);
+                    x_mov(a, RDX, RAX);
+                    x_alu_imm(a, X_AND, RDX, 0xFFF);
+                    x_mov(a, RSI, RCX);
+                    x_alu_imm(a, X_AND, RSI, 0xFFF);
+                    x_alu(a, X_ADD, RDX, RSI);
+                    x_shift(a, X_SHR, RDX, 8);
+                    x_alu_imm(a, X_AND, RDX, FLAG_H);
+                    x_alu(a, X_ADD, RAX, RCX);
+                    x_mov(a, RSI, RAX);
+                    x_shift(a, X_SHR, RSI, a->adl ? 24 : 16);
+                    x_alu_imm(a, X_AND, RSI, FLAG_C);
+                    x_alu(a, X_OR, RDX, RSI);
+                    x_alu_imm(a, X_AND, RAX, mask);
+                    x_store(a, RAX, jit_index(prefix));
+                    x_load8(a, RCX, JIT_REG(F));
+                    x_alu_imm(a, X_AND, RCX, FLAG_S | FLAG_Z | FLAG_5 | FLAG_3 | FLAG_PV);
+                    x_alu(a, X_OR, RCX, RDX);
+                    x_store8(a, RCX, JIT_REG(F));
+                    return length;
+                case 2:
+                    if (prefix && p != 2) {
+                        return 0;
+                    }
+                    JIT_OPERANDS(p < 2 ? 0 : word);
+                    jit_emit_fetch(a, length, r);
+                    address = p < 2 ? 0 : jit_word(a, operand);
+                    switch (p) {
+                        case 0: /* LD (BC), A and LD A, (BC) */
+                        case 1: /* LD (DE), A and LD A, (DE) */
+                            jit_emit_address(a, p ? JIT_REG(DE) : JIT_REG(BC), 0);
+                            if (q) {
+                                jit_emit_read(a, RAX);
+                                x_store8(a, RAX, JIT_REG(A));
+                            } else {
+                                x_load8(a, RCX, JIT_REG(A));
+                                jit_emit_write(a, RAX, RCX);
+                            }
+                            return length;
+                        case 2:
+                            for (i = 0; i < word; i++) {
+                                x_mov_imm(a, RAX, jit_address(a, address + i));
+                                if (q) { /* LD HL, (Mmn) */
+                                    jit_emit_read(a, RAX);
+                                    if (i) {
+                                        x_shift(a, X_SHL, RAX, i << 3);
+                                        x_alu(a, X_OR, R13, RAX);
+                                    } else {
+                                        x_mov(a, R13, RAX);
+                                    }
+                                } else { /* LD (Mmn), HL */
+                                    x_load8(a, RCX, jit_index(prefix) + i);
+                                    jit_emit_write(a, RAX, RCX);
+                                }
+                            }
+                            if (q) {
+                                x_store(a, R13, jit_index(prefix));
+                            }
+                            return length;
+                        default:
+                            x_mov_imm(a, RAX, jit_address(a, address));
+                            if (q) { /* LD A, (Mmn) */
+                                jit_emit_read(a, RAX);
+                                x_store8(a, RAX, JIT_REG(A));
+                            } else { /* LD (Mmn), A */
+                                x_load8(a, RCX, JIT_REG(A));
+                                jit_emit_write(a, RAX, RCX);
+                            }
+                            return length;
+                    }
+                case 3: /* INC rp[p] and DEC rp[p] */
+                    if (prefix && p != 2) {
+                        return 0;
+                    }
+                    JIT_OPERANDS(0);
+                    jit_emit_fetch(a, length, r);
+                    x_load(a, RAX, jit_rp(a, p, prefix));
+                    x_alu_imm(a, X_AND, RAX, mask);
+                    x_alu_imm(a, q ? X_SUB : X_ADD, RAX, 1);
+                    x_alu_imm(a, X_AND, RAX, mask);
+                    x_store(a, RAX, jit_rp(a, p, prefix));
+                    return length;
+                case 4: /* INC r[y] */
+                case 5: /* DEC r[y] */
+                    if (prefix && (y < 4 || y == 7)) {
+                        return 0;
+                    }
+                    JIT_OPERANDS(prefix && y == 6);
+                    offset = prefix && y == 6 ? (int8_t)operand[0] : 0;
+                    jit_emit_fetch(a, length, r);
+                    if (y == 6) {
+                        jit_emit_address(a, jit_index(prefix), offset);
+                        x_mov(a, R12, RAX);
+                        jit_emit_read(a, R12);
+                        jit_emit_cycle(a);
+                        jit_emit_inc(a, z == 5);
+                        jit_emit_write(a, R12, RAX);
+                    } else {
+                        x_load8(a, RAX, jit_reg(y, prefix));
+                        jit_emit_inc(a, z == 5);
+                        x_store8(a, RAX, jit_reg(y, prefix));
+                    }
+                    return length;
+                case 6: /* LD r[y], n */
+                    if (prefix && (y < 4 || y == 7)) {
+                        return 0;
+                    }
+                    JIT_OPERANDS(1 + (prefix && y == 6));
+                    jit_emit_fetch(a, length, r);
+                    if (y == 6) {
+                        offset = prefix ? (int8_t)operand[0] : 0;
+                        x_mov_imm(a, RCX, code[length - 1]);
+                        jit_emit_set(a, 6, prefix, offset, RCX);
+                    } else {
+                        x_store8_imm(a, jit_reg(y, prefix), code[length - 1]);
+                    }
+                    return length;
+                default: /* RLCA, RRCA, RLA, RRA, DAA, CPL, SCF, CCF */
+                    if (prefix) {
+                        return 0;
+                    }
+                    JIT_OPERANDS(0);
+                    jit_emit_fetch(a, length, r);
+                    x_mov_imm(a, JIT_ARG0, y);
+                    x_call(a, (uintptr_t)cpu_execute_rot_acc);
+                    return length;
+            }
+        case 1:
+            if (z == y) { /* LD r, r */
+                if (z < 4 || z == 6 || (prefix && z == 7)) {
+                    return 0;
+                }
+                JIT_OPERANDS(0);
+                jit_emit_fetch(a, length, r);
+                return length;
+            }
+            if (prefix && (z < 4 || z == 7) && (y < 4 || y == 7)) {
+                return 0;
+            }
+            JIT_OPERANDS(prefix && (z == 6 || y == 6));
+            offset = prefix && (z == 6 || y == 6) ? (int8_t)operand[0] : 0;
+            jit_emit_fetch(a, length, r);
+            jit_emit_get(a, z, y != 6 ? prefix : 0, offset);
+            jit_emit_set(a, y, z != 6 ? prefix : 0, offset, RAX);
+            return length;
+        case 2: /* ALU[y] r[z] */
+            if (prefix && (z < 4 || z == 7)) {
+                return 0;
+            }
+            JIT_OPERANDS(prefix && z == 6);
+            offset = prefix && z == 6 ? (int8_t)operand[0] : 0;
+            jit_emit_fetch(a, length, r);
+            jit_emit_get(a, z, prefix, offset);
+            x_mov(a, RCX, RAX);
+            jit_emit_alu(a, y);
+            return length;
+        default:
+            if (prefix && !(z & 1)) {
+                return 0;
+            }
+            switch (z) {
+                case 0: /* RET cc[y] */
+                    JIT_OPERANDS(0);
+                    jit_emit_fetch(a, length, r);
+                    jit_emit_cycle(a);
+                    jump = jit_emit_cc(a, y);
+                    x_mem_imm8(a, X_ADD, JIT_REG(R), 2);
+                    jit_emit_call(a, (uintptr_t)jit_ret);
+                    jit_emit_return(a, a->index + 1);
+                    x_patch(a, jump);
+                    return length;
+                case 1:
+                    if (!q) { /* POP rp2[p] */
+                        if (prefix && p != 2) {
+                            return 0;
+                        }
+                        JIT_OPERANDS(0);
+                        jit_emit_fetch(a, length, r);
+                        jit_emit_call(a, (uintptr_t)jit_pop);
+                        if (p == 3) {
+                            x_store16(a, RAX, JIT_REG(AF));
+                        } else {
+                            x_alu_imm(a, X_AND, RAX, mask);
+                            x_store(a, RAX, jit_rp(a, p, prefix));
+                        }
+                        return length;
+                    }
+                    if (prefix && p < 2) {
+                        return 0;
+                    }
+                    JIT_OPERANDS(0);
+                    jit_emit_fetch(a, length, r);
+                    switch (p) {
+                        case 0: /* RET */
+                            jit_emit_call(a, (uintptr_t)jit_ret);
+                            jit_emit_return(a, a->index + 1);
+                            a->done = true;
+                            return length;
+                        case 1: /* EXX */
+                            for (i = 0; i < 3; i++) {
+                                static const uint32_t regs[3][2] = {
+                                    { JIT_REG(BC), JIT_REG(_BC) },
+                                    { JIT_REG(DE), JIT_REG(_DE) },
+                                    { JIT_REG(HL), JIT_REG(_HL) },
+                                };
+                                x_load(a, RAX, regs[i][0]);
+                                x_load(a, RCX, regs[i][1]);
+                                x_store(a, RCX, regs[i][0]);
+                                x_store(a, RAX, regs[i][1]);
+                            }
+                            return length;
+                        case 2: /* JP (rr) */
+                            x_load(a, JIT_ARG0, jit_index(prefix));
+                            jit_emit_call(a, (uintptr_t)jit_jump_index);
+                            jit_emit_return(a, a->index + 1);
+                            a->done = true;
+                            return length;
+                        default: /* LD SP, HL */
+                            x_load(a, RAX, jit_index(prefix));
+                            x_store(a, RAX, jit_rp(a, 3, prefix));
+                            return length;
+                    }
+                case 2: /* JP cc[y], nn */
+                    JIT_OPERANDS(word);
+                    address = jit_word(a, operand);
+                    end = jit_address(a, a->pc + length - 1) + 1;
+                    jit_emit_fetch(a, 1, r);
+                    jump = jit_emit_cc(a, y);
+                    jit_emit_cycle(a);
+                    jit_emit_no_prefetch(a, word);
+                    x_mov_imm(a, JIT_ARG0, address);
+                    jit_emit_call(a, (uintptr_t)jit_jump);
+                    jit_emit_taken(a, end);
+                    x_patch(a, jump);
+                    jit_emit_fetch_more(a, word);
+                    return length;
+                case 3:
+                    if (y == 1) {
+                        return jit_translate_cb(a, code, avail, prefix);
+                    }
+                    if (prefix) {
+                        return 0;
+                    }
+                    if (y == 0) { /* JP nn */
+                        JIT_OPERANDS(word);
+                        end = jit_address(a, a->pc + length - 1) + 1;
+                        jit_emit_fetch(a, 1, r);
+                        jit_emit_cycle(a);
+                        jit_emit_no_prefetch(a, word);
+                        x_mov_imm(a, JIT_ARG0, jit_word(a, operand));
+                        jit_emit_call(a, (uintptr_t)jit_jump);
+                        jit_emit_taken(a, end);
+                        a->done = true;
+                        return length;
+                    }
+                    if (y == 5) { /* EX DE, HL */
+                        JIT_OPERANDS(0);
+                        jit_emit_fetch(a, length, r);
+                        x_load(a, RAX, JIT_REG(DE));
+                        x_alu_imm(a, X_AND, RAX, mask);
+                        x_load(a, RCX, JIT_REG(HL));
+                        x_alu_imm(a, X_AND, RCX, mask);
+                        x_store(a, RCX, JIT_REG(DE));
+                        x_store(a, RAX, JIT_REG(HL));
+                        return length;
+                    }
+                    return 0;
+                case 4: /* CALL cc[y], nn */
+                    JIT_OPERANDS(word);
+                    jit_emit_fetch(a, 1, r);
+                    jump = jit_emit_cc(a, y);
+                    jit_emit_no_prefetch(a, word);
+                    if (!a->adl) {
+                        jit_emit_cycle(a);
+                    }
+                    x_mov_imm(a, JIT_ARG0, jit_word(a, operand));
+                    jit_emit_call(a, (uintptr_t)jit_call);
+                    jit_emit_return(a, a->index + 1);
+                    x_patch(a, jump);
+                    jit_emit_fetch_more(a, word);
+                    return length;
+                case 5:
+                    if (prefix && y != 4) {
+                        return 0;
+                    }
+                    if (!q) { /* PUSH rp2[p] */
+                        JIT_OPERANDS(0);
+                        jit_emit_fetch(a, length, r + (!prefix && a->adl ? 2 : 0));
+                        if (p == 3) {
+                            x_load16(a, JIT_ARG0, JIT_REG(AF));
+                        } else {
+                            x_load(a, JIT_ARG0, jit_rp(a, p, prefix));
+                            x_alu_imm(a, X_AND, JIT_ARG0, mask);
+                        }
+                        jit_emit_call(a, (uintptr_t)jit_push);
+                        return length;
+                    }
+                    if (p == 0) { /* CALL nn */
+                        JIT_OPERANDS(word);
+                        jit_emit_fetch(a, 1, r);
+                        jit_emit_no_prefetch(a, word);
+                        x_mov_imm(a, JIT_ARG0, jit_word(a, operand));
+                        jit_emit_call(a, (uintptr_t)jit_call);
+                        jit_emit_return(a, a->index + 1);
+                        a->done = true;
+                        return length;
+                    }
+                    return 0;
+                case 6: /* alu[y] n */
+                    JIT_OPERANDS(1);
+                    jit_emit_fetch(a, length, r);
+                    x_mov_imm(a, RCX, operand[0]);
+                    jit_emit_alu(a, y);
+                    return length;
+                default:
+                    return 0;
+            }
+    }
+
+#undef JIT_OPERANDS
+}
+
+static bool jit_translate_block(jit_block_t *block, uint32_t pc) {
+    const uint8_t *code = mem_page_ptr(pc, false);
+    uint32_t avail = 0x100 - (pc & 0xFF), offset = 0, length, index;
+    uint8_t *start, *inst;
+    jit_asm_t a;
+
+    if (!code || jit_mark_index(pc) == JIT_INVALID) {
+        return false;
+    }
+    if (JIT_CODE_SIZE - jit->used < JIT_CODE_LIMIT) {
+        jit_flush();
+        jit_block_reset(block, block->key);
+    }
+    a.ptr = start = jit->code + jit->used;
+    a.adl = cpu.ADL;
+    a.mbase = a.adl ? 0 : (uint32_t)cpu.registers.MBASE << 16;
+    a.pc = pc & jit_mask(&a);
+    a.verify = jit->verify;
+    a.done = false;
+    jit_emit_prologue(&a);
+    for (a.index = 0; a.index < JIT_BLOCK_SIZE && !a.done && offset < avail; a.index++) {
+        inst = a.ptr;
+        if (a.index) {
+            jit_emit_boundary(&a);
+        }
+        if (!(length = jit_translate(&a, code + offset, avail - offset))) {
+            a.ptr = inst;
+            break;
+        }
+        offset += length;
+        a.pc += length;
+    }
+    if (!a.index) {
+        return false;
+    }
+    if (!a.done) {
+        jit_emit_return(&a, a.index);
+    }
+    block->code = (jit_code_t)(uintptr_t)start;
+    block->opcode = code[0];
+    jit->used = (uint32_t)(a.ptr - jit->code + 15) & ~15u;
+    for (index = jit_mark_index(pc); offset; offset--, index++) {
+        jit->marks[index >> 3] |= 1 << (index & 7);
+    }
+    return true;
+}
+
+uint32_t jit_run(uint32_t limit, uint32_t *end) {
+    uint32_t pc = cpu.registers.PC, key = pc | (uint32_t)cpu.ADL << 24;
+    jit_block_t *block;
+    uint32_t result;
+
+    if (!jit && !jit_alloc()) {
+        return 0;
+    }
+    block = jit_block(key);
+    if (block->key != key || block->gen != jit->gen[pc >> 8 & 0xFFFF]) {
+        jit_block_reset(block, key);
+    }
+    if (!block->code) {
+        if (block->failed || ++block->hits < JIT_HOT << jit->rewrites[pc >> 8 & 0xFFFF]) {
+            return 0;
+        }
+        if (!jit_translate_block(block, pc)) {
+            block->failed = true;
+            return 0;
+        }
+    }
+    /* the opcode was prefetched before the block could be invalidated, and the operands of the
+     * first instruction are fetched with the current mbase */
+    if (cpu.prefetch != block->opcode || cpu.L != cpu.ADL || cpu.IL != cpu.ADL ||
+        (!cpu.ADL && pc >> 16 != cpu.registers.MBASE) || !mem_page_ptr(pc, false)) {
+        return 0;
+    }
+    jit->exit = 0;
+    jit->limit = limit;
+    result = block->code(&cpu, jit);
+    *end = jit->end;
+    return result;
+}
+
+#else
+
+bool jit_supported(void) {
+    return false;
+}
+
+void jit_free(void) {
+}
+
+void jit_flush(void) {
+}
+
+void jit_invalidate(uint32_t address, uint32_t size) {
+    (void)address;
+    (void)size;
+}
+
+void jit_set_verify(bool verify) {
+    (void)verify;
+}
+
+uint32_t jit_run(uint32_t limit, uint32_t *end) {
+    (void)limit;
+    (void)end;
+    return 0;
+}
+
+void jit_discard(uint32_t address, bool adl) {
+    (void)address;
+    (void)adl;
+}
+
+void jit_log_start(void) {
+}
+
+void jit_log_undo(void) {
+}
+
+bool jit_log_check(void) {
+    return true;
+}
+
+void jit_log_stop(void) {
+}
+
+#endif
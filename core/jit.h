@@ -0,0 +1,41 @@
+#ifndef JIT_H
+#define JIT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Dynamic recompiler: hot basic blocks are translated to x86-64 code that keeps the interpreter's
+ * order of fetches, memory accesses and cycle updates, so both paths can be mixed freely.
+ * Only used through cpu_set_jit_mode, the interpreter stays the reference. */
+
+#define JIT_COUNT 0xFF    /* instructions a block ran */
+#define JIT_TAKEN 0x100   /* the block ended with a taken jr or jp, see cpu_idle_loop */
+#define JIT_ABORT 0x200   /* verifying: stopped in the middle of an instruction before a side effect */
+
+bool jit_supported(void);
+void jit_free(void);
+void jit_flush(void);
+void jit_invalidate(uint32_t address, uint32_t size);   /* call when code in flash or ram may have changed */
+void jit_set_verify(bool verify);   /* translate blocks that stop before any access which can't be undone */
+uint32_t jit_run(uint32_t limit, uint32_t *end);   /* run the block at pc for at most limit instructions */
+void jit_discard(uint32_t address, bool adl);   /* never translate the block at address again */
+
+/* memory writes of the verifying mode, first of the translated code, then of the interpreter */
+void jit_log_start(void);
+void jit_log_undo(void);   /* takes back the writes of the translated code */
+bool jit_log_check(void);   /* true if the interpreter wrote the same values to the same addresses */
+void jit_log_stop(void);
+
+/* interpreter operations the translated code calls, in cpu.c */
+void cpu_execute_rot_acc(int y);
+uint8_t cpu_rot(int y, uint8_t value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -11,7 +11,7 @@
 #include <stdio.h>
 
 /* Global KEYPAD state */
-keypad_state_t keypad;
+EMU_LOCAL keypad_state_t keypad;
 
 void keypad_intrpt_check() {
     intrpt_set(INT_KEYPAD, (keypad.status & keypad.enable) | (keypad.gpioStatus & keypad.gpioEnable));
@@ -196,10 +196,10 @@ eZ80portrange_t init_keypad(void) {
     return device;
 }
 
-bool keypad_save(FILE *image) {
-    return fwrite(&keypad, sizeof(keypad), 1, image) == 1;
+bool keypad_save(image_t *image) {
+    return image_write(image, &keypad, sizeof(keypad));
 }
 
-bool keypad_restore(FILE *image) {
-    return fread(&keypad, sizeof(keypad), 1, image) == 1;
+bool keypad_restore(image_t *image) {
+    return image_read(image, &keypad, sizeof(keypad));
 }
@@ -1,6 +1,7 @@
 #ifndef KEYPAD_H
 #define KEYPAD_H
 
+#include "image.h"
 #include "defines.h"
 
 #ifdef __cplusplus
@@ -35,13 +36,13 @@ typedef struct keypad_state {
     uint32_t gpioEnable;
 } keypad_state_t;
 
-extern keypad_state_t keypad;
+extern EMU_LOCAL keypad_state_t keypad;
 
 eZ80portrange_t init_keypad(void);
 void keypad_intrpt_check(void);
 void keypad_reset(void);
-bool keypad_restore(FILE *image);
-bool keypad_save(FILE *image);
+bool keypad_restore(image_t *image);
+bool keypad_save(image_t *image);
 
 /* api functions */
 void emu_keypad_event(unsigned int row, unsigned int col, bool press);
@@ -13,10 +13,53 @@
 #include <stdlib.h>
 #include <string.h>
 
-/* Global LCD state */
-lcd_state_t lcd;
+/* Four 32-bit lanes are enough for every pixel conversion below */
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LCD_VEC
+typedef __m128i lcd_vec_t;
+#define lcd_vload(p)      _mm_loadu_si128((const __m128i *)(p))
+#define lcd_vstore(p, v)  _mm_storeu_si128((__m128i *)(p), (v))
+#define lcd_vdup(x)       _mm_set1_epi32((int)(x))
+#define lcd_vand(a, b)    _mm_and_si128((a), (b))
+#define lcd_vor(a, b)     _mm_or_si128((a), (b))
+#define lcd_vadd(a, b)    _mm_add_epi32((a), (b))
+#define lcd_vshr(a, n)    _mm_srli_epi32((a), (n))
+#define lcd_vshl(a, n)    _mm_slli_epi32((a), (n))
+#define lcd_vziplo(a, b)  _mm_unpacklo_epi32((a), (b))
+#define lcd_vziphi(a, b)  _mm_unpackhi_epi32((a), (b))
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define LCD_VEC
+typedef uint32x4_t lcd_vec_t;
+#define lcd_vload(p)      vld1q_u32((const uint32_t *)(p))
+#define lcd_vstore(p, v)  vst1q_u32((uint32_t *)(p), (v))
+#define lcd_vdup(x)       vdupq_n_u32((uint32_t)(x))
+#define lcd_vand(a, b)    vandq_u32((a), (b))
+#define lcd_vor(a, b)     vorrq_u32((a), (b))
+#define lcd_vadd(a, b)    vaddq_u32((a), (b))
+#define lcd_vshr(a, n)    vshrq_n_u32((a), (n))
+#define lcd_vshl(a, n)    vshlq_n_u32((a), (n))
+#define lcd_vziplo(a, b)  (vzipq_u32((a), (b)).val[0])
+#define lcd_vziphi(a, b)  (vzipq_u32((a), (b)).val[1])
+#endif
 
-static bool _rgb;
+/* Global LCD state */
+EMU_LOCAL lcd_state_t lcd;
+
+/* Pixels fetched by the dma that have not reached the panel yet. Nothing the cpu can see
+ * depends on the panel, so it only catches up, a line at a time, before it is read or changed. */
+#define LCD_DMA_PIXELS (16 * 32)
+#define LCD_PANEL_SIZE LCD_SIZE
+static EMU_LOCAL struct {
+    uint32_t *colors;   /* red | green << 8 | blue << 16 */
+    uint32_t count;
+    uint32_t row, col;  /* scan position of the first pending pixel */
+    bool lookupValid;   /* cleared by anything that changes how pixels convert */
+    uint32_t lookup[3][0x100]; /* colors or'd together from each byte of a pixel, or of each palette index */
+} panel;
+
+static EMU_LOCAL bool _rgb;
 
 #define c1555(w) ((w) + ((w) & 0xFFE0) + ((w) >> 10 & 0x20))
 #define c565(w)  (((w) >> 8 & 0xF800) | ((w) >> 5 & 0x7E0) | ((w) >> 3 & 0x1F))
@@ -44,13 +87,102 @@ static uint32_t lcd_bgr16out(uint32_t bgr16) {
     }
 }
 
+/* RGBA8888 copy of the first entries of lcd.palette, into a buffer owned by the draw call since the gui thread draws too */
+static void lcd_palette_out(uint32_t *out, unsigned int entries) {
+    unsigned int i;
+
+    for (i = 0; i < entries; i++) {
+        out[i] = lcd_bgr16out(c1555(lcd.palette[i]));
+    }
+}
+
+#ifdef LCD_VEC
+/* same as lcd_bgr16out, for four pixels */
+static inline lcd_vec_t lcd_bgr16out_vec(lcd_vec_t bgr16, bool rgb) {
+    lcd_vec_t r, g, b;
+
+    r = lcd_vand(lcd_vshr(bgr16, 10), lcd_vdup(0x3E));
+    g = lcd_vand(lcd_vshr(bgr16, 5), lcd_vdup(0x3F));
+    b = lcd_vand(lcd_vshl(bgr16, 1), lcd_vdup(0x3E));
+
+    r = lcd_vor(r, lcd_vshr(r, 5));
+    r = lcd_vor(lcd_vshl(r, 2), lcd_vshr(r, 4));
+
+    g = lcd_vor(lcd_vshl(g, 2), lcd_vshr(g, 4));
+
+    b = lcd_vor(b, lcd_vshr(b, 5));
+    b = lcd_vor(lcd_vshl(b, 2), lcd_vshr(b, 4));
+
+    if (rgb) {
+        return lcd_vor(lcd_vor(r, lcd_vshl(g, 8)), lcd_vor(lcd_vshl(b, 16), lcd_vdup(0xFF000000)));
+    } else {
+        return lcd_vor(lcd_vor(b, lcd_vshl(g, 8)), lcd_vor(lcd_vshl(r, 16), lcd_vdup(0xFF000000)));
+    }
+}
+
+/* same as c1555, c565 and c12, for four pixels */
+static inline lcd_vec_t lcd_c1555_vec(lcd_vec_t w) {
+    return lcd_vadd(lcd_vadd(w, lcd_vand(w, lcd_vdup(0xFFE0))), lcd_vand(lcd_vshr(w, 10), lcd_vdup(0x20)));
+}
+
+static inline lcd_vec_t lcd_c565_vec(lcd_vec_t w) {
+    return lcd_vor(lcd_vor(lcd_vand(lcd_vshr(w, 8), lcd_vdup(0xF800)), lcd_vand(lcd_vshr(w, 5), lcd_vdup(0x7E0))), lcd_vand(lcd_vshr(w, 3), lcd_vdup(0x1F)));
+}
+
+static inline lcd_vec_t lcd_c12_vec(lcd_vec_t w) {
+    return lcd_vor(lcd_vor(lcd_vand(lcd_vshl(w, 4), lcd_vdup(0xF000)), lcd_vand(lcd_vshl(w, 3), lcd_vdup(0x780))), lcd_vand(lcd_vshl(w, 1), lcd_vdup(0x1E)));
+}
+
+/* Converts the direct color modes four words at a time, returns how many words were done */
+static inline size_t lcd_drawmem_vec(uint32_t *out, const uint32_t *dat, size_t words, uint_fast8_t mode, bool bebo, bool rgb) {
+    lcd_vec_t word, lo, hi;
+    size_t i;
+
+    for (i = 0; i + 4 <= words; i += 4) {
+        word = lcd_vload(dat + i);
+        if (mode == 5) {
+            lcd_vstore(out, lcd_bgr16out_vec(lcd_c565_vec(word), rgb));
+            out += 4;
+            continue;
+        }
+        if (bebo) { word = lcd_vor(lcd_vshl(word, 16), lcd_vshr(word, 16)); }
+        lo = lcd_vand(word, lcd_vdup(0xFFFF));
+        hi = lcd_vshr(word, 16);
+        if (mode == 4) {
+            lo = lcd_c1555_vec(lo);
+            hi = lcd_c1555_vec(hi);
+        } else if (mode == 7) {
+            lo = lcd_c12_vec(lo);
+            hi = lcd_c12_vec(hi);
+        }
+        lo = lcd_bgr16out_vec(lo, rgb);
+        hi = lcd_bgr16out_vec(hi, rgb);
+        lcd_vstore(out, lcd_vziplo(lo, hi));
+        lcd_vstore(out + 4, lcd_vziphi(lo, hi));
+        out += 8;
+    }
+    return i;
+}
+#endif
+
 void emu_set_lcd_callback(void (*callback)(void*), void *data) {
     lcd.gui_callback = callback;
     lcd.gui_callback_data = data;
 }
 
+/* Mode requested by the gui, -1 when none; only the emu thread touches the panel, so it is applied at the next vsync */
+static EMU_LOCAL _Atomic(int) lcd_spi_request = -1;
+
 void emu_set_lcd_spi(int enable) {
-    lcd.spi = enable;
+    lcd_spi_request = enable ? 1 : 0;
+}
+
+static void lcd_apply_spi_request(void) {
+    int request = lcd_spi_request;
+    if (request >= 0 && atomic_compare_exchange_strong(&lcd_spi_request, &request, -1)) {
+        lcd_flush_panel();
+        lcd.spi = request;
+    }
 }
 
 void emu_lcd_drawframe(void *output) {
@@ -59,11 +191,156 @@ void emu_lcd_drawframe(void *output) {
     }
 }
 
+/* What the last damage tracked frame was drawn from, if any of it changes the whole frame is redrawn */
+static EMU_LOCAL struct {
+    void *output;
+    uint32_t *data, *data_end;
+    uint32_t control;
+    int spi;
+    uint16_t palette[0x100];
+} drawn;
+
+/* rows are added in increasing order, past the last rectangle they all merge into it */
+static void lcd_damage_rows(lcd_damage_t *damage, uint32_t first, uint32_t last) {
+    if (damage->count) {
+        uint32_t end = damage->rects[damage->count - 1].y + damage->rects[damage->count - 1].height;
+        if (first <= end || damage->count == LCD_DAMAGE_RECTS) {
+            if (last >= end) {
+                damage->rects[damage->count - 1].height = last + 1 - damage->rects[damage->count - 1].y;
+            }
+            return;
+        }
+    }
+    damage->rects[damage->count].x = 0;
+    damage->rects[damage->count].y = first;
+    damage->rects[damage->count].width = LCD_WIDTH;
+    damage->rects[damage->count].height = last + 1 - first;
+    damage->count++;
+}
+
+/* lcd.data always points into ram, since the lcd masks its base address */
+static uint32_t lcd_data_addr(void) {
+    return 0xD00000 + (uint32_t)((uint8_t *)lcd.data - mem.ram.block);
+}
+
+static uint32_t lcd_pixels_per_word(uint32_t control) {
+    uint8_t mode = control >> 1 & 7;
+    return mode < 4 ? 32u >> mode : mode == 5 ? 1 : 2;
+}
+
+/* Finds the rows whose vram pages were written since the last call */
+static void lcd_damage_vram(lcd_damage_t *damage) {
+    uint32_t pixelsPerWord = lcd_pixels_per_word(lcd.control);
+    uint32_t words = (uint32_t)(lcd.data_end - lcd.data);
+    uint32_t addr = lcd_data_addr();
+    uint32_t word, next, last;
+
+    for (word = 0; word < words && word * pixelsPerWord < LCD_SIZE; word = next) {
+        next = (((addr + word * 4) | (MEM_PAGE_SIZE - 1)) + 1 - addr) / 4;
+        if (next > words) {
+            next = words;
+        }
+        if (mem_lcd_written(addr + word * 4, (next - word) * 4)) {
+            last = (next * pixelsPerWord - 1) / LCD_WIDTH;
+            lcd_damage_rows(damage, word * pixelsPerWord / LCD_WIDTH, last < LCD_HEIGHT ? last : LCD_HEIGHT - 1);
+        }
+    }
+    /* whatever the data doesn't cover is drawn as noise every time */
+    if (words * pixelsPerWord < LCD_SIZE) {
+        lcd_damage_rows(damage, words * pixelsPerWord / LCD_WIDTH, LCD_HEIGHT - 1);
+    }
+}
+
+void emu_lcd_drawframe_damage(void *output, lcd_damage_t *damage) {
+    uint32_t *out = output, *data, *data_end;
+    uint32_t pixelsPerWord, row, first, size, i;
+    bool all;
+
+    damage->count = 0;
+    if (!(lcd.control & 1 << 11)) {
+        return;
+    }
+    all = output != drawn.output || lcd.data != drawn.data || lcd.data_end != drawn.data_end ||
+          lcd.control != drawn.control || lcd.spi != drawn.spi ||
+          memcmp(drawn.palette, lcd.palette, sizeof(lcd.palette));
+    drawn.output = output;
+    drawn.data = lcd.data;
+    drawn.data_end = lcd.data_end;
+    drawn.control = lcd.control;
+    drawn.spi = lcd.spi;
+    memcpy(drawn.palette, lcd.palette, sizeof(lcd.palette));
+
+    if (lcd.spi) {
+        /* the panel rewrites its whole display every frame, so compare against what it holds now */
+        for (row = 0; row < LCD_HEIGHT; row++) {
+            if (all || memcmp(&out[row * LCD_WIDTH], spi.display[row], sizeof(spi.display[row]))) {
+                memcpy(&out[row * LCD_WIDTH], spi.display[row], sizeof(spi.display[row]));
+                lcd_damage_rows(damage, row, row);
+            }
+        }
+        return;
+    }
+
+    if (all || !lcd.data) {
+        if (lcd.data) {
+            mem_lcd_written(lcd_data_addr(), (uint32_t)(lcd.data_end - lcd.data) * 4);
+        }
+        lcd_damage_rows(damage, 0, LCD_HEIGHT - 1);
+    } else {
+        lcd_damage_vram(damage);
+    }
+    pixelsPerWord = lcd_pixels_per_word(lcd.control);
+    for (i = 0; i < damage->count; i++) {
+        first = damage->rects[i].y * LCD_WIDTH;
+        size = damage->rects[i].height * LCD_WIDTH;
+        data = data_end = NULL;
+        if (lcd.data && first / pixelsPerWord < (uint32_t)(lcd.data_end - lcd.data)) {
+            data = lcd.data + first / pixelsPerWord;
+            data_end = (uint32_t)(lcd.data_end - data) > size / pixelsPerWord ? data + size / pixelsPerWord : lcd.data_end;
+        }
+        emu_lcd_drawmem(&out[first], data, data_end, lcd.control, (int)size, 0);
+    }
+}
+
+void emu_lcd_frames_init(lcd_frames_t *frames) {
+    memset(frames->buffer, 0, sizeof(frames->buffer));
+    frames->back = 0;
+    frames->shared = 1;
+    frames->front = 2;
+}
+
+/* swaps a buffer with the shared one, the only point where the threads touch */
+static uint8_t lcd_frames_exchange(lcd_frames_t *frames, uint8_t desired) {
+    uint8_t expected = frames->shared;
+    while (!atomic_compare_exchange_strong(&frames->shared, &expected, desired)) {
+    }
+    return expected;
+}
+
+uint32_t *emu_lcd_frames_back(lcd_frames_t *frames) {
+    return frames->buffer[frames->back];
+}
+
+void emu_lcd_frames_publish(lcd_frames_t *frames) {
+    frames->back = lcd_frames_exchange(frames, frames->back | LCD_FRAME_FRESH) & ~LCD_FRAME_FRESH;
+}
+
+const uint32_t *emu_lcd_frames_front(lcd_frames_t *frames, bool *fresh) {
+    bool swap = frames->shared & LCD_FRAME_FRESH;
+    if (swap) {
+        frames->front = lcd_frames_exchange(frames, frames->front) & ~LCD_FRAME_FRESH;
+    }
+    if (fresh) {
+        *fresh = swap;
+    }
+    return frames->buffer[frames->front];
+}
+
 /* Draw the lcd onto an RGBA8888 buffer. Alpha is always 255. */
 void emu_lcd_drawmem(void *output, void *data, void *data_end, uint32_t lcd_control, int size, int use_spi) {
     bool bebo;
     uint_fast8_t mode;
-    uint32_t word, color;
+    uint32_t word;
     uint32_t *out;
     uint32_t *out_end;
     uint32_t *dat;
@@ -85,9 +362,30 @@ void emu_lcd_drawmem(void *output, void *data, void *data_end, uint32_t lcd_cont
     if (!out) { return; }
     if (!dat) { goto draw_black; }
 
+#ifdef LCD_VEC
+    if (mode >= 4) {
+        /* only whole words whose pixels all fit in the output */
+        size_t words = (size_t)(dat_end - dat);
+        size_t fit = (size_t)(out_end - out) / (mode == 5 ? 1 : 2);
+        size_t done;
+        if (words > fit) { words = fit; }
+        switch (mode) {
+            case 4: done = lcd_drawmem_vec(out, dat, words, 4, bebo, _rgb); break;
+            case 5: done = lcd_drawmem_vec(out, dat, words, 5, bebo, _rgb); break;
+            case 6: done = lcd_drawmem_vec(out, dat, words, 6, bebo, _rgb); break;
+            default: done = lcd_drawmem_vec(out, dat, words, 7, bebo, _rgb); break;
+        }
+        dat += done;
+        out += mode == 5 ? done : done * 2;
+        if (out == out_end) { return; }
+    }
+#endif
+
     if (mode < 4) {
+        uint32_t pal[0x100];
         uint_fast8_t bpp = 1u << mode;
         uint32_t mask = (1 << bpp) - 1;
+        lcd_palette_out(pal, mask + 1);
         uint_fast8_t bi = bebo ? 0 : 24;
         bool bepo = lcd_control & (1 << 10);
         if (!bepo) { bi ^= 8 - bpp; }
@@ -95,46 +393,45 @@ void emu_lcd_drawmem(void *output, void *data, void *data_end, uint32_t lcd_cont
             uint_fast8_t bitpos = 32;
             word = *dat++;
             do {
-                color = lcd.palette[word >> ((bitpos -= bpp) ^ bi) & mask];
-                *out++ = lcd_bgr16out(c1555(color));
+                *out++ = pal[word >> ((bitpos -= bpp) ^ bi) & mask];
             } while (bitpos && out != out_end);
         } while (dat < dat_end);
 
     } else if (mode == 4) {
-        do {
+        while (dat < dat_end) {
             word = *dat++;
             if (bebo) { word = word << 16 | word >> 16; }
             *out++ = lcd_bgr16out(c1555(word));
             if (out == out_end) break;
             word >>= 16;
             *out++ = lcd_bgr16out(c1555(word));
-        } while (dat < dat_end);
+        }
 
     } else if (mode == 5) {
-        do {
+        while (dat < dat_end) {
             word = *dat++;
             *out++ = lcd_bgr16out(c565(word));
-        } while (dat < dat_end);
+        }
 
     } else if (mode == 6) {
-        do {
+        while (dat < dat_end) {
             word = *dat++;
             if (bebo) { word = word << 16 | word >> 16; }
             *out++ = lcd_bgr16out(word);
             if (out == out_end) break;
             word >>= 16;
             *out++ = lcd_bgr16out(word);
-        } while (dat < dat_end);
+        }
 
     } else { /* mode == 7 */
-        do {
+        while (dat < dat_end) {
             word = *dat++;
             if (bebo) { word = word << 16 | word >> 16; }
             *out++ = lcd_bgr16out(c12(word));
             if (out == out_end) break;
             word >>= 16;
             *out++ = lcd_bgr16out(c12(word));
-        } while (dat < dat_end);
+        }
     }
 
 draw_black:
@@ -150,68 +447,99 @@ static void lcd_gui_event(void) {
 void lcd_free(void) {
     lcd.gui_callback = NULL;
     lcd.gui_callback_data = NULL;
+    free(panel.colors);
+    panel.colors = NULL;
+    panel.count = 0;
 }
 
-static uint32_t lcd_process_pixel(uint8_t red, uint8_t green, uint8_t blue) {
-    uint32_t v, h, ticks = 1;
-    if (likely(lcd.curRow < lcd.LPP)) {
-        if (!likely(lcd.curCol)) {
-            if (!likely(lcd.curRow)) {
-                for (v = lcd.VBP; v; v--) {
-                    for (h = lcd.HBP + lcd.CPL + lcd.HFP; h && spi_refresh_pixel(); h--) {
-                    }
-                    if (!spi_hsync()) {
-                        break;
-                    }
-                }
-            }
-            for (h = lcd.HBP; h && spi_refresh_pixel(); h--) {
-            }
+/* Porch lines only refresh the panel */
+static void lcd_panel_porch(uint32_t lines) {
+    while (lines--) {
+        spi_update_line(NULL, 0, lcd.HBP + lcd.CPL + lcd.HFP, 0);
+        if (!spi_hsync()) {
+            break;
         }
-        spi_refresh_pixel();
-        if (likely(lcd.curCol < lcd.PPL && spi.ifCtl & SPI_IC_CTRL_DATA)) {
-            if (!likely(lcd.control & 1 << 11)) {
-                red = green = blue = 0;
-            } else if (likely(lcd.BGR)) {
-                uint8_t temp = red;
-                red = blue;
-                blue = temp;
+    }
+}
+
+/* Same as sending each pixel to the panel as it is scanned out, a line at a time */
+static void lcd_panel_pixels(const uint32_t *colors, uint32_t count) {
+    uint32_t before, after, pixels;
+    while (count && likely(panel.row < lcd.LPP)) {
+        before = after = 0;
+        if (!likely(panel.col)) {
+            if (!likely(panel.row)) {
+                lcd_panel_porch(lcd.VBP);
             }
-            spi_update_pixel_16bpp(red, green, blue);
+            before = lcd.HBP;
         }
-        if (unlikely(++lcd.curCol >= lcd.PPL)) {
-            for (h = lcd.HFP; h && spi_refresh_pixel(); h--) {
-            }
+        pixels = lcd.PPL - panel.col;
+        if (pixels > count) {
+            pixels = count;
+        } else {
+            after = lcd.HFP;
+        }
+        spi_update_line(colors, pixels, before, after);
+        colors += pixels;
+        count -= pixels;
+        if ((panel.col += pixels) >= lcd.PPL) {
             spi_hsync();
-            if (unlikely(++lcd.curRow >= lcd.LPP)) {
-                for (v = lcd.VFP; v; v--) {
-                    for (h = lcd.HBP + lcd.CPL + lcd.HFP; h && spi_refresh_pixel(); h--) {
-                    }
-                    if (!spi_hsync()) {
-                        break;
-                    }
-                }
+            if (++panel.row >= lcd.LPP) {
+                lcd_panel_porch(lcd.VFP);
             }
+            panel.col = 0;
+        }
+    }
+}
+
+void lcd_flush_panel(void) {
+    lcd_panel_pixels(panel.colors, panel.count);
+    panel.count = 0;
+}
+
+/* Advances the scan position by a number of pixels, returns how long they take */
+static uint32_t lcd_pixel_ticks(uint32_t pixels) {
+    uint32_t left, ticks = 0;
+    while (pixels && likely(lcd.curRow < lcd.LPP)) {
+        left = lcd.PPL - lcd.curCol;
+        if (pixels < left) {
+            lcd.curCol += pixels;
+            ticks += pixels;
+            pixels = 0;
+        } else {
+            ticks += left + lcd.HFP + lcd.HSW + lcd.HBP;
+            pixels -= left;
             lcd.curCol = 0;
-            ticks += lcd.HFP + lcd.HSW + lcd.HBP;
+            lcd.curRow++;
         }
     }
-    return ticks * lcd.PCD * 2;
+    return (ticks + pixels) * lcd.PCD * 2;
+}
+
+static uint32_t lcd_pixel_color(uint8_t red, uint8_t green, uint8_t blue) {
+    if (!likely(lcd.control & 1 << 11)) {
+        red = green = blue = 0;
+    } else if (likely(lcd.BGR)) {
+        uint8_t temp = red;
+        red = blue;
+        blue = temp;
+    }
+    return spi.lut[red + 0] | spi.lut[green + 32] << 8 | (uint32_t)spi.lut[blue + 96] << 16;
 }
 
-static uint32_t lcd_process_half(uint16_t pixel) {
+static uint32_t lcd_half_color(uint16_t pixel) {
     switch (lcd.LCDBPP) {
         default: /* 1555 */
-            return lcd_process_pixel(pixel & 0x1F, (pixel >> 4 & 0x3E) | (pixel >> 15 & 1), pixel >> 10 & 0x1F);
+            return lcd_pixel_color(pixel & 0x1F, (pixel >> 4 & 0x3E) | (pixel >> 15 & 1), pixel >> 10 & 0x1F);
         case 6: /* 565 */
-            return lcd_process_pixel(pixel & 0x1F, pixel >> 5 & 0x3F, pixel >> 11 & 0x1F);
+            return lcd_pixel_color(pixel & 0x1F, pixel >> 5 & 0x3F, pixel >> 11 & 0x1F);
         case 7: /* 444 */
-            return lcd_process_pixel(pixel << 1 & 0x1E, pixel >> 2 & 0x3C, pixel >> 7 & 0x1E);
+            return lcd_pixel_color(pixel << 1 & 0x1E, pixel >> 2 & 0x3C, pixel >> 7 & 0x1E);
     }
 }
 
-static uint32_t lcd_process_index(uint8_t index) {
-    return lcd_process_half(lcd.palette[index]);
+static uint32_t lcd_index_color(uint8_t index) {
+    return lcd_half_color(lcd.palette[index]);
 }
 
 static void lcd_fill_bytes(uint8_t bytes) {
@@ -236,24 +564,47 @@ static uint32_t lcd_drain_word(uint8_t *pos) {
     return word;
 }
 
-static uint32_t lcd_words(uint8_t words) {
-    uint32_t ticks = 0;
-    uint8_t pos = lcd.pos, bit, bpp = 1 << lcd.LCDBPP;
+static void lcd_build_lookup(void) {
+    unsigned int i;
+    for (i = 0; i < 0x100; i++) {
+        if (lcd.LCDBPP == 5) {
+            panel.lookup[0][i] = lcd_pixel_color(i >> 3, 0, 0);
+            panel.lookup[1][i] = lcd_pixel_color(0, i >> 2, 0);
+            panel.lookup[2][i] = lcd_pixel_color(0, 0, i >> 3);
+        } else if (lcd.LCDBPP >= 4) {
+            panel.lookup[0][i] = lcd_half_color(i);
+            panel.lookup[1][i] = lcd_half_color(i << 8);
+        } else {
+            panel.lookup[0][i] = lcd_index_color(i);
+        }
+    }
+    panel.lookupValid = true;
+}
+
+/* Converts words from the fifo to panel colors, returns how many pixels they held */
+static uint32_t lcd_words(uint8_t words, uint32_t *colors) {
+    const uint32_t (*lookup)[0x100] = panel.lookup;
+    const uint8_t mode = lcd.LCDBPP, bpp = 1 << mode, mask = (1 << bpp) - 1;
+    const uint8_t shift = unlikely(lcd.BEPO) ? 8 - bpp : 0;
+    uint32_t *out = colors;
+    uint8_t pos = lcd.pos, bit;
+    if (unlikely(!panel.lookupValid)) {
+        lcd_build_lookup();
+    }
     while (words--) {
         uint32_t word = lcd_drain_word(&pos);
-        if (unlikely(lcd.LCDBPP == 5)) {
-            ticks += lcd_process_pixel(word >> 3 & 0x1F, word >> 10 & 0x3F, word >> 19 & 0x1F);
-        } else if (unlikely(lcd.LCDBPP >= 4)) {
-            ticks += lcd_process_half(word);
-            ticks += lcd_process_half(word >> 16);
+        if (unlikely(mode == 5)) {
+            *out++ = lookup[0][word & 0xFF] | lookup[1][word >> 8 & 0xFF] | lookup[2][word >> 16 & 0xFF];
+        } else if (unlikely(mode >= 4)) {
+            *out++ = lookup[0][word & 0xFF] | lookup[1][word >> 8 & 0xFF];
+            *out++ = lookup[0][word >> 16 & 0xFF] | lookup[1][word >> 24];
         } else {
             for (bit = 0; bit < 32; bit += bpp) {
-                ticks += lcd_process_index(word >> (bit ^ (unlikely(lcd.BEPO) ? 8 - bpp : 0)) &
-                                           ((1 << bpp) - 1));
+                *out++ = lookup[0][word >> (bit ^ shift) & mask];
             }
         }
     }
-    return ticks;
+    return (uint32_t)(out - colors);
 }
 
 static void lcd_event(enum sched_item_id id) {
@@ -273,6 +624,8 @@ static void lcd_event(enum sched_item_id id) {
         default:
             fallthrough;
         case LCD_SYNC:
+            lcd_flush_panel();
+            lcd_apply_spi_request();
             lcd_gui_event();
             lcd.PPL =  ((lcd.timing[0] >>  2 &  0x3F) + 1) << 4;
             lcd.HSW =   (lcd.timing[0] >>  8 &  0xFF) + 1;
@@ -302,6 +655,7 @@ static void lcd_event(enum sched_item_id id) {
             lcd.BEPO =   lcd.control   >> 10 &     1;
             lcd.WTRMRK = lcd.control   >> 16 &     1;
             lcd.BPP = lcd.LCDBPP <= 5 ? lcd.LCDBPP : 4;
+            panel.lookupValid = false;
             lcd.PPF = 1 << (8 + lcd.WTRMRK - lcd.BPP);
             duration = ((lcd.VSW - 1) * (lcd.HSW + lcd.HBP + lcd.CPL + lcd.HFP) +
                         lcd.HSW) * lcd.PCD + 1;
@@ -309,6 +663,7 @@ static void lcd_event(enum sched_item_id id) {
             if (lcd.spi) {
                 lcd.pos = 0;
                 lcd.curRow = lcd.curCol = 0;
+                panel.row = panel.col = 0;
                 spi_vsync();
                 sched_repeat_relative(SCHED_LCD_DMA, SCHED_LCD, duration, 0);
             }
@@ -339,7 +694,7 @@ static void lcd_event(enum sched_item_id id) {
 }
 
 static uint32_t lcd_dma(enum sched_item_id id) {
-    uint32_t ticks;
+    uint32_t ticks, pixels, colors[LCD_DMA_PIXELS];
     if (unlikely(lcd.prefill)) {
         if (!lcd.pos) {
             lcd.upcurr = lcd.upbase;
@@ -352,7 +707,21 @@ static uint32_t lcd_dma(enum sched_item_id id) {
         }
         return lcd.pos & 64 ? 18 : 19;
     }
-    ticks = lcd_words(lcd.WTRMRK ? 16 : 8);
+    if (likely(panel.colors)) {
+        if (panel.count > LCD_PANEL_SIZE - LCD_DMA_PIXELS) {
+            lcd_flush_panel();
+        }
+        pixels = lcd_words(lcd.WTRMRK ? 16 : 8, &panel.colors[panel.count]);
+        panel.count += pixels;
+        /* scrolled refreshes draw from bus_rand, which has to stay in order */
+        if (unlikely(spi.mode & SPI_MODE_SCROLL)) {
+            lcd_flush_panel();
+        }
+    } else {
+        pixels = lcd_words(lcd.WTRMRK ? 16 : 8, colors);
+        lcd_panel_pixels(colors, pixels);
+    }
+    ticks = lcd_pixel_ticks(pixels);
     lcd_fill_bytes(lcd.WTRMRK ? 64 : 32);
     if (lcd.curRow < lcd.LPP) {
         sched_repeat(id, ticks);
@@ -361,7 +730,11 @@ static uint32_t lcd_dma(enum sched_item_id id) {
 }
 
 void lcd_reset(void) {
+    lcd_flush_panel();
+    lcd_apply_spi_request();
     memset(&lcd, 0, offsetof(lcd_state_t, spi));
+    panel.row = panel.col = 0;
+    panel.lookupValid = false;
     lcd_update();
 
     sched.items[SCHED_LCD].callback.event = lcd_event;
@@ -507,6 +880,7 @@ static void lcd_write(const uint16_t pio, const uint8_t value, bool poke) {
         } else if (index == 0x018) {
             old = lcd.control;
             write8(lcd.control, bit_offset, value);
+            panel.lookupValid = false;
             if ((lcd.control ^ old) & 1 << 0) { /* lcdEn changed */
                 if (lcd.control & 1 << 0) {
                     lcd.compare = LCD_SYNC;
@@ -526,6 +900,7 @@ static void lcd_write(const uint16_t pio, const uint8_t value, bool poke) {
         lcd_update();
     } else if (index < 0x400) {
         write8(lcd.palette[pio >> 1 & 0xFF], (pio & 1) << 3, value);
+        panel.lookupValid = false;
     } else if (index < 0xC30) {
         if (index < 0xC00 && index >= 0x800) {
             write8(lcd.crsrImage[((pio-0x800) & 0x3FF) >> 2], bit_offset, value);
@@ -569,26 +944,38 @@ static const eZ80portrange_t device = {
 
 eZ80portrange_t init_lcd(void) {
     memset(&lcd, 0, offsetof(lcd_state_t, spi));
+    if (!panel.colors) {
+        panel.colors = malloc(LCD_PANEL_SIZE * sizeof(uint32_t));
+    }
+    panel.count = panel.row = panel.col = 0;
+    panel.lookupValid = false;
     gui_console_printf("[CEmu] Initialized LCD...\n");
     return device;
 }
 
-bool lcd_save(FILE *image) {
+bool lcd_save(image_t *image) {
     lcd_state_t sanatizedLcd;
+    lcd_flush_panel(); /* before spi_save */
     memcpy(&sanatizedLcd, &lcd, sizeof(lcd_state_t));
     sanatizedLcd.gui_callback = NULL;
     sanatizedLcd.gui_callback_data = NULL;
     sanatizedLcd.data = NULL;
     sanatizedLcd.data_end = NULL;
-    return fwrite(&sanatizedLcd, sizeof(lcd_state_t), 1, image) == 1;
+    return image_write(image, &sanatizedLcd, sizeof(lcd_state_t));
 }
 
-bool lcd_restore(FILE *image) {
-    bool ret = fread(&lcd, sizeof(lcd), 1, image) == 1;
-    lcd.gui_callback = NULL;
-    lcd.gui_callback_data = NULL;
+bool lcd_restore(image_t *image) {
+    void (*gui_callback)(void*) = lcd.gui_callback;
+    void *gui_callback_data = lcd.gui_callback_data;
+    bool ret = image_read(image, &lcd, sizeof(lcd));
+    lcd.gui_callback = gui_callback;
+    lcd.gui_callback_data = gui_callback_data;
     lcd.data = NULL;
     lcd.data_end = NULL;
     lcd_update();
+    panel.count = 0;
+    panel.row = lcd.curRow;
+    panel.col = lcd.curCol;
+    panel.lookupValid = false;
     return ret;
 }
@@ -1,6 +1,8 @@
 ﻿#ifndef LCD_H
 #define LCD_H
 
+#include "image.h"
+#include "atomics.h"
 #include "defines.h"
 
 #ifdef __cplusplus
@@ -72,22 +74,47 @@ typedef struct lcd_state {
     void *gui_callback_data;
 } lcd_state_t;
 
-extern lcd_state_t lcd;
+extern EMU_LOCAL lcd_state_t lcd;
 
 void lcd_reset(void);
 void lcd_free(void);
 eZ80portrange_t init_lcd(void);
-bool lcd_restore(FILE *image);
-bool lcd_save(FILE *image);
+bool lcd_restore(image_t *image);
+bool lcd_save(image_t *image);
 void lcd_update(void);
 void lcd_disable(void);
+void lcd_flush_panel(void);   /* send pixels the dma already fetched to the panel */
 
 /* api functions */
 void emu_lcd_drawframe(void *output);
 void emu_set_lcd_callback(void (*callback)(void*), void *data);
-void emu_set_lcd_spi(int enable);
-
-/* advanced api functions */
+void emu_set_lcd_spi(int enable);   /* takes effect at the next vsync, safe from the gui thread */
+
+/* rows redrawn by emu_lcd_drawframe_damage, as full width rectangles, empty if the frame didn't change */
+#define LCD_DAMAGE_RECTS 8
+typedef struct lcd_damage {
+    unsigned int count;
+    struct {
+        uint16_t x, y, width, height;
+    } rects[LCD_DAMAGE_RECTS];
+} lcd_damage_t;
+
+void emu_lcd_drawframe_damage(void *output, lcd_damage_t *damage);  /* output must still hold the frame from the last call */
+
+/* frames handed from the emu thread to a gui thread without locking, the reader always gets the newest one */
+#define LCD_FRAME_FRESH 4
+typedef struct lcd_frames {
+    uint32_t buffer[3][LCD_SIZE];
+    _Atomic(uint8_t) shared;     /* buffer between the threads, with LCD_FRAME_FRESH until the reader takes it */
+    uint8_t back, front;         /* buffers owned by the writer and by the reader */
+} lcd_frames_t;
+
+void emu_lcd_frames_init(lcd_frames_t *frames);                          /* clear to black, only while neither side uses it */
+uint32_t *emu_lcd_frames_back(lcd_frames_t *frames);                     /* writer: buffer to draw the next frame into */
+void emu_lcd_frames_publish(lcd_frames_t *frames);                       /* writer: make the drawn buffer the newest frame */
+const uint32_t *emu_lcd_frames_front(lcd_frames_t *frames, bool *fresh); /* reader: newest frame, fresh if it changed since the last call */
+
+/* advanced api functions, with MULTI_INSTANCE these read the lcd of the calling thread's emulator */
 void emu_set_lcd_ptrs(uint32_t **dat, uint32_t **dat_end, int width, int height, uint32_t addr, uint32_t lcd_control, bool mask);
 void emu_lcd_drawmem(void *output, void *data, void *data_end, uint32_t lcd_control, int size, int spi);
 
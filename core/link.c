@@ -9,6 +9,7 @@
 #include "os/os.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #define ADDR_SAFE_RAM   0xD052C6
@@ -18,6 +19,12 @@
 #define FILE_DATA 0x35
 #define FILE_DATA_START 0x37
 
+static EMU_LOCAL bool link_turbo;
+
+void EMSCRIPTEN_KEEPALIVE emu_set_link_turbo(bool enabled) {
+    link_turbo = enabled;
+}
+
 int EMSCRIPTEN_KEEPALIVE emu_send_variable(const char *file, int location) {
     return emu_send_variables(&file, 1, location, NULL, NULL);
 }
@@ -47,7 +54,7 @@ int EMSCRIPTEN_KEEPALIVE emu_send_variables(const char *const *files, int num, i
         }
         snprintf(argv[i+1], arg_size, "send%s:%s", locations[location], files[i]);
     }
-    err = usb_init_device(1+num, (const char *const *)argv, progress_handler, progress_context);
+    err = usb_init_device(1+num, (const char *const *)argv, progress_handler, progress_context, link_turbo);
     if (err != 0) {
         gui_console_printf("[CEmu] USB transfer error code %d.\n", err);
     }
@@ -110,6 +117,82 @@ w_err:
     return LINK_ERR;
 }
 
+static int emu_inject_variable(const char *file, int location) {
+    calc_var_t var, found;
+    uint8_t *buffer = NULL, *entry, *end;
+    uint16_t header_size, data_size;
+    long length;
+    int status = LINK_GOOD;
+    FILE *fd;
+
+    if (!(fd = fopen_utf8(file, "rb")))                                goto r_err;
+    if (fseek(fd, 0, SEEK_END) || (length = ftell(fd)) < FILE_DATA_START) goto r_err;
+    if (fseek(fd, 0, SEEK_SET) || !(buffer = malloc(length)))          goto r_err;
+    if (fread(buffer, length, 1, fd) != 1 || memcmp(buffer, header, 8)) goto r_err;
+    (void)fclose(fd);
+    fd = NULL;
+
+    end = buffer + FILE_DATA_START + (buffer[FILE_DATA] | buffer[FILE_DATA + 1] << 8);
+    if (end > buffer + length)                                         goto r_err;
+    for (entry = buffer + FILE_DATA_START; entry != end; entry += 4 + header_size + data_size) {
+        if (end - entry < 4)                                           goto r_err;
+        header_size = entry[0] | entry[1] << 8;
+        data_size = entry[2] | entry[3] << 8;
+        if (header_size < 11 || end - entry < 4 + header_size + data_size) goto r_err;
+
+        memset(&var, 0, sizeof var);
+        var.type1 = entry[4];
+        var.type = (calc_var_type_t)(var.type1 & 0x3F);
+        memcpy(var.name, &entry[5], 8);
+        var.version = header_size > 11 ? entry[13] : 0;
+        var.size = data_size;
+        var.data = &entry[4 + header_size];
+        var.named = calc_var_is_named(&var);
+        var.namelen = var.named ? strnlen((const char *)var.name, 8) : 3;
+        if (location == LINK_ARCH || (location == LINK_FILE && header_size > 12 && entry[14] & 0x80)) {
+            gui_console_printf("[CEmu] Inject Warning: %s is placed in RAM instead of the archive.\n",
+                               calc_var_name_to_utf8(var.name, var.named));
+            status = LINK_WARN;
+        }
+
+        /* whatever ram variable holds the name is replaced, then the new one has to read back unchanged */
+        if (var.type >= CALC_VAR_TYPE_OPERATING_SYSTEM || var.type == CALC_VAR_TYPE_BACKUP) goto c_err;
+        while (vat_search_name(&var, &found)) {
+            if (!vat_delete(&found))                                   goto c_err;
+        }
+        if (!vat_create(&var) || !vat_search_find(&var, &found) ||
+            found.size != var.size || !found.data || memcmp(found.data, var.data, var.size)) {
+            goto c_err;
+        }
+    }
+    free(buffer);
+    return status;
+
+c_err:
+    free(buffer);
+    gui_console_printf("[CEmu] Inject Error: could not create %s.\n", calc_var_name_to_utf8(var.name, var.named));
+    return LINK_ERR;
+
+r_err:
+    if (fd) {
+        (void)fclose(fd);
+    }
+    free(buffer);
+    gui_console_printf("[CEmu] Inject Error: %s is not a valid variable file.\n", file);
+    return LINK_ERR;
+}
+
+int EMSCRIPTEN_KEEPALIVE emu_inject_variables(const char *const *files, int num, int location) {
+    int status = LINK_GOOD;
+    for (int i = 0; i < num && status != LINK_ERR; i++) {
+        int err = emu_inject_variable(files[i], location);
+        if (err > status) {
+            status = err;
+        }
+    }
+    return status;
+}
+
 int emu_cancel_transfer(void) {
-    return usb_init_device(0, NULL, NULL, NULL);
+    return usb_init_device(0, NULL, NULL, NULL, false);
 }
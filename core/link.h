@@ -15,7 +15,9 @@ int emu_send_variable(const char *file, int location);
 int emu_send_variables(const char *const *files, int num, int location,
                        usb_progress_handler_t *progress_handler, void *progress_context);
 int emu_receive_variable(const char *file, const calc_var_t *vars, int count);
+int emu_inject_variables(const char *const *files, int num, int location);   /* write straight into the vat, only while the os is idle */
 int emu_cancel_transfer(void);
+void emu_set_link_turbo(bool enabled);   /* end host side waits of later transfers once the calc halts */
 
 #ifdef __cplusplus
 }
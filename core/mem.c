@@ -6,6 +6,7 @@
 #include "flash.h"
 #include "control.h"
 #include "debug/debug.h"
+#include "os/os.h"
 
 #include <assert.h>
 #include <string.h>
@@ -15,24 +16,152 @@
 #define mmio_mapped(addr, select) ((addr) < (((select) = (addr) >> 6 & 0x4000) ? 0xFB0000 : 0xE40000))
 #define mmio_port(addr, select) (0x1000 + (select) + ((addr) >> 4 & 0xF000) + ((addr) & 0xFFF))
 
+#define MEM_NUM_PAGES (0x1000000 >> MEM_PAGE_BITS)
+
 /* Global MEMORY state */
-mem_state_t mem;
+EMU_LOCAL mem_state_t mem;
+
+/* Host pointers for pages that can be accessed without side effects other than wait states */
+static EMU_LOCAL uint8_t *page_read[MEM_NUM_PAGES];
+static EMU_LOCAL uint8_t *page_write[MEM_NUM_PAGES];
+
+#define MEM_FLASH_PAGES (SIZE_FLASH >> MEM_PAGE_BITS)
+#define MEM_RAM_PAGES ((SIZE_RAM + MEM_PAGE_SIZE - 1) >> MEM_PAGE_BITS)
+#define MEM_DIRTY_PAGES (MEM_FLASH_PAGES + MEM_RAM_PAGES)
+
+/* Version of the flash and ram chunks in chunked images */
+#define MEM_IMAGE_VERSION 1
+
+/* Dirty page flags: written since the delta base was set, since mem_written last looked, and since mem_lcd_written did */
+#define MEM_DIRTY_BASE 1
+#define MEM_DIRTY_WATCH 2
+#define MEM_DIRTY_LCD 4
+#define MEM_DIRTY_ALL (MEM_DIRTY_BASE | MEM_DIRTY_WATCH | MEM_DIRTY_LCD)
+
+/* Copy of memory used as the base for delta saves, and the pages written since it was taken (flash pages first) */
+static EMU_LOCAL struct mem_base {
+    uint8_t *flash;
+    uint8_t *ram;
+    uint32_t serial;
+    uint8_t dirty[MEM_DIRTY_PAGES];
+} base;
+
+/* Set when flash is a copy-on-write mapping of the ROM file instead of a private allocation */
+static EMU_LOCAL bool flash_shared;
+/* The file it is mapped from, if that could be identified */
+static EMU_LOCAL bool flash_file_known;
+static EMU_LOCAL os_file_id_t flash_file;
+
+static void mem_dirty_ptr(const uint8_t *ptr, uint32_t size) {
+    uint32_t first, last;
+    if (!size) {
+        return;
+    }
+    if (ptr >= mem.ram.block && ptr < mem.ram.block + SIZE_RAM) {
+        first = MEM_FLASH_PAGES + ((ptr - mem.ram.block) >> MEM_PAGE_BITS);
+        last = MEM_FLASH_PAGES + ((ptr - mem.ram.block + size - 1) >> MEM_PAGE_BITS);
+    } else if (ptr >= mem.flash.block && ptr < mem.flash.block + SIZE_FLASH) {
+        first = (ptr - mem.flash.block) >> MEM_PAGE_BITS;
+        last = (ptr - mem.flash.block + size - 1) >> MEM_PAGE_BITS;
+    } else {
+        return;
+    }
+    memset(&base.dirty[first], MEM_DIRTY_ALL, last - first + 1);
+}
+
+/* the part of a block that holds a dirty page */
+static uint8_t *mem_dirty_page(uint32_t page, uint8_t *flash, uint8_t *ram, uint32_t *size) {
+    if (page < MEM_FLASH_PAGES) {
+        *size = MEM_PAGE_SIZE;
+        return flash + (page << MEM_PAGE_BITS);
+    }
+    page -= MEM_FLASH_PAGES;
+    *size = page == MEM_RAM_PAGES - 1 ? SIZE_RAM - (page << MEM_PAGE_BITS) : MEM_PAGE_SIZE;
+    return ram + (page << MEM_PAGE_BITS);
+}
+
+static void mem_update_page(uint32_t page) {
+    uint32_t start = page << MEM_PAGE_BITS;
+    uint32_t end = start + MEM_PAGE_SIZE - 1;
+    uint8_t *ptr = NULL;
+    if (start < 0x800000) {
+        if (mem.flash.block && flash.mapped && end <= flash.mask && end < SIZE_FLASH && flash.waitStates != 6) {
+            ptr = mem.flash.block + start;
+        }
+    } else if (start >= 0xD00000 && start < 0xE00000) {
+        if (mem.ram.block && (end & 0x7FFFF) < SIZE_RAM) {
+            ptr = mem.ram.block + (start & 0x7FFFF);
+        }
+    }
+    if (end >= control.protectedStart && start <= control.protectedEnd) {
+        ptr = NULL;
+    }
+    page_read[page] = ptr;
+    page_write[page] = start >= 0xD00000 && (control.stackLimit < start || control.stackLimit > end) ? ptr : NULL;
+}
+
+void mem_update_page_range(uint32_t start, uint32_t end) {
+    uint32_t page, last;
+    if (start > end) {
+        page = start;
+        start = end;
+        end = page;
+    }
+    last = (end & 0xFFFFFF) >> MEM_PAGE_BITS;
+    for (page = (start & 0xFFFFFF) >> MEM_PAGE_BITS; page <= last; page++) {
+        mem_update_page(page);
+    }
+}
+
+void mem_update_pages(void) {
+    mem_update_page_range(0, 0xFFFFFF);
+}
+
+uint8_t *mem_page_ptr(uint32_t addr, bool write) {
+    uint8_t *ptr = (write ? page_write : page_read)[addr >> MEM_PAGE_BITS];
+    if (!ptr || (addr < 0xD00000 && mem.flash.command != FLASH_NO_COMMAND)) {
+        return NULL;
+    }
+    return ptr + (addr & (MEM_PAGE_SIZE - 1));
+}
+
+static void mem_set_flash_block(uint8_t *block) {
+    unsigned int i;
+
+    mem.flash.block = block;
+    for (i = 0; i < NUM_8K_SECTORS; i++) {
+        mem.flash.sector8k[i].ptr = block + i * SIZE_FLASH_SECTOR_8K;
+    }
+    for (i = 0; i < NUM_SECTORS; i++) {
+        mem.flash.sector[i].ptr = block + i * SIZE_FLASH_SECTOR_64K;
+    }
+}
+
+static void mem_free_flash_block(void) {
+    if (flash_shared) {
+        os_unmap(mem.flash.block, SIZE_FLASH);
+        flash_shared = false;
+    } else {
+        free(mem.flash.block);
+    }
+    mem.flash.block = NULL;
+}
 
 void mem_init(void) {
     unsigned int i;
 
-    /* Allocate FLASH memory */
-    mem.flash.block = (uint8_t*)malloc(SIZE_FLASH);
-    memset(mem.flash.block, 0xFF, SIZE_FLASH);
+    /* Allocate FLASH memory, unless it was already mapped from the rom file */
+    if (!flash_shared) {
+        mem_set_flash_block((uint8_t*)malloc(SIZE_FLASH));
+        memset(mem.flash.block, 0xFF, SIZE_FLASH);
+    }
 
     for (i = 0; i < NUM_8K_SECTORS; i++) {
-        mem.flash.sector8k[i].ptr = mem.flash.block + i * SIZE_FLASH_SECTOR_8K;
         mem.flash.sector8k[i].ipb = 0;
         mem.flash.sector8k[i].dpb = 1;
     }
 
     for (i = 0; i < NUM_SECTORS; i++) {
-        mem.flash.sector[i].ptr = mem.flash.block + i * SIZE_FLASH_SECTOR_64K;
         mem.flash.sector[i].ipb = 1;
         mem.flash.sector[i].dpb = 1;
     }
@@ -43,19 +172,71 @@ void mem_init(void) {
 
     mem.flash.write = 0;
     mem.flash.command = FLASH_NO_COMMAND;
+    mem_update_pages();
     gui_console_printf("[CEmu] Initialized Memory...\n");
 }
 
 void mem_free(void) {
+    free(base.ram);
+    base.ram = NULL;
+    free(base.flash);
+    base.flash = NULL;
     free(mem.ram.block);
     mem.ram.block = NULL;
-    free(mem.flash.block);
-    mem.flash.block = NULL;
+    mem_free_flash_block();
+    mem_update_pages();
     gui_console_printf("[CEmu] Freed Memory.\n");
 }
 
+bool mem_share_flash(FILE *file, size_t offset) {
+    uint8_t *block;
+
+    assert(!mem.flash.block);
+
+    if (!(block = (uint8_t*)os_map_private(file, offset, SIZE_FLASH))) {
+        return false;
+    }
+    mem_set_flash_block(block);
+    flash_shared = true;
+    flash_file_known = os_file_id(file, &flash_file);
+    return true;
+}
+
+bool mem_flash_mapped_from(const char *path) {
+    os_file_id_t id;
+
+    if (!flash_shared) {
+        return false;
+    }
+    if (!flash_file_known) {
+        return true;
+    }
+    return os_path_id(path, &id) && id.device == flash_file.device && id.index == flash_file.index;
+}
+
+bool mem_unshare_flash(void) {
+    uint8_t *block;
+
+    if (!flash_shared) {
+        return true;
+    }
+    if (!(block = (uint8_t*)malloc(SIZE_FLASH))) {
+        return false;
+    }
+    memcpy(block, mem.flash.block, SIZE_FLASH);
+    mem_free_flash_block();
+    mem_set_flash_block(block);
+    mem_update_pages();
+    return true;
+}
+
+bool mem_flash_shared(void) {
+    return flash_shared;
+}
+
 void mem_reset(void) {
     memset(mem.ram.block, 0, SIZE_RAM);
+    mem_dirty_ptr(mem.ram.block, SIZE_RAM);
     mem.flash.command = FLASH_NO_COMMAND;
     gui_console_printf("[CEmu] Memory reset.\n");
 }
@@ -69,6 +250,7 @@ static uint32_t flash_block(uint32_t *addr, uint32_t *size) {
         /* assume this will crash */
         if (flash.waitStates == 6) {
             flash.waitStates = 10;
+            mem_update_page_range(0, 0x7FFFFF);
             cpu_crash("[CEmu] Reset triggered, flash data not latched.\n");
         }
         return flash.waitStates;
@@ -116,6 +298,52 @@ void *phys_mem_ptr(uint32_t addr, int32_t size) {
     return NULL;
 }
 
+void mem_invalidate_ptr(const void *ptr, uint32_t size) {
+    const uint8_t *p = ptr;
+    if (p >= mem.ram.block && p < mem.ram.block + SIZE_RAM) {
+        cpu_cache_invalidate(0xD00000 + (uint32_t)(p - mem.ram.block), size);
+    } else if (p >= mem.flash.block && p < mem.flash.block + SIZE_FLASH) {
+        cpu_cache_invalidate((uint32_t)(p - mem.flash.block), size);
+    }
+    mem_dirty_ptr(p, size);
+}
+
+static bool mem_test_dirty(uint32_t addr, uint32_t size, uint8_t bit) {
+    uint32_t page, last, block_size, end_addr;
+    bool written = false;
+    void *block;
+
+    if (!size) {
+        return false;
+    }
+    end_addr = addr_block(&addr, (int32_t)size, &block, &block_size);
+    if (addr > end_addr || end_addr > block_size) {
+        return true; /* not tracked, so assume it changed */
+    }
+    if (block == mem.flash.block) {
+        page = addr >> MEM_PAGE_BITS;
+        last = (end_addr - 1) >> MEM_PAGE_BITS;
+    } else if (block == mem.ram.block) {
+        page = MEM_FLASH_PAGES + (addr >> MEM_PAGE_BITS);
+        last = MEM_FLASH_PAGES + ((end_addr - 1) >> MEM_PAGE_BITS);
+    } else {
+        return true;
+    }
+    for (; page <= last; page++) {
+        written |= base.dirty[page] & bit;
+        base.dirty[page] &= ~bit;
+    }
+    return written;
+}
+
+bool mem_written(uint32_t addr, uint32_t size) {
+    return mem_test_dirty(addr, size, MEM_DIRTY_WATCH);
+}
+
+bool mem_lcd_written(uint32_t addr, uint32_t size) {
+    return mem_test_dirty(addr, size, MEM_DIRTY_LCD);
+}
+
 void *virt_mem_cpy(void *buf, uint32_t addr, int32_t size) {
     uint8_t *dest = buf, *save_dest;
     void *block;
@@ -193,6 +421,8 @@ static void flash_write(uint32_t addr, uint8_t byte) {
 
     if (valid == true) {
         mem.flash.block[addr] &= byte;
+        base.dirty[addr >> MEM_PAGE_BITS] = MEM_DIRTY_ALL;
+        cpu_cache_invalidate(addr, 1);
     }
 }
 
@@ -206,15 +436,18 @@ static void flash_erase(uint32_t addr, uint8_t byte) {
     for (i = 0; i < NUM_8K_SECTORS; i++) {
         if ((mem.flash.sector8k[i].ipb & mem.flash.sector8k[i].dpb) == 1) {
             memset(mem.flash.sector8k[i].ptr, 0xFF, SIZE_FLASH_SECTOR_8K);
+            mem_dirty_ptr(mem.flash.sector8k[i].ptr, SIZE_FLASH_SECTOR_8K);
         }
     }
 
     for (i = 0; i < NUM_SECTORS; i++) {
         if ((mem.flash.sector[i].ipb & mem.flash.sector[i].dpb) == 1) {
             memset(mem.flash.sector[i].ptr, 0xFF, SIZE_FLASH_SECTOR_64K);
+            mem_dirty_ptr(mem.flash.sector[i].ptr, SIZE_FLASH_SECTOR_64K);
         }
     }
 
+    cpu_cache_flush();
     gui_console_printf("[CEmu] Erased Unlocked Sectors.\n");
 }
 
@@ -228,11 +461,15 @@ static void flash_erase_sector(uint32_t addr, uint8_t byte) {
         selected = addr / SIZE_FLASH_SECTOR_8K;
         if ((mem.flash.sector8k[selected].ipb & mem.flash.sector8k[selected].dpb) == 1) {
             memset(mem.flash.sector8k[selected].ptr, 0xff, SIZE_FLASH_SECTOR_8K);
+            mem_dirty_ptr(mem.flash.sector8k[selected].ptr, SIZE_FLASH_SECTOR_8K);
+            cpu_cache_invalidate(selected * SIZE_FLASH_SECTOR_8K, SIZE_FLASH_SECTOR_8K);
         }
     } else {
         selected = addr / SIZE_FLASH_SECTOR_64K;
         if ((mem.flash.sector[selected].ipb & mem.flash.sector[selected].dpb) == 1) {
             memset(mem.flash.sector[selected].ptr, 0xff, SIZE_FLASH_SECTOR_64K);
+            mem_dirty_ptr(mem.flash.sector[selected].ptr, SIZE_FLASH_SECTOR_64K);
+            cpu_cache_invalidate(selected * SIZE_FLASH_SECTOR_64K, SIZE_FLASH_SECTOR_64K);
         }
     }
 }
@@ -603,9 +840,17 @@ static bool detect_flash_unlock_sequence(uint8_t current) {
     return true;
 }
 
+static inline void mem_fetched(uint8_t value) {
+    mem.buffer[++mem.fetch] = value;
+    if (control.flashUnlocked & 1 << 3 && unprivileged_code()) {
+        control.flashUnlocked &= ~(1 << 3);
+    }
+}
+
 uint8_t mem_read_cpu(uint32_t addr, bool fetch) {
     uint8_t value = 0;
     uint32_t ramAddr, select;
+    uint8_t *ptr;
 
     addr &= 0xFFFFFF;
 #ifdef DEBUG_SUPPORT
@@ -621,15 +866,37 @@ uint8_t mem_read_cpu(uint32_t addr, bool fetch) {
                 }
             }
         }
-        if (debug.addr[addr] & DBG_MASK_READ) {
+        if (unlikely(debug.active) && debug.addr[addr] & DBG_MASK_READ) {
             debug_open(DBG_WATCHPOINT_READ, addr);
         }
     }
 #endif
+    if (likely(ptr = page_read[addr >> MEM_PAGE_BITS])) {
+        if (addr >= 0xD00000) {
+            sched_process_pending_dma(4);
+            value = ptr[addr & (MEM_PAGE_SIZE - 1)];
+            if (fetch) {
+                mem_fetched(value);
+            }
+            return value;
+        }
+        if (likely(mem.flash.command == FLASH_NO_COMMAND)) {
+            cpu.cycles += flash.waitStates;
+            value = ptr[addr & (MEM_PAGE_SIZE - 1)];
+            if (fetch) {
+                if (detect_flash_unlock_sequence(value)) {
+                    control.flashUnlocked |= 1 << 3;
+                }
+                mem_fetched(value);
+            }
+            return value;
+        }
+    }
     switch((addr >> 20) & 0xF) {
         /* FLASH */
         case 0x0: case 0x1: case 0x2: case 0x3:
         case 0x4: case 0x5: case 0x6: case 0x7:
+            cpu_idle_break();
             value = mem_read_flash(addr);
             if (fetch && detect_flash_unlock_sequence(value)) {
                 control.flashUnlocked |= 1 << 3;
@@ -638,6 +905,7 @@ uint8_t mem_read_cpu(uint32_t addr, bool fetch) {
 
         /* UNMAPPED */
         case 0x8: case 0x9: case 0xA: case 0xB: case 0xC:
+            cpu_idle_break();
             value = mem_read_unmapped_other(true);
             cpu.cycles += 258;
             break;
@@ -649,6 +917,7 @@ uint8_t mem_read_cpu(uint32_t addr, bool fetch) {
             if (ramAddr < 0x65800) {
                 value = mem.ram.block[ramAddr];
             } else {
+                cpu_idle_break();
                 value = mem_read_unmapped_ram(true);
             }
             break;
@@ -667,10 +936,7 @@ uint8_t mem_read_cpu(uint32_t addr, bool fetch) {
             break;
     }
     if (fetch) {
-        mem.buffer[++mem.fetch] = value;
-        if (unprivileged_code()) {
-            control.flashUnlocked &= ~(1 << 3);
-        }
+        mem_fetched(value);
     } else if (addr >= control.protectedStart && addr <= control.protectedEnd && unprivileged_code()) {
         value = 0; /* reads from protected memory return 0 */
     }
@@ -679,14 +945,23 @@ uint8_t mem_read_cpu(uint32_t addr, bool fetch) {
 
 void mem_write_cpu(uint32_t addr, uint8_t value) {
     uint32_t ramAddr, select;
+    uint8_t *ptr;
     addr &= 0xFFFFFF;
 
 #ifdef DEBUG_SUPPORT
-    if ((debug.addr[addr] &= ~(DBG_INST_START_MARKER | DBG_INST_MARKER)) & DBG_MASK_WRITE) {
+    if ((debug.addr[addr] &= ~(DBG_INST_START_MARKER | DBG_INST_MARKER)) & DBG_MASK_WRITE && unlikely(debug.active)) {
         debug_open(DBG_WATCHPOINT_WRITE, addr);
     }
 #endif
 
+    if (likely(ptr = page_write[addr >> MEM_PAGE_BITS])) {
+        sched_process_pending_dma(2);
+        ptr[addr & (MEM_PAGE_SIZE - 1)] = value;
+        base.dirty[MEM_FLASH_PAGES + ((addr & 0x7FFFF) >> MEM_PAGE_BITS)] = MEM_DIRTY_ALL;
+        cpu_cache_invalidate(0xD00000 | (addr & 0x7FFFF), 1);
+        return;
+    }
+
     if (addr == control.stackLimit) {
         control.protectionStatus |= 1;
         gui_console_printf("[CEmu] NMI reset caused by writing to the stack limit at address %#06x. Hint: Probably a stack overflow (aka too much recursion).\n", addr);
@@ -722,6 +997,8 @@ void mem_write_cpu(uint32_t addr, uint8_t value) {
                 ramAddr = addr & 0x7FFFF;
                 if (ramAddr < 0x65800) {
                     mem.ram.block[ramAddr] = value;
+                    base.dirty[MEM_FLASH_PAGES + (ramAddr >> MEM_PAGE_BITS)] = MEM_DIRTY_ALL;
+                    cpu_cache_invalidate(0xD00000 | ramAddr, 1);
                 }
                 break;
 
@@ -814,6 +1091,7 @@ void mem_poke_byte(uint32_t addr, uint8_t value) {
         uint8_t *ptr;
         if ((ptr = phys_mem_ptr(addr, 1))) {
             *ptr = value;
+            mem_invalidate_ptr(ptr, 1);
         }
     } else if (mmio_mapped(addr, select)) {
         port_poke_byte(mmio_port(addr, select), value);
@@ -838,7 +1116,7 @@ void mem_poke_word(uint32_t addr, uint32_t value, bool mode) {
 }
 
 uint8_t mem_read_unmapped_ram(bool update) {
-    static uint8_t value = 0;
+    static EMU_LOCAL uint8_t value = 0;
     if (update) {
         value = bus_rand();
     }
@@ -846,7 +1124,7 @@ uint8_t mem_read_unmapped_ram(bool update) {
 }
 
 uint8_t mem_read_unmapped_flash(bool update) {
-    static uint8_t value = 0;
+    static EMU_LOCAL uint8_t value = 0;
     if (update) {
         value = bus_rand();
     }
@@ -854,25 +1132,131 @@ uint8_t mem_read_unmapped_flash(bool update) {
 }
 
 uint8_t mem_read_unmapped_other(bool update) {
-    static uint8_t value = 0;
+    static EMU_LOCAL uint8_t value = 0;
     if (update) {
         value = bus_rand();
     }
     return value;
 }
 
-bool mem_save(FILE *image) {
+bool mem_set_base(void) {
+    uint32_t page;
+
     assert(mem.flash.block);
     assert(mem.ram.block);
 
-    return fwrite(&mem, sizeof(mem), 1, image) == 1 &&
-           fwrite(mem.flash.block, SIZE_FLASH, 1, image) == 1 &&
-           fwrite(mem.ram.block, SIZE_RAM, 1, image) == 1;
+    if (!base.flash) {
+        base.flash = (uint8_t*)malloc(SIZE_FLASH);
+        base.ram = (uint8_t*)malloc(SIZE_RAM);
+        if (!base.flash || !base.ram) {
+            free(base.flash);
+            base.flash = NULL;
+            free(base.ram);
+            base.ram = NULL;
+            return false;
+        }
+    }
+
+    memcpy(base.flash, mem.flash.block, SIZE_FLASH);
+    memcpy(base.ram, mem.ram.block, SIZE_RAM);
+    for (page = 0; page < MEM_DIRTY_PAGES; page++) {
+        base.dirty[page] &= ~MEM_DIRTY_BASE;
+    }
+    base.serial++;
+    return true;
+}
+
+uint32_t mem_base_serial(void) {
+    return base.flash ? base.serial : 0;
 }
 
-bool mem_restore(FILE *image) {
+static bool mem_save_delta(image_t *image) {
+    uint8_t dirty[MEM_DIRTY_PAGES];
+    uint32_t page, size;
+    uint8_t *ptr;
+
+    for (page = 0; page < MEM_DIRTY_PAGES; page++) {
+        dirty[page] = base.dirty[page] & MEM_DIRTY_BASE;
+    }
+    if (!image_write(image, dirty, sizeof(dirty))) {
+        return false;
+    }
+    for (page = 0; page < MEM_DIRTY_PAGES; page++) {
+        if (dirty[page]) {
+            ptr = mem_dirty_page(page, mem.flash.block, mem.ram.block, &size);
+            if (!image_write(image, ptr, size)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static bool mem_restore_delta(image_t *image) {
+    uint8_t dirty[MEM_DIRTY_PAGES];
+    uint32_t page, size;
+    uint8_t *ptr;
+
+    if (!base.flash || !image_read(image, dirty, sizeof(dirty))) {
+        return false;
+    }
+    /* pages written since the base either come from the delta or go back to the base */
+    for (page = 0; page < MEM_DIRTY_PAGES; page++) {
+        ptr = mem_dirty_page(page, mem.flash.block, mem.ram.block, &size);
+        if (dirty[page]) {
+            if (!image_read(image, ptr, size)) {
+                return false;
+            }
+            base.dirty[page] = MEM_DIRTY_ALL;
+        } else if (base.dirty[page] & MEM_DIRTY_BASE) {
+            memcpy(ptr, mem_dirty_page(page, base.flash, base.ram, &size), size);
+            base.dirty[page] = MEM_DIRTY_ALL & ~MEM_DIRTY_BASE;
+        }
+    }
+    return true;
+}
+
+bool mem_save(image_t *image) {
+    assert(mem.flash.block);
+    assert(mem.ram.block);
+
+    if (image->delta) {
+        return image_write(image, &mem, sizeof(mem)) &&
+               mem_save_delta(image);
+    }
+
+    return image_write(image, &mem, sizeof(mem)) &&
+           image_write_chunk(image, IMAGE_TAG_FLASH, MEM_IMAGE_VERSION) &&
+           image_write(image, mem.flash.block, SIZE_FLASH) &&
+           image_write_chunk(image, IMAGE_TAG_RAM, MEM_IMAGE_VERSION) &&
+           image_write(image, mem.ram.block, SIZE_RAM);
+}
+
+/* write only the pages that differ, so a shared flash mapping keeps the rest */
+static bool mem_restore_flash(image_t *image) {
+    uint8_t page[MEM_PAGE_SIZE];
+    uint32_t addr;
+
+    /* already mapped from the image being loaded */
+    if (image->mapped && image->tag == image->mapped) {
+        return true;
+    }
+    if (!flash_shared) {
+        return image_read(image, mem.flash.block, SIZE_FLASH);
+    }
+    for (addr = 0; addr < SIZE_FLASH; addr += MEM_PAGE_SIZE) {
+        if (!image_read(image, page, MEM_PAGE_SIZE)) {
+            return false;
+        }
+        if (memcmp(mem.flash.block + addr, page, MEM_PAGE_SIZE)) {
+            memcpy(mem.flash.block + addr, page, MEM_PAGE_SIZE);
+        }
+    }
+    return true;
+}
+
+bool mem_restore(image_t *image) {
     bool ret = false;
-    unsigned int i;
     uint8_t *tmp_flash_ptr;
     uint8_t *tmp_ram_ptr;
 
@@ -882,20 +1266,23 @@ bool mem_restore(FILE *image) {
     tmp_flash_ptr = mem.flash.block;
     tmp_ram_ptr = mem.ram.block;
 
-    ret |= fread(&mem, sizeof(mem), 1, image) == 1;
+    ret |= image_read(image, &mem, sizeof(mem));
 
-    mem.flash.block = tmp_flash_ptr;
+    mem_set_flash_block(tmp_flash_ptr);
     mem.ram.block = tmp_ram_ptr;
 
-    ret |= fread(mem.flash.block, SIZE_FLASH, 1, image) == 1 &&
-           fread(mem.ram.block, SIZE_RAM, 1, image) == 1;
-
-    for (i = 0; i < 8; i++) {
-        mem.flash.sector[i].ptr = &mem.flash.block[i*SIZE_FLASH_SECTOR_8K];
-    }
-    for (i = 0; i < 64; i++) {
-        mem.flash.sector[i].ptr = &mem.flash.block[i*SIZE_FLASH_SECTOR_64K];
+    if (image->delta) {
+        ret = ret && mem_restore_delta(image);
+    } else {
+        ret = ret &&
+              image_read_chunk(image, IMAGE_TAG_FLASH, MEM_IMAGE_VERSION) &&
+              mem_restore_flash(image) &&
+              image_read_chunk(image, IMAGE_TAG_RAM, MEM_IMAGE_VERSION) &&
+              image_read(image, mem.ram.block, SIZE_RAM);
+        memset(base.dirty, MEM_DIRTY_ALL, sizeof(base.dirty));
     }
 
+    mem_update_pages();
+
     return ret;
 }
@@ -5,6 +5,8 @@
 extern "C" {
 #endif
 
+#include "image.h"
+#include "defines.h"
 #include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
@@ -15,6 +17,8 @@ extern "C" {
 #define SIZE_FLASH_SECTOR_64K 0x10000
 #define NUM_SECTORS 64
 #define NUM_8K_SECTORS 8
+#define MEM_PAGE_BITS 12
+#define MEM_PAGE_SIZE (1 << MEM_PAGE_BITS)
 
 enum flash_commands {
     FLASH_NO_COMMAND,
@@ -63,15 +67,29 @@ typedef struct mem_state {
     uint8_t fetch : 4, buffer[1 << 4];
 } mem_state_t;
 
-extern mem_state_t mem;
+extern EMU_LOCAL mem_state_t mem;
 
 void mem_init(void);
 void mem_free(void);
 void mem_reset(void);
-bool mem_restore(FILE *image);
-bool mem_save(FILE *image);
+bool mem_restore(image_t *image);
+bool mem_save(image_t *image);
+bool mem_set_base(void);   /* copy memory as the base for delta images and track pages written after it */
+uint32_t mem_base_serial(void);   /* changes every time the base is set, 0 if there is none */
+bool mem_share_flash(FILE *file, size_t offset);   /* call before mem_init to map flash from a rom or image file, pages are copied only once written */
+/* Shared flash reads through to the rom or image file it was loaded from, which must not be
+ * truncated or rewritten meanwhile; files that others may write are read instead */
+bool mem_unshare_flash(void);   /* give flash a private copy, needed before the mapped file is overwritten */
+bool mem_flash_shared(void);   /* true while flash is mapped from a file */
+bool mem_flash_mapped_from(const char *path);   /* true if writing path would change the file flash is mapped from, or that can't be told */
+void mem_update_pages(void);   /* call when flash mapping or protection settings change */
+void mem_update_page_range(uint32_t start, uint32_t end);   /* same, for settings that only affect addresses start..end */
+uint8_t *mem_page_ptr(uint32_t addr, bool write);   /* host pointer for plain accesses up to the end of the page, or NULL */
 
 void *phys_mem_ptr(uint32_t addr, int32_t size);
+void mem_invalidate_ptr(const void *ptr, uint32_t size);   /* call after writing through phys_mem_ptr */
+bool mem_written(uint32_t addr, uint32_t size);   /* true if the physical range may have changed since the last call, clears its pages */
+bool mem_lcd_written(uint32_t addr, uint32_t size);   /* same as mem_written, but tracked separately for lcd damage */
 void *virt_mem_cpy(void *buf, uint32_t addr, int32_t size);
 void *virt_mem_dup(uint32_t addr, int32_t size);
 void *mem_dma_cpy(void *buf, uint32_t addr, int32_t size);
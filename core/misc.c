@@ -10,11 +10,11 @@
 #include <string.h>
 #include <stdio.h>
 
-watchdog_state_t watchdog;
-protected_state_t protect;
-cxxx_state_t cxxx; /* Global CXXX state */
-exxx_state_t exxx; /* Global EXXX state */
-fxxx_state_t fxxx; /* Global FXXX state */
+EMU_LOCAL watchdog_state_t watchdog;
+EMU_LOCAL protected_state_t protect;
+EMU_LOCAL cxxx_state_t cxxx; /* Global CXXX state */
+EMU_LOCAL exxx_state_t exxx; /* Global EXXX state */
+EMU_LOCAL fxxx_state_t fxxx; /* Global FXXX state */
 
 static void watchdog_event(enum sched_item_id id) {
 
@@ -140,12 +140,12 @@ eZ80portrange_t init_watchdog(void) {
     return pwatchdog;
 }
 
-bool watchdog_save(FILE *image) {
-    return fwrite(&watchdog, sizeof(watchdog), 1, image) == 1;
+bool watchdog_save(image_t *image) {
+    return image_write(image, &watchdog, sizeof(watchdog));
 }
 
-bool watchdog_restore(FILE *image) {
-    return fread(&watchdog, sizeof(watchdog), 1, image) == 1;
+bool watchdog_restore(image_t *image) {
+    return image_read(image, &watchdog, sizeof(watchdog));
 }
 
 /* ============================================= */
@@ -192,12 +192,12 @@ eZ80portrange_t init_protected(void) {
     return p9xxx;
 }
 
-bool protect_save(FILE *image) {
-    return fwrite(&protect, sizeof(protect), 1, image) == 1;
+bool protect_save(image_t *image) {
+    return image_write(image, &protect, sizeof(protect));
 }
 
-bool protect_restore(FILE *image) {
-    return fread(&protect, sizeof(protect), 1, image) == 1;
+bool protect_restore(image_t *image) {
+    return image_read(image, &protect, sizeof(protect));
 }
 
 /* ============================================= */
@@ -224,12 +224,12 @@ eZ80portrange_t init_cxxx(void) {
     return pcxxx;
 }
 
-bool cxxx_save(FILE *image) {
-    return fwrite(&cxxx, sizeof(cxxx), 1, image) == 1;
+bool cxxx_save(image_t *image) {
+    return image_write(image, &cxxx, sizeof(cxxx));
 }
 
-bool cxxx_restore(FILE *image) {
-    return fread(&cxxx, sizeof(cxxx), 1, image) == 1;
+bool cxxx_restore(image_t *image) {
+    return image_read(image, &cxxx, sizeof(cxxx));
 }
 
 /* ============================================= */
@@ -267,12 +267,12 @@ eZ80portrange_t init_exxx(void) {
     return pexxx;
 }
 
-bool exxx_save(FILE *image) {
-    return fwrite(&exxx, sizeof(exxx), 1, image) == 1;
+bool exxx_save(image_t *image) {
+    return image_write(image, &exxx, sizeof(exxx));
 }
 
-bool exxx_restore(FILE *image) {
-    return fread(&exxx, sizeof(exxx), 1, image) == 1;
+bool exxx_restore(image_t *image) {
+    return image_read(image, &exxx, sizeof(exxx));
 }
 
 /* ============================================= */
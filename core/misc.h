@@ -5,6 +5,7 @@
 extern "C" {
 #endif
 
+#include "image.h"
 #include "port.h"
 
 #include <stdio.h>
@@ -37,11 +38,11 @@ typedef struct fxxx_state {
     uint8_t dummy;
 } fxxx_state_t;
 
-extern watchdog_state_t watchdog;
-extern protected_state_t protect;
-extern cxxx_state_t cxxx;
-extern exxx_state_t exxx;
-extern fxxx_state_t fxxx;
+extern EMU_LOCAL watchdog_state_t watchdog;
+extern EMU_LOCAL protected_state_t protect;
+extern EMU_LOCAL cxxx_state_t cxxx;
+extern EMU_LOCAL exxx_state_t exxx;
+extern EMU_LOCAL fxxx_state_t fxxx;
 
 eZ80portrange_t init_watchdog(void);
 eZ80portrange_t init_protected(void);
@@ -49,14 +50,14 @@ eZ80portrange_t init_cxxx(void);
 eZ80portrange_t init_exxx(void);
 eZ80portrange_t init_fxxx(void);
 void watchdog_reset(void);
-bool watchdog_restore(FILE *image);
-bool watchdog_save(FILE *image);
-bool protect_restore(FILE *image);
-bool protect_save(FILE *image);
-bool cxxx_restore(FILE *image);
-bool cxxx_save(FILE *image);
-bool exxx_restore(FILE *image);
-bool exxx_save(FILE *image);
+bool watchdog_restore(image_t *image);
+bool watchdog_save(image_t *image);
+bool protect_restore(image_t *image);
+bool protect_save(image_t *image);
+bool cxxx_restore(image_t *image);
+bool cxxx_save(image_t *image);
+bool exxx_restore(image_t *image);
+bool exxx_save(image_t *image);
 
 #ifdef __cplusplus
 }
@@ -21,7 +21,7 @@
 
 #include <time.h>
 
-static char file_buf[500] = {0};
+static EMU_LOCAL char file_buf[500] = {0};
 
 static bool transfer_progress_cb(void *context, int value, int total) {
     (void)context;
@@ -81,6 +81,44 @@ FILE *fopen_utf8(const char *filename, const char *mode) {
     return fopen(filename, mode);
 }
 
+void *os_map_private(FILE *file, size_t offset, size_t size) {
+    (void)file;
+    (void)offset;
+    (void)size;
+    return NULL;
+}
+
+void os_unmap(void *ptr, size_t size) {
+    (void)ptr;
+    (void)size;
+}
+
+bool os_file_id(FILE *file, os_file_id_t *id) {
+    (void)file;
+    (void)id;
+    return false;
+}
+
+bool os_path_id(const char *path, os_file_id_t *id) {
+    (void)path;
+    (void)id;
+    return false;
+}
+
+void *os_alloc_exec(size_t size) {
+    (void)size;
+    return NULL;
+}
+
+void os_free_exec(void *ptr, size_t size) {
+    (void)ptr;
+    (void)size;
+}
+
+bool os_sync(FILE *file) {
+    return !fflush(file);
+}
+
 void EMSCRIPTEN_KEEPALIVE set_file_to_send(const char* path) {
     strcpy(file_buf, path);
 }
@@ -1,7 +1,73 @@
 #include "os.h"
 #include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 FILE *fopen_utf8(const char *filename, const char *mode)
 {
     return fopen(filename, mode);
 }
+
+void *os_map_private(FILE *file, size_t offset, size_t size)
+{
+    struct stat info;
+    void *ptr;
+    int fd = fileno(file);
+
+    if (fd < 0 || fstat(fd, &info) || info.st_size < (off_t)offset || info.st_size - (off_t)offset < (off_t)size) {
+        return NULL;
+    }
+    /* pages not yet written still come from the file, so leave files that others may change to be read */
+    if (!S_ISREG(info.st_mode) || info.st_mode & (S_IWGRP | S_IWOTH)) {
+        return NULL;
+    }
+    ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, (off_t)offset);
+    return ptr == MAP_FAILED ? NULL : ptr;
+}
+
+void os_unmap(void *ptr, size_t size)
+{
+    munmap(ptr, size);
+}
+
+bool os_file_id(FILE *file, os_file_id_t *id)
+{
+    struct stat info;
+    int fd = fileno(file);
+
+    if (fd < 0 || fstat(fd, &info)) {
+        return false;
+    }
+    id->device = (uint64_t)info.st_dev;
+    id->index = (uint64_t)info.st_ino;
+    return true;
+}
+
+bool os_path_id(const char *path, os_file_id_t *id)
+{
+    struct stat info;
+
+    if (stat(path, &info)) {
+        return false;
+    }
+    id->device = (uint64_t)info.st_dev;
+    id->index = (uint64_t)info.st_ino;
+    return true;
+}
+
+void *os_alloc_exec(size_t size)
+{
+    void *ptr = mmap(NULL, size, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return ptr == MAP_FAILED ? NULL : ptr;
+}
+
+void os_free_exec(void *ptr, size_t size)
+{
+    munmap(ptr, size);
+}
+
+bool os_sync(FILE *file)
+{
+    return !fflush(file) && !fsync(fileno(file));
+}
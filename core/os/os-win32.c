@@ -2,6 +2,8 @@
 #include "os.h"
 #include <stdio.h>
 #include <windows.h>
+#include <aclapi.h>
+#include <io.h>
 
 FILE *fopen_utf8(const char *filename, const char *mode)
 {
@@ -12,4 +14,118 @@ FILE *fopen_utf8(const char *filename, const char *mode)
     return _wfopen(filename_w, mode_w);
 }
 
+/* true unless only the owner, administrators and the system may write the file */
+static bool os_writable_by_others(HANDLE handle)
+{
+    static const WELL_KNOWN_SID_TYPE others[] = { WinWorldSid, WinAuthenticatedUserSid, WinBuiltinUsersSid };
+    PSECURITY_DESCRIPTOR descriptor;
+    PACL dacl;
+    bool writable = false;
+    size_t i;
+
+    if (GetSecurityInfo(handle, SE_FILE_OBJECT, DACL_SECURITY_INFORMATION, NULL, NULL, &dacl, NULL, &descriptor) != ERROR_SUCCESS) {
+        return true;
+    }
+    /* no dacl at all grants everyone full access */
+    if (!dacl) {
+        writable = true;
+    }
+    for (i = 0; i < sizeof(others) / sizeof(others[0]) && !writable; i++) {
+        BYTE sid[SECURITY_MAX_SID_SIZE];
+        DWORD sid_size = sizeof(sid);
+        TRUSTEE_W trustee;
+        ACCESS_MASK rights;
+
+        if (!CreateWellKnownSid(others[i], NULL, sid, &sid_size)) {
+            writable = true;
+            break;
+        }
+        BuildTrusteeWithSidW(&trustee, sid);
+        writable = GetEffectiveRightsFromAclW(dacl, &trustee, &rights) != ERROR_SUCCESS ||
+                   rights & (FILE_WRITE_DATA | FILE_APPEND_DATA);
+    }
+    LocalFree(descriptor);
+    return writable;
+}
+
+void *os_map_private(FILE *file, size_t offset, size_t size)
+{
+    HANDLE handle = (HANDLE)_get_osfhandle(_fileno(file));
+    LARGE_INTEGER file_size;
+    HANDLE mapping;
+    void *ptr;
+
+    if (handle == INVALID_HANDLE_VALUE || !GetFileSizeEx(handle, &file_size) || file_size.QuadPart < (LONGLONG)offset || file_size.QuadPart - (LONGLONG)offset < (LONGLONG)size) {
+        return NULL;
+    }
+    /* pages not yet written still come from the file, so leave files that others may change to be read */
+    if (GetFileType(handle) != FILE_TYPE_DISK || os_writable_by_others(handle)) {
+        return NULL;
+    }
+    mapping = CreateFileMappingW(handle, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    if (!mapping) {
+        return NULL;
+    }
+    ptr = MapViewOfFile(mapping, FILE_MAP_COPY, (DWORD)((uint64_t)offset >> 32), (DWORD)offset, size);
+    CloseHandle(mapping);
+    return ptr;
+}
+
+void os_unmap(void *ptr, size_t size)
+{
+    (void)size;
+    UnmapViewOfFile(ptr);
+}
+
+static bool os_handle_id(HANDLE handle, os_file_id_t *id)
+{
+    BY_HANDLE_FILE_INFORMATION info;
+
+    if (handle == INVALID_HANDLE_VALUE || !GetFileInformationByHandle(handle, &info)) {
+        return false;
+    }
+    id->device = info.dwVolumeSerialNumber;
+    id->index = (uint64_t)info.nFileIndexHigh << 32 | info.nFileIndexLow;
+    return true;
+}
+
+bool os_file_id(FILE *file, os_file_id_t *id)
+{
+    return os_handle_id((HANDLE)_get_osfhandle(_fileno(file)), id);
+}
+
+bool os_path_id(const char *path, os_file_id_t *id)
+{
+    wchar_t path_w[MAX_PATH];
+    HANDLE handle;
+    bool success;
+
+    if (!MultiByteToWideChar(CP_UTF8, 0, path, -1, path_w, MAX_PATH)) {
+        return false;
+    }
+    handle = CreateFileW(path_w, 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+                         OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL);
+    success = os_handle_id(handle, id);
+    if (handle != INVALID_HANDLE_VALUE) {
+        CloseHandle(handle);
+    }
+    return success;
+}
+
+void *os_alloc_exec(size_t size)
+{
+    return VirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+}
+
+void os_free_exec(void *ptr, size_t size)
+{
+    (void)size;
+    VirtualFree(ptr, 0, MEM_RELEASE);
+}
+
+bool os_sync(FILE *file)
+{
+    return !fflush(file) && FlushFileBuffers((HANDLE)_get_osfhandle(_fileno(file)));
+}
+
 #endif
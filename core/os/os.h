@@ -8,10 +8,35 @@ extern "C" {
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdbool.h>
 
 /* Some really crappy APIs don't use UTF-8 in fopen. */
 FILE *fopen_utf8(const char *filename, const char *mode);
 
+/* Map part of a file copy-on-write, so pages stay shared until written. */
+/* The offset has to be a multiple of 64 KiB. */
+/* Returns NULL if the file is too small or mapping is not supported. */
+/* Until a page is written it reads from the file, so the file must not be truncated */
+/* (that faults with SIGBUS) or rewritten while mapped, see mem_unshare_flash. */
+void *os_map_private(FILE *file, size_t offset, size_t size);
+void os_unmap(void *ptr, size_t size);
+
+/* Tells whether a path names a file that is already open, such as one that is mapped. */
+/* Both return false if the file doesn't exist or can't be identified. */
+typedef struct os_file_id {
+    uint64_t device, index;
+} os_file_id_t;
+bool os_file_id(FILE *file, os_file_id_t *id);
+bool os_path_id(const char *path, os_file_id_t *id);
+
+/* Memory the recompiler can write code to and run it from. */
+/* Returns NULL if that is not allowed. */
+void *os_alloc_exec(size_t size);
+void os_free_exec(void *ptr, size_t size);
+
+/* Flush a file all the way to the disk. */
+bool os_sync(FILE *file);
+
 #ifdef __cplusplus
 }
 #endif
@@ -6,8 +6,12 @@
 #define PORT_READ_DELAY  2
 #define PORT_WRITE_DELAY 4
 
+/* Port ranges whose reads have no side effects and only change on scheduled events:
+ * control, flash, lcd, interrupts, rtc, keypad and backlight */
+static const uint16_t port_pure_reads = 1 << 0x0 | 1 << 0x1 | 1 << 0x4 | 1 << 0x5 | 1 << 0x8 | 1 << 0xA | 1 << 0xB;
+
 /* Global APB state */
-eZ80portrange_t port_map[0x10];
+EMU_LOCAL eZ80portrange_t port_map[0x10];
 
 #define port_range(a) (((a)>>12)&0xF) /* converts an address to a port range 0x0-0xF */
 
@@ -25,11 +29,15 @@ uint8_t port_read_byte(uint16_t address) {
     static const uint8_t port_read_cycles[0x10] = {2,2,2,4,3,3,3,3,3,3,3,3,3,3,3,3};
 
 #ifdef DEBUG_SUPPORT
-    if (debug.port[address] & DBG_MASK_PORT_READ) {
+    if (unlikely(debug.active) && debug.port[address] & DBG_MASK_PORT_READ) {
         debug_open(DBG_PORT_READ, address);
     }
 #endif
 
+    if (!(port_pure_reads >> port_loc & 1)) {
+        cpu_idle_break();
+    }
+
     cpu.cycles += PORT_READ_DELAY;
     sched_process_pending_events(); /* make io ports consistent with mid-instruction state */
     value = port_read(address, port_loc, false);
@@ -48,7 +56,7 @@ void port_write_byte(uint16_t address, uint8_t value) {
     static const uint8_t port_write_cycles[0x10] = {2,2,2,4,2,3,3,3,3,3,3,3,3,3,3,3};
 
 #ifdef DEBUG_SUPPORT
-    if (debug.port[address] & (DBG_MASK_PORT_FREEZE | DBG_MASK_PORT_WRITE)) {
+    if (unlikely(debug.active) && debug.port[address] & (DBG_MASK_PORT_FREEZE | DBG_MASK_PORT_WRITE)) {
         if (debug.port[address] & DBG_MASK_PORT_WRITE) {
             debug_open(DBG_PORT_WRITE, address);
         }
@@ -58,6 +66,7 @@ void port_write_byte(uint16_t address, uint8_t value) {
     }
 #endif
 
+    cpu_idle_break();
     cpu.cycles += PORT_WRITE_DELAY;
     sched_process_pending_events(); /* make io ports consistent with mid-instruction state */
     port_write(address, port_loc, value, false);
@@ -7,7 +7,7 @@
 #include <stdio.h>
 
 /* Global GPT state */
-rtc_state_t rtc;
+EMU_LOCAL rtc_state_t rtc;
 
 static void rtc_event(enum sched_item_id id) {
     /* Update exactly once a second */
@@ -195,10 +195,10 @@ eZ80portrange_t init_rtc(void) {
     return device;
 }
 
-bool rtc_save(FILE *image) {
-    return fwrite(&rtc, sizeof(rtc), 1, image) == 1;
+bool rtc_save(image_t *image) {
+    return image_write(image, &rtc, sizeof(rtc));
 }
 
-bool rtc_restore(FILE *image) {
-    return fread(&rtc, sizeof(rtc), 1, image) == 1;
+bool rtc_restore(image_t *image) {
+    return image_read(image, &rtc, sizeof(rtc));
 }
@@ -5,6 +5,7 @@
 extern "C" {
 #endif
 
+#include "image.h"
 #include "port.h"
 #include <stdint.h>
 #include <stdbool.h>
@@ -32,12 +33,12 @@ typedef struct rtc_state {
     uint32_t revision;
 } rtc_state_t;
 
-extern rtc_state_t rtc;
+extern EMU_LOCAL rtc_state_t rtc;
 
 eZ80portrange_t init_rtc(void);
 void rtc_reset(void);
-bool rtc_restore(FILE *image);
-bool rtc_save(FILE *image);
+bool rtc_restore(image_t *image);
+bool rtc_save(image_t *image);
 
 #ifdef __cplusplus
 }
@@ -21,7 +21,13 @@
 #include <string.h>
 #include <stdio.h>
 
-sched_state_t sched;
+EMU_LOCAL sched_state_t sched;
+
+/* integer ratios between each clock and the cpu clock, 0 when the rates don't divide evenly */
+static EMU_LOCAL struct sched_ratio {
+    uint32_t up;   /* cpu cycles per tick */
+    uint32_t down; /* ticks per cpu cycle */
+} ratios[CLOCK_NUM_ITEMS];
 
 static uint32_t muldiv_floor(uint32_t a, uint32_t b, uint32_t c) {
     if (likely(b == c)) return a;
@@ -32,6 +38,40 @@ static uint32_t muldiv_ceil(uint32_t a, uint32_t b, uint32_t c) {
     return ((uint64_t)a * b + c - 1) / c;
 }
 
+static void sched_update_ratios(void) {
+    uint32_t cpu_rate = sched.clockRates[CLOCK_CPU];
+    enum clock_id clock;
+    for (clock = CLOCK_CPU; clock < CLOCK_NUM_ITEMS; clock++) {
+        uint32_t rate = sched.clockRates[clock];
+        ratios[clock].up = rate && cpu_rate % rate == 0 ? cpu_rate / rate : 0;
+        ratios[clock].down = cpu_rate && rate % cpu_rate == 0 ? rate / cpu_rate : 0;
+    }
+}
+
+/* same as muldiv_ceil(ticks, cpu rate, clock rate) */
+static uint32_t sched_ticks_to_cycles(enum clock_id clock, uint32_t ticks) {
+    const struct sched_ratio *ratio = &ratios[clock];
+    if (likely(ratio->up)) {
+        return ticks * ratio->up;
+    }
+    if (ratio->down) {
+        return (ticks + ratio->down - 1) / ratio->down;
+    }
+    return muldiv_ceil(ticks, sched.clockRates[CLOCK_CPU], sched.clockRates[clock]);
+}
+
+/* same as muldiv_floor(cycles, clock rate, cpu rate) */
+static uint32_t sched_cycles_to_ticks(enum clock_id clock, uint32_t cycles) {
+    const struct sched_ratio *ratio = &ratios[clock];
+    if (likely(ratio->down)) {
+        return cycles * ratio->down;
+    }
+    if (ratio->up) {
+        return cycles / ratio->up;
+    }
+    return muldiv_floor(cycles, sched.clockRates[clock], sched.clockRates[CLOCK_CPU]);
+}
+
 void sched_run_event(enum sched_item_id id) {
     (void)id;
     sched.run_event_triggered = true;
@@ -44,6 +84,14 @@ uint32_t sched_event_next_cycle(void) {
     return sched.event.cycle ? sched.event.cycle : sched.items[next].cycle;
 }
 
+uint32_t sched_dma_next_cycle(void) {
+    enum sched_item_id next = sched.dma.next;
+    if (next == SCHED_PREV_MA || sched.items[next].second) {
+        return UINT32_MAX;
+    }
+    return sched.items[next].cycle;
+}
+
 static void sched_update_next(enum sched_item_id id) {
     sched.event.next = id;
     cpu_restore_next();
@@ -54,38 +102,58 @@ static bool sched_before(enum sched_item_id a_id, enum sched_item_id b_id) {
     return a->second <= b->second && a->cycle < b->cycle;
 }
 
-static void sched_update(enum sched_item_id id) {
+static void sched_update_event(enum sched_item_id id) {
     struct sched_item *item = &sched.items[id];
+    if (item->callback.event && !item->second &&
+        item->cycle < sched_event_next_cycle()) {
+        sched_update_next(id);
+    }
+}
+
+static void sched_update_dma(enum sched_item_id id) {
+    struct sched_item *item = &sched.items[id];
+    if (item->callback.dma && item->second >= 0 &&
+        (sched.dma.next == SCHED_PREV_MA || sched_before(id, sched.dma.next))) {
+        sched.dma.next = id;
+    }
+}
+
+static void sched_update(enum sched_item_id id) {
     if (id == SCHED_SECOND) {
         sched_update_next(id);
         for (id = SCHED_FIRST_EVENT; id <= SCHED_LAST_EVENT; id++) {
-            sched_update(id);
+            sched_update_event(id);
         }
     } else if (id >= SCHED_FIRST_EVENT && id <= SCHED_LAST_EVENT) {
-        if (item->callback.event && !item->second &&
-            item->cycle < sched_event_next_cycle()) {
-            sched_update_next(id);
-        }
+        sched_update_event(id);
     } else if (id == SCHED_PREV_MA) {
         sched.dma.next = id;
         for (id = SCHED_FIRST_DMA; id <= SCHED_LAST_DMA; id++) {
-            sched_update(id);
+            sched_update_dma(id);
         }
     } else if (id >= SCHED_FIRST_DMA && id <= SCHED_LAST_DMA) {
-        if (item->callback.dma && sched_active(id) &&
-            (sched.dma.next == SCHED_PREV_MA || sched_before(id, sched.dma.next))) {
-            sched.dma.next = id;
-        }
+        sched_update_dma(id);
     }
 }
 
 static void sched_schedule(enum sched_item_id id, int32_t seconds, uint64_t ticks) {
     struct sched_item *item = &sched.items[id];
-    item->second = seconds + ticks / sched.clockRates[item->clock];
-    item->tick = ticks % sched.clockRates[item->clock];
-    item->cycle = muldiv_ceil(item->tick, sched.clockRates[CLOCK_CPU], sched.clockRates[item->clock]);
+    uint32_t rate = sched.clockRates[item->clock];
+    if (likely(ticks < rate)) {
+        item->second = seconds;
+        item->tick = ticks;
+    } else {
+        item->second = seconds + ticks / rate;
+        item->tick = ticks % rate;
+    }
+    item->cycle = sched_ticks_to_cycles(item->clock, item->tick);
     if (id == sched.event.next) {
         sched_update(SCHED_SECOND);
+    } else if (id == SCHED_PREV_MA) {
+        /* when no dma is pending there is nothing to rescan, the previous access never orders before dma */
+        if (sched.dma.next != SCHED_PREV_MA) {
+            sched_update(SCHED_PREV_MA);
+        }
     } else if (id == sched.dma.next) {
         sched_update(SCHED_PREV_MA);
     } else {
@@ -103,7 +171,7 @@ void sched_repeat(enum sched_item_id id, uint64_t ticks) {
 }
 
 void sched_set(enum sched_item_id id, uint64_t ticks) {
-    sched_schedule(id, 0, muldiv_floor(cpu.cycles, sched.clockRates[sched.items[id].clock], sched.clockRates[CLOCK_CPU]) + ticks);
+    sched_schedule(id, 0, sched_cycles_to_ticks(sched.items[id].clock, cpu.cycles) + ticks);
 }
 
 void sched_clear(enum sched_item_id id) {
@@ -139,7 +207,7 @@ uint64_t sched_tick(enum sched_item_id id) {
 }
 
 uint64_t sched_ticks_remaining(enum sched_item_id id) {
-    return sched_tick(id) - muldiv_floor(cpu.cycles, sched.clockRates[sched.items[id].clock], sched.clockRates[CLOCK_CPU]);
+    return sched_tick(id) - sched_cycles_to_ticks(sched.items[id].clock, cpu.cycles);
 }
 
 void sched_process_pending_events(void) {
@@ -225,6 +293,7 @@ void sched_set_clock(enum clock_id clock, uint32_t new_rate) {
     }
     sched_update(SCHED_SECOND);
     sched.clockRates[clock] = new_rate;
+    sched_update_ratios();
 }
 
 uint32_t sched_get_clock_rate(enum clock_id clock) {
@@ -238,6 +307,7 @@ void sched_reset(void) {
 
     memset(&sched, 0, sizeof sched);
     memcpy(sched.clockRates, def_rates, sizeof(def_rates));
+    sched_update_ratios();
 
     sched_update_next(sched.dma.next = SCHED_SECOND);
 
@@ -267,7 +337,7 @@ uint64_t sched_total_cycles(void) {
 }
 
 uint64_t sched_total_time(enum clock_id clock) {
-    return (uint64_t)cpu.seconds * sched.clockRates[clock] + muldiv_floor(cpu.cycles, sched.clockRates[clock], sched.clockRates[CLOCK_CPU]);
+    return (uint64_t)cpu.seconds * sched.clockRates[clock] + sched_cycles_to_ticks(clock, cpu.cycles);
 }
 
 uint64_t event_next_cycle(enum sched_item_id id) {
@@ -275,11 +345,11 @@ uint64_t event_next_cycle(enum sched_item_id id) {
     return (uint64_t)item->second * sched.clockRates[CLOCK_CPU] + item->cycle - sched_event_next_cycle() + cpu.baseCycles;
 }
 
-bool sched_save(FILE *image) {
-    return fwrite(&sched, sizeof(sched), 1, image) == 1;
+bool sched_save(image_t *image) {
+    return image_write(image, &sched, sizeof(sched));
 }
 
-bool sched_restore(FILE *image) {
+bool sched_restore(image_t *image) {
     bool ret;
     enum sched_item_id id;
     union sched_callback callbacks[SCHED_NUM_ITEMS];
@@ -288,11 +358,12 @@ bool sched_restore(FILE *image) {
         callbacks[id] = sched.items[id].callback;
     }
 
-    ret = fread(&sched, sizeof(sched), 1, image) == 1;
+    ret = image_read(image, &sched, sizeof(sched));
 
     for (id = 0; id < SCHED_NUM_ITEMS; id++) {
         sched.items[id].callback = callbacks[id];
     }
+    sched_update_ratios();
 
     return ret;
 }
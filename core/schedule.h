@@ -5,6 +5,8 @@
 extern "C" {
 #endif
 
+#include "image.h"
+#include "defines.h"
 #include <stdint.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -66,7 +68,7 @@ typedef struct sched_state {
     bool run_event_triggered;
 } sched_state_t;
 
-extern sched_state_t sched;
+extern EMU_LOCAL sched_state_t sched;
 
 void sched_init(void);
 void sched_reset(void);
@@ -89,8 +91,8 @@ uint32_t sched_get_clock_rate(enum clock_id clock);
 uint64_t sched_total_cycles(void);
 uint64_t sched_total_time(enum clock_id clock);
 uint64_t event_next_cycle(enum sched_item_id id);
-bool sched_restore(FILE *image);
-bool sched_save(FILE *image);
+bool sched_restore(image_t *image);
+bool sched_save(image_t *image);
 
 #ifdef __cplusplus
 }
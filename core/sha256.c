@@ -19,7 +19,7 @@
 #include <string.h>
 #include <stdio.h>
 
-static sha256_state_t sha256;
+static EMU_LOCAL sha256_state_t sha256;
 
 #define ROR(x, y) ((x) >> (y) | (x) << (32 - (y)))
 
@@ -155,11 +155,11 @@ eZ80portrange_t init_sha256(void) {
     return device;
 }
 
-bool sha256_save(FILE *image) {
-    return fwrite(&sha256, sizeof(sha256), 1, image) == 1;
+bool sha256_save(image_t *image) {
+    return image_write(image, &sha256, sizeof(sha256));
 }
 
-bool sha256_restore(FILE *image) {
-    return fread(&sha256, sizeof(sha256), 1, image) == 1;
+bool sha256_restore(image_t *image) {
+    return image_read(image, &sha256, sizeof(sha256));
 }
 
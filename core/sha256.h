@@ -5,6 +5,7 @@
 extern "C" {
 #endif
 
+#include "image.h"
 #include "port.h"
 #include <stdint.h>
 #include <stdbool.h>
@@ -18,8 +19,8 @@ typedef struct sha256_state {
 
 eZ80portrange_t init_sha256(void);
 void sha256_reset(void);
-bool sha256_restore(FILE *image);
-bool sha256_save(FILE *image);
+bool sha256_restore(image_t *image);
+bool sha256_save(image_t *image);
 
 #ifdef __cplusplus
 }
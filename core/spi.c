@@ -1,4 +1,5 @@
 #include "spi.h"
+#include "lcd.h"
 #include "emu.h"
 #include "bus.h"
 #include "schedule.h"
@@ -7,7 +8,7 @@
 #include <stdlib.h>
 #include <string.h>
 
-spi_state_t spi;
+EMU_LOCAL spi_state_t spi;
 
 static bool spi_scan_line(uint16_t row) {
     if (unlikely(row > SPI_LAST_ROW)) {
@@ -69,6 +70,24 @@ bool spi_vsync(void) {
     return spi_scan_line(0);
 }
 
+static inline void spi_refresh_color(uint8_t mode, uint8_t mac, uint8_t *red, uint8_t *green, uint8_t *blue) {
+    if (!likely(mac & SPI_MAC_BGR)) { /* eor */
+        uint8_t temp = *red;
+        *red = *blue;
+        *blue = temp;
+    }
+    if (unlikely(mode & SPI_MODE_INVERT)) {
+        *red = ~*red;
+        *green = ~*green;
+        *blue = ~*blue;
+    }
+    if (unlikely(mode & SPI_MODE_IDLE)) {
+        *red = (int8_t)*red >> 7;
+        *green = (int8_t)*green >> 7;
+        *blue = (int8_t)*blue >> 7;
+    }
+}
+
 bool spi_refresh_pixel(void) {
     uint8_t *pixel, red, green, blue;
     if (unlikely(spi.mode & SPI_MODE_IGNORE)) {
@@ -87,21 +106,7 @@ bool spi_refresh_pixel(void) {
             green = pixel[SPI_GREEN];
             blue = pixel[SPI_BLUE];
         }
-        if (!likely(spi.mac & SPI_MAC_BGR)) { /* eor */
-            uint8_t temp = red;
-            red = blue;
-            blue = temp;
-        }
-        if (unlikely(spi.mode & SPI_MODE_INVERT)) {
-            red = ~red;
-            green = ~green;
-            blue = ~blue;
-        }
-        if (unlikely(spi.mode & SPI_MODE_IDLE)) {
-            red = (int8_t)red >> 7;
-            green = (int8_t)green >> 7;
-            blue = (int8_t)blue >> 7;
-        }
+        spi_refresh_color(spi.mode, spi.mac, &red, &green, &blue);
     }
     pixel = spi.display[spi.col][spi.dstRow];
     pixel[SPI_RED] = red;
@@ -116,38 +121,44 @@ bool spi_refresh_pixel(void) {
     return true;
 }
 
-static void spi_update_pixel(uint8_t red, uint8_t green, uint8_t blue) {
-    if (likely(spi.rowReg < 320 && spi.colReg < 240)) {
-        uint8_t *pixel = spi.frame[spi.rowReg][spi.colReg];
-        pixel[SPI_RED] = red;
-        pixel[SPI_GREEN] = green;
-        pixel[SPI_BLUE] = blue;
-    }
-    if (unlikely(spi.mac & SPI_MAC_RCX)) {
-        if (unlikely(spi.colReg == spi.colEnd)) {
-            if (unlikely(spi.rowReg == spi.rowEnd && spi.rowStart <= spi.rowEnd)) {
-                spi.rowReg = spi.colReg = ~0;
+/* Steps the memory registers through the window, takes copies so pixel loops can keep them in registers */
+static inline void spi_step_mregs(uint32_t *rowReg, uint32_t *colReg, uint8_t mac,
+                                  uint16_t rowStart, uint16_t rowEnd, uint16_t colStart, uint16_t colEnd) {
+    if (unlikely(mac & SPI_MAC_RCX)) {
+        if (unlikely(*colReg == colEnd)) {
+            if (unlikely(*rowReg == rowEnd && rowStart <= rowEnd)) {
+                *rowReg = *colReg = ~0;
             } else {
-                spi.colReg = spi.colStart;
-                spi.rowReg = (spi.rowReg + 1 - (spi.mac >> 6 & 2)) & 0x1FF;
+                *colReg = colStart;
+                *rowReg = (*rowReg + 1 - (mac >> 6 & 2)) & 0x1FF;
             }
-        } else if (spi.colReg < 0x100) {
-            spi.colReg = (spi.colReg + 1 - (spi.mac >> 5 & 2)) & 0xFF;
+        } else if (*colReg < 0x100) {
+            *colReg = (*colReg + 1 - (mac >> 5 & 2)) & 0xFF;
         }
     } else {
-        if (unlikely(spi.rowReg == spi.colEnd)) {
-            if (unlikely(spi.colReg == spi.rowEnd && spi.rowStart <= spi.rowEnd)) {
-                spi.rowReg = spi.colReg = ~0;
+        if (unlikely(*rowReg == colEnd)) {
+            if (unlikely(*colReg == rowEnd && rowStart <= rowEnd)) {
+                *rowReg = *colReg = ~0;
             } else {
-                spi.rowReg = spi.colStart;
-                spi.colReg = (spi.colReg + 1 - (spi.mac >> 5 & 2)) & 0xFF;
+                *rowReg = colStart;
+                *colReg = (*colReg + 1 - (mac >> 5 & 2)) & 0xFF;
             }
-        } else if (spi.rowReg < 0x200) {
-            spi.rowReg = (spi.rowReg + 1 - (spi.mac >> 6 & 2)) & 0x1FF;
+        } else if (*rowReg < 0x200) {
+            *rowReg = (*rowReg + 1 - (mac >> 6 & 2)) & 0x1FF;
         }
     }
 }
 
+static void spi_update_pixel(uint8_t red, uint8_t green, uint8_t blue) {
+    if (likely(spi.rowReg < 320 && spi.colReg < 240)) {
+        uint8_t *pixel = spi.frame[spi.rowReg][spi.colReg];
+        pixel[SPI_RED] = red;
+        pixel[SPI_GREEN] = green;
+        pixel[SPI_BLUE] = blue;
+    }
+    spi_step_mregs(&spi.rowReg, &spi.colReg, spi.mac, spi.rowStart, spi.rowEnd, spi.colStart, spi.colEnd);
+}
+
 void spi_update_pixel_18bpp(uint8_t red, uint8_t green, uint8_t blue) {
     assert(red < 64 && green < 64 && blue < 64);
     spi_update_pixel(red << 2 | red >> 4, green << 2 | green >> 4, blue << 2 | blue >> 4);
@@ -163,6 +174,104 @@ void spi_update_pixel_12bpp(uint8_t red, uint8_t green, uint8_t blue) {
     spi_update_pixel(spi.lut[(red << 1) + 0], spi.lut[(green << 2) + 32], spi.lut[(blue << 1) + 96]);
 }
 
+/* Refreshes the rest of the current line, up to count pixels, returns how many were refreshed */
+static uint32_t spi_refresh_pixels(uint32_t count) {
+    const uint8_t mode = spi.mode, mac = spi.mac, colDir = spi.colDir;
+    const uint16_t srcRow = spi.srcRow, dstRow = spi.dstRow;
+    uint8_t *pixel, red, green, blue, col = spi.col;
+    uint32_t i, n;
+
+    if (unlikely(mode & SPI_MODE_IGNORE)) {
+        return 0;
+    }
+    n = colDir == 1 ? SPI_NUM_COLS - col : col + 1;
+    if (n > count) {
+        n = count;
+    }
+    for (i = 0; i < n; i++) {
+        if (unlikely(mode & (SPI_MODE_SLEEP | SPI_MODE_OFF | SPI_MODE_BLANK))) {
+            red = green = blue = ~0;
+        } else {
+            pixel = spi.frame[srcRow][col];
+            red = pixel[SPI_RED];
+            green = pixel[SPI_GREEN];
+            blue = pixel[SPI_BLUE];
+            spi_refresh_color(mode, mac, &red, &green, &blue);
+        }
+        pixel = spi.display[col][dstRow];
+        pixel[SPI_RED] = red;
+        pixel[SPI_GREEN] = green;
+        pixel[SPI_BLUE] = blue;
+        pixel[SPI_ALPHA] = ~0;
+        col += colDir;
+    }
+    spi.col = col;
+    if (unlikely(col > SPI_LAST_COL)) {
+        spi.mode |= SPI_MODE_IGNORE;
+    }
+    return n;
+}
+
+/* Same as before refreshes, then a refresh and an update for each color, then after refreshes.
+ * The line is refreshed up front, and the few pixels updated ahead of their refresh are patched. */
+void spi_update_line(const uint32_t *colors, uint32_t count, uint32_t before, uint32_t after) {
+    const uint8_t mode = spi.mode, mac = spi.mac, col = spi.col, colDir = spi.colDir;
+    const uint16_t srcRow = spi.srcRow, dstRow = spi.dstRow;
+    const uint16_t rowStart = spi.rowStart, rowEnd = spi.rowEnd, colStart = spi.colStart, colEnd = spi.colEnd;
+    uint32_t i, refreshed, ahead, rowReg, colReg;
+    uint8_t *pixel, red, green, blue;
+    bool patch;
+
+    if (unlikely(mode & SPI_MODE_SCROLL)) { /* refreshes may take from bus_rand */
+        while (before--) {
+            spi_refresh_pixel();
+        }
+        for (i = 0; i < count; i++) {
+            spi_refresh_pixel();
+            if (likely(spi.ifCtl & SPI_IC_CTRL_DATA)) {
+                spi_update_pixel(colors[i], colors[i] >> 8, colors[i] >> 16);
+            }
+        }
+        while (after--) {
+            spi_refresh_pixel();
+        }
+        return;
+    }
+
+    patch = !(mode & (SPI_MODE_SLEEP | SPI_MODE_OFF | SPI_MODE_BLANK));
+    refreshed = spi_refresh_pixels(before + count + after);
+    if (unlikely(!(spi.ifCtl & SPI_IC_CTRL_DATA))) {
+        return;
+    }
+    rowReg = spi.rowReg;
+    colReg = spi.colReg;
+    for (i = 0; i < count; i++) {
+        if (likely(rowReg < 320 && colReg < 240)) {
+            red = colors[i];
+            green = colors[i] >> 8;
+            blue = colors[i] >> 16;
+            pixel = spi.frame[rowReg][colReg];
+            pixel[SPI_RED] = red;
+            pixel[SPI_GREEN] = green;
+            pixel[SPI_BLUE] = blue;
+            if (unlikely(rowReg == srcRow) && patch) {
+                /* refresh index of this column, the one for this pixel came just before it */
+                ahead = (uint8_t)((colReg - col) * colDir);
+                if (ahead < refreshed && ahead > before + i) {
+                    spi_refresh_color(mode, mac, &red, &green, &blue);
+                    pixel = spi.display[colReg][dstRow];
+                    pixel[SPI_RED] = red;
+                    pixel[SPI_GREEN] = green;
+                    pixel[SPI_BLUE] = blue;
+                }
+            }
+        }
+        spi_step_mregs(&rowReg, &colReg, mac, rowStart, rowEnd, colStart, colEnd);
+    }
+    spi.rowReg = rowReg;
+    spi.colReg = colReg;
+}
+
 static void spi_sw_reset(void) {
     spi.cmd = 0;
     spi.fifo = 1;
@@ -421,6 +530,7 @@ static void spi_write(const uint16_t pio, const uint8_t byte, bool poke) {
     if (pio == 0x18) {
         spi.fifo = spi.fifo << 3 | (byte & 7);
         if (spi.fifo & 0x200) {
+            lcd_flush_panel();
             if (spi.fifo & 0x100) {
                 spi_write_param(spi.fifo);
             } else {
@@ -458,10 +568,10 @@ eZ80portrange_t init_spi(void) {
     return pspi;
 }
 
-bool spi_save(FILE *image) {
-    return fwrite(&spi, sizeof(spi), 1, image) == 1;
+bool spi_save(image_t *image) {
+    return image_write(image, &spi, sizeof(spi));
 }
 
-bool spi_restore(FILE *image) {
-    return fread(&spi, sizeof(spi), 1, image) == 1;
+bool spi_restore(image_t *image) {
+    return image_read(image, &spi, sizeof(spi));
 }
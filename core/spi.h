@@ -5,6 +5,7 @@
 extern "C" {
 #endif
 
+#include "image.h"
 #include "port.h"
 
 #include <stdint.h>
@@ -62,7 +63,7 @@ typedef struct spi_state {
     uint8_t gammaCorrection[2][16];
 } spi_state_t;
 
-extern spi_state_t spi;
+extern EMU_LOCAL spi_state_t spi;
 
 eZ80portrange_t init_spi(void);
 void spi_reset(void);
@@ -72,8 +73,9 @@ bool spi_refresh_pixel(void);
 void spi_update_pixel_18bpp(uint8_t r, uint8_t g, uint8_t b);
 void spi_update_pixel_16bpp(uint8_t r, uint8_t g, uint8_t b);
 void spi_update_pixel_12bpp(uint8_t r, uint8_t g, uint8_t b);
-bool spi_restore(FILE *image);
-bool spi_save(FILE *image);
+void spi_update_line(const uint32_t *colors, uint32_t count, uint32_t before, uint32_t after);
+bool spi_restore(image_t *image);
+bool spi_save(image_t *image);
 
 #ifdef __cplusplus
 }
@@ -10,7 +10,7 @@
 #include <string.h>
 
 /* Global GPT state */
-general_timers_state_t gpt;
+EMU_LOCAL general_timers_state_t gpt;
 
 static void ost_event(enum sched_item_id id) {
     static const int ost_ticks[4] = { 73, 153, 217, 313 };
@@ -190,10 +190,10 @@ eZ80portrange_t init_gpt(void) {
     return device;
 }
 
-bool gpt_save(FILE *image) {
-    return fwrite(&gpt, sizeof(gpt), 1, image) == 1;
+bool gpt_save(image_t *image) {
+    return image_write(image, &gpt, sizeof(gpt));
 }
 
-bool gpt_restore(FILE *image) {
-    return fread(&gpt, sizeof(gpt), 1, image) == 1;
+bool gpt_restore(image_t *image) {
+    return image_read(image, &gpt, sizeof(gpt));
 }
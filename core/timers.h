@@ -5,6 +5,7 @@
 extern "C" {
 #endif
 
+#include "image.h"
 #include "port.h"
 #include <stdint.h>
 #include <stdbool.h>
@@ -22,12 +23,12 @@ typedef struct general_timers_state {
     bool osTimerState;
 } general_timers_state_t;
 
-extern general_timers_state_t gpt;
+extern EMU_LOCAL general_timers_state_t gpt;
 
 eZ80portrange_t init_gpt(void);
 void gpt_reset(void);
-bool gpt_restore(FILE *image);
-bool gpt_save(FILE *image);
+bool gpt_restore(image_t *image);
+bool gpt_save(image_t *image);
 
 #ifdef __cplusplus
 }
@@ -49,6 +49,7 @@ typedef struct usb_event {
     usb_progress_handler_t *progress_handler;
     void *progress_context, *context;
     usb_event_type_t type;
+    bool turbo; /* end host side waits early when the calculator halts through them */
     union {
         usb_init_info_t init;
         usb_transfer_info_t transfer;
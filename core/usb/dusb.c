@@ -100,6 +100,9 @@
 
 #define DUSB_OS_BASE_ADDR                   0x30000
 
+/* time given to the calculator to notice a plug or a reset */
+#define DUSB_SETTLE_USECONDS                10000
+
 
 typedef enum dusb_command_type {
     DUSB_DONE_COMMAND,
@@ -618,7 +621,7 @@ static int dusb_transition(usb_event_t *event, dusb_state_t state) {
             case DUSB_RESET_RECOVERY_STATE:
                 event->type = USB_TIMER_EVENT;
                 timer->mode = USB_TIMER_ABSOLUTE_MODE;
-                timer->useconds = 10000;
+                timer->useconds = DUSB_SETTLE_USECONDS;
                 break;
             case DUSB_RESET_STATE:
                 event->type = USB_RESET_EVENT;
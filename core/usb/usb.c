@@ -16,7 +16,7 @@
 void debugInstruction(void);
 
 /* Global GPT state */
-usb_state_t usb;
+EMU_LOCAL usb_state_t usb;
 
 static void usb_host_reset(void);
 
@@ -83,7 +83,12 @@ static void usb_plug(void) {
 static int usb_dispatch_event(void) {
     int error = 0;
     do {
+        usb_transfer_info_t dma = usb.event.info.transfer;
+        bool transfer = usb.event.type == USB_TRANSFER_EVENT && dma.buffer;
         error = usb.device(&usb.event);
+        if (transfer) {
+            mem_invalidate_ptr(dma.buffer, dma.length);
+        }
         if (error) {
             usb.event.type = USB_DESTROY_EVENT;
         }
@@ -161,7 +166,7 @@ static int usb_dispatch_event(void) {
 }
 
 int usb_init_device(int argc, const char *const *argv,
-                    usb_progress_handler_t *progress_handler, void *progress_context) {
+                    usb_progress_handler_t *progress_handler, void *progress_context, bool turbo) {
     if (!usb.device) {
         usb.device = usb_disconnected_device;
     }
@@ -180,6 +185,7 @@ int usb_init_device(int argc, const char *const *argv,
     }
     usb.event.progress_handler = progress_handler;
     usb.event.progress_context = progress_context;
+    usb.event.turbo = turbo;
     int error = usb_dispatch_event();
     if (!error) {
         usb_plug();
@@ -197,6 +203,16 @@ static void usb_device_event(enum sched_item_id event) {
     usb_dispatch_event();
 }
 
+/* Waits between packets are the host's, so while the calculator sleeps through one it may as well end */
+bool usb_fast_forward(void) {
+    if (usb.event.turbo && usb.device != usb_disconnected_device &&
+        sched.event.next == SCHED_USB_DEVICE && sched_active(SCHED_USB_DEVICE)) {
+        sched_set(SCHED_USB_DEVICE, 0);
+        return true;
+    }
+    return false;
+}
+
 uint8_t usb_status(void) {
     return (usb.regs.otgcsr & (OTGCSR_A_VBUS_VLD | OTGCSR_A_SESS_VLD | OTGCSR_B_SESS_VLD) ? 0x80 : 0) |
         (usb.regs.otgcsr & (OTGCSR_DEV_B | OTGCSR_ROLE_D) ? 0x40 : 0);
@@ -510,13 +526,13 @@ eZ80portrange_t init_usb(void) {
     return device;
 }
 
-bool usb_save(FILE *image) {
-    return fwrite(&usb, offsetof(usb_state_t, event), 1, image) == 1;
+bool usb_save(image_t *image) {
+    return image_write(image, &usb, offsetof(usb_state_t, event));
 }
 
-bool usb_restore(FILE *image) {
+bool usb_restore(image_t *image) {
     void *context = usb.event.context;
-    bool success = fread(&usb, offsetof(usb_state_t, event), 1, image) == 1;
+    bool success = image_read(image, &usb, offsetof(usb_state_t, event));
     usb.event.context = context;
     usb_init_hccr(); // hccr is read only
     // these bits are raz
@@ -2,6 +2,7 @@
 #define H_USB_USB
 
 #include "device.h"
+#include "../image.h"
 #include "../port.h"
 
 #include <stdint.h>
@@ -18,7 +19,7 @@ typedef struct usb_state {
     usb_device_t *device;
 } usb_state_t;
 
-extern usb_state_t usb;
+extern EMU_LOCAL usb_state_t usb;
 
 #ifdef __cplusplus
 extern "C" {
@@ -26,8 +27,8 @@ extern "C" {
 
 eZ80portrange_t init_usb(void);
 void usb_reset(void);
-bool usb_restore(FILE *image);
-bool usb_save(FILE *image);
+bool usb_restore(image_t *image);
+bool usb_save(image_t *image);
 
 void usb_host_int(uint8_t);
 void usb_otg_int(uint16_t);
@@ -35,9 +36,10 @@ void usb_grp0_int(uint8_t);
 void usb_grp1_int(uint32_t);
 void usb_grp2_int(uint16_t);
 uint8_t usb_status(void);
+bool usb_fast_forward(void);   /* fire a pending turbo transfer wait now instead of halting until it */
 
 int usb_init_device(int argc, const char *const *argv,
-                    usb_progress_handler_t *progress_handler, void *progress_context);
+                    usb_progress_handler_t *progress_handler, void *progress_context, bool turbo);
 
 #ifdef __cplusplus
 }
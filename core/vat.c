@@ -5,6 +5,21 @@
 
 #include <string.h>
 
+/* The os keeps user memory as variable data growing up from userMem, followed by the floating
+ * point stack from fpBase up to FPS and free memory. Above that the operator stack grows down
+ * from OPBase to OPS, under the temporary entries up to pTemp, the named entries up to progPtr
+ * and the symbol table up to symTable. Entries are read downwards from their first byte. */
+#define VAT_USER_MEM    0xD1A881
+#define VAT_FP_BASE     0xD0258A
+#define VAT_FPS         0xD0258D
+#define VAT_OP_BASE     0xD02590
+#define VAT_OPS         0xD02593
+#define VAT_P_TEMP      0xD0259A
+#define VAT_PROG_PTR    0xD0259D
+#define VAT_NEW_DATA    0xD025A0
+#define VAT_SYM_TABLE   0xD3FFFF
+#define VAT_RAM_END     0xD40000
+
 const char *calc_var_type_names[0x40] = {
     "Real",
     "Real List",
@@ -82,7 +97,7 @@ static void hex_byte(char **dest, uint8_t byte) {
 }
 
 const char *calc_var_name_to_utf8(uint8_t name[8], bool named) {
-    static char buffer[20];
+    static EMU_LOCAL char buffer[20];
     char *dest = buffer;
     uint8_t i = 0;
     if (name[0] == 0x5D) {
@@ -213,15 +228,15 @@ const char *calc_var_name_to_utf8(uint8_t name[8], bool named) {
 
 void vat_search_init(calc_var_t *var) {
     memset(var, 0, sizeof *var);
-    var->vat = 0xD3FFFF;
+    var->vat = VAT_SYM_TABLE;
 }
 
 bool vat_search_next(calc_var_t *var) {
-    const uint32_t userMem  = 0xD1A881,
-                   OPBase   = mem_peek_long(0xD02590),
-                   pTemp    = mem_peek_long(0xD0259A),
-                   progPtr  = mem_peek_long(0xD0259D),
-                   symTable = 0xD3FFFF;
+    const uint32_t userMem  = VAT_USER_MEM,
+                   OPBase   = mem_peek_long(VAT_OP_BASE),
+                   pTemp    = mem_peek_long(VAT_P_TEMP),
+                   progPtr  = mem_peek_long(VAT_PROG_PTR),
+                   symTable = VAT_SYM_TABLE;
     uint8_t i;
     if (!var->vat || var->vat < userMem || var->vat <= OPBase || var->vat > symTable) {
         return false; /* some sanity check failed */
@@ -243,7 +258,7 @@ bool vat_search_next(calc_var_t *var) {
     var->archived = var->address > 0xC0000 && var->address < 0x400000;
     if (var->archived) {
         var->address += 9 + var->named + var->namelen;
-    } else if (var->address < 0xD1A881 || var->address >= 0xD40000) {
+    } else if (var->address < VAT_USER_MEM || var->address >= VAT_RAM_END) {
         return false;
     }
     var->type = (calc_var_type_t)(var->type1 & 0x3F);
@@ -297,6 +312,151 @@ bool vat_search_find(const calc_var_t *target, calc_var_t *result) {
     return false;
 }
 
+/* names are unique within each table, so a real and a complex A or a program and a protected program clash */
+bool vat_search_name(const calc_var_t *target, calc_var_t *result) {
+    vat_search_init(result);
+    while (vat_search_next(result)) {
+        if (result->named == target->named &&
+            result->namelen == target->namelen &&
+            !memcmp(result->name, target->name, target->namelen)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint32_t vat_entry_size(const calc_var_t *var) {
+    return 6 + var->named + var->namelen;
+}
+
+/* move a block of ram, the ranges have already been checked against the os pointers */
+static void vat_move(uint32_t dst, uint32_t src, uint32_t size) {
+    uint8_t *ptr;
+    if (size && (ptr = phys_mem_ptr(dst, size))) {
+        memmove(ptr, phys_mem_ptr(src, size), size);
+        mem_invalidate_ptr(ptr, size);
+    }
+}
+
+static void vat_adjust(uint32_t pointer, uint32_t from, int32_t delta) {
+    uint32_t value = mem_peek_long(pointer);
+    if (value >= from) {
+        mem_poke_long(pointer, value + delta);
+    }
+}
+
+/* the data addresses of ram entries are stored high byte first, below the type and version */
+static void vat_relocate(uint32_t from, int32_t delta) {
+    calc_var_t var;
+    uint32_t entry, address;
+    vat_search_init(&var);
+    for (entry = var.vat; vat_search_next(&var); entry = var.vat) {
+        if (!var.archived && var.address >= from) {
+            address = var.address + delta;
+            mem_poke_byte(entry - 3, address);
+            mem_poke_byte(entry - 4, address >> 8);
+            mem_poke_byte(entry - 5, address >> 16);
+        }
+    }
+}
+
+bool vat_create(const calc_var_t *var) {
+    const uint32_t fpBase  = mem_peek_long(VAT_FP_BASE),
+                   FPS     = mem_peek_long(VAT_FPS),
+                   OPS     = mem_peek_long(VAT_OPS),
+                   pTemp   = mem_peek_long(VAT_P_TEMP),
+                   progPtr = mem_peek_long(VAT_PROG_PTR),
+                   size    = vat_entry_size(var),
+                   top     = var->named ? pTemp : progPtr;
+    uint8_t *ptr;
+    uint32_t entry;
+    uint8_t i;
+    if (fpBase < VAT_USER_MEM || fpBase > FPS || FPS > OPS || OPS > top ||
+        pTemp > progPtr || progPtr > VAT_SYM_TABLE || !var->namelen || var->namelen > 8) {
+        return false; /* some sanity check failed */
+    }
+    if (OPS - FPS < var->size + size || !(ptr = phys_mem_ptr(fpBase, var->size))) {
+        return false; /* not enough free memory */
+    }
+
+    /* the data goes after all other variable data, pushing up the floating point stack */
+    vat_move(fpBase + var->size, fpBase, FPS - fpBase);
+    memcpy(ptr, var->data, var->size);
+    mem_invalidate_ptr(ptr, var->size);
+    vat_adjust(VAT_NEW_DATA, fpBase, var->size);
+    mem_poke_long(VAT_FPS, FPS + var->size);
+    mem_poke_long(VAT_FP_BASE, fpBase + var->size);
+
+    /* the entry goes at the bottom of its table, pushing down everything under it */
+    vat_move(OPS + 1 - size, OPS + 1, top - OPS);
+    entry = top;
+    mem_poke_byte(entry--, var->type1);
+    mem_poke_byte(entry--, 0);
+    mem_poke_byte(entry--, var->version);
+    mem_poke_byte(entry--, fpBase);
+    mem_poke_byte(entry--, fpBase >> 8);
+    mem_poke_byte(entry--, fpBase >> 16);
+    if (var->named) {
+        mem_poke_byte(entry--, var->namelen);
+    }
+    for (i = 0; i != var->namelen; i++) {
+        mem_poke_byte(entry--, var->name[i]);
+    }
+    mem_poke_long(VAT_OPS, OPS - size);
+    mem_poke_long(VAT_OP_BASE, mem_peek_long(VAT_OP_BASE) - size);
+    mem_poke_long(VAT_P_TEMP, pTemp - size);
+    if (!var->named) {
+        mem_poke_long(VAT_PROG_PTR, progPtr - size);
+    }
+    return true;
+}
+
+bool vat_delete(const calc_var_t *var) {
+    const uint32_t fpBase  = mem_peek_long(VAT_FP_BASE),
+                   FPS     = mem_peek_long(VAT_FPS),
+                   OPS     = mem_peek_long(VAT_OPS),
+                   pTemp   = mem_peek_long(VAT_P_TEMP),
+                   progPtr = mem_peek_long(VAT_PROG_PTR),
+                   size    = vat_entry_size(var),
+                   top     = var->vat + size,
+                   end     = var->address + var->size;
+    if (var->archived || var->vat < OPS || top <= pTemp || top > VAT_SYM_TABLE ||
+        var->address < VAT_USER_MEM || end > fpBase || fpBase > FPS) {
+        return false; /* only ram variables outside of the temporary entries can be deleted */
+    }
+
+    /* close the gap left by the entry, then the gap left by the data */
+    vat_move(OPS + 1 + size, OPS + 1, var->vat - OPS);
+    mem_poke_long(VAT_OPS, OPS + size);
+    mem_poke_long(VAT_OP_BASE, mem_peek_long(VAT_OP_BASE) + size);
+    mem_poke_long(VAT_P_TEMP, pTemp + size);
+    if (top > progPtr) {
+        mem_poke_long(VAT_PROG_PTR, progPtr + size);
+    }
+    vat_move(var->address, end, FPS - end);
+    vat_relocate(end, -(int32_t)var->size);
+    vat_adjust(VAT_NEW_DATA, end, -(int32_t)var->size);
+    mem_poke_long(VAT_FPS, FPS - var->size);
+    mem_poke_long(VAT_FP_BASE, fpBase - var->size);
+    return true;
+}
+
+bool calc_var_is_named(const calc_var_t *var) {
+    switch (var->type) {
+        case CALC_VAR_TYPE_PROG:
+        case CALC_VAR_TYPE_PROT_PROG:
+        case CALC_VAR_TYPE_TEMP_PROG:
+        case CALC_VAR_TYPE_APP_VAR:
+        case CALC_VAR_TYPE_GROUP:
+            return true;
+        case CALC_VAR_TYPE_REAL_LIST:
+        case CALC_VAR_TYPE_CPLX_LIST:
+            return var->name[0] == 0x5D && var->name[1] > 5; /* L1 to L6 live in the symbol table */
+        default:
+            return false;
+    }
+}
+
 bool calc_var_is_prog(const calc_var_t *var) {
     return var && (var->type == CALC_VAR_TYPE_PROG || var->type == CALC_VAR_TYPE_PROT_PROG);
 }
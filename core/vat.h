@@ -90,6 +90,11 @@ typedef struct calc_var {
 void vat_search_init(calc_var_t *);
 bool vat_search_next(calc_var_t *);
 bool vat_search_find(const calc_var_t *, calc_var_t *);
+bool vat_search_name(const calc_var_t *, calc_var_t *);   /* find what the os would treat as the same variable, whatever its type */
+bool vat_create(const calc_var_t *);   /* add a ram variable from type1, version, name, named and size bytes of data */
+bool vat_delete(const calc_var_t *);   /* remove a ram variable returned by a search */
+
+bool calc_var_is_named(const calc_var_t *);
 
 bool calc_var_is_prog(const calc_var_t *);
 bool calc_var_is_asmprog(const calc_var_t *);
@@ -192,7 +192,9 @@ SOURCES += \
     ../../core/registers.c \
     ../../core/port.c \
     ../../core/interrupt.c \
+    ../../core/jit.c \
     ../../core/flash.c \
+    ../../core/image.c \
     ../../core/misc.c \
     ../../core/schedule.c \
     ../../core/timers.c \
@@ -227,6 +229,8 @@ SOURCES += \
     debugger.cpp \
     settings.cpp \
     capture/animated-png.c \
+    capture/recorder.cpp \
+    capture/y4m.c \
     keypad/qtkeypadbridge.cpp \
     keypad/keymap.cpp \
     keypad/keypadwidget.cpp \
@@ -267,7 +271,7 @@ SOURCES += \
 
 linux|macx: SOURCES += ../../core/os/os-linux.c
 win32: SOURCES += ../../core/os/os-win32.c win32-console.cpp
-win32: LIBS += -lpsapi
+win32: LIBS += -lpsapi -ladvapi32
 
 
 macx: SOURCES += os/mac/kdmactouchbar.mm
@@ -293,8 +297,10 @@ HEADERS  += \
     ../../core/registers.h \
     ../../core/port.h \
     ../../core/interrupt.h \
+    ../../core/jit.h \
     ../../core/emu.h \
     ../../core/flash.h \
+    ../../core/image.h \
     ../../core/misc.h \
     ../../core/schedule.h \
     ../../core/timers.h \
@@ -341,6 +347,8 @@ HEADERS  += \
     keypad/operkey.h \
     keypad/arrowkey.h \
     capture/animated-png.h \
+    capture/recorder.h \
+    capture/y4m.h \
     debugger/hexwidget.h \
     debugger/disasm.h \
     tivars_lib_cpp/src/tivarslib_utils.h \
@@ -2,16 +2,12 @@
 
 #ifdef PNG_WRITE_APNG_SUPPORTED
 
-#include <assert.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
-#include <math.h>
 #include <stdint.h>
 #include <stdbool.h>
 
-#include "../../core/schedule.h"
-
 #ifdef _MSC_VER
 static inline int clzll(unsigned long long input_num) {
     unsigned long index;
@@ -31,299 +27,186 @@ static inline int clzll(unsigned long long input_num) {
 #define clzll(x) __builtin_clzll(x)
 #endif
 
-static apng_t apng;
+/* the crc of a png chunk, over its type and data */
+static uint32_t apng_crc(const uint8_t *data, size_t size) {
+    uint32_t crc = ~UINT32_C(0);
+    int i;
 
-bool apng_start(const char *tmp_name, int frameskip) {
-    /* temp file used for saving rgb888 data rather than storing everything in ram */
-    if (!(apng.tmp = fopen(tmp_name, "w+b"))) {
-        return false;
+    while (size--) {
+        crc ^= *data++;
+        for (i = 0; i != 8; i++) {
+            crc = crc >> 1 ^ (UINT32_C(0xEDB88320) & -(crc & 1));
+        }
     }
-
-    /* set frameskip rate */
-    apng.frameskip = (unsigned int)frameskip + 1;
-
-    /* init recording items */
-    apng.recording = true;
-    apng.skipped = 0;
-    apng.n = 0;
-
-    return true;
+    return ~crc;
 }
 
-static void apng_write_delay(void) {
-    uint64_t time = sched_total_time(CLOCK_48M) - apng.prev_time;
-    int logo = 48 - clzll(time);
-    uint64_t shift = logo > 10 ? (uint64_t)logo : 10;
-    png_uint_16 num = time >> shift, den = sched.clockRates[CLOCK_48M] >> shift;
-    fwrite(&num, sizeof(num), 1, apng.tmp);
-    fwrite(&den, sizeof(den), 1, apng.tmp);
-    apng.prev_time += num << shift;
+static void apng_abort(apng_t *apng) {
+    png_destroy_write_struct(&apng->png_ptr, &apng->info_ptr);
+    fclose(apng->file);
+    apng->file = NULL;
 }
 
-void apng_add_frame(const void *frame) {
-    if (!apng.recording) {
-        return;
+bool apng_open(apng_t *apng, const char *filename, bool optimize) {
+    if (!(apng->file = fopen(filename, "w+b"))) {
+        return false;
     }
 
-    if (!apng.skipped--) {
-        apng.skipped = apng.frameskip;
-
-        if (!apng.n || memcmp(frame, apng.frame, sizeof(apng.frame))) {
-            if (!apng.n) {
-                apng.prev_time = sched_total_time(CLOCK_48M);
-            } else {
-                apng_write_delay();
-            }
-            memcpy(apng.frame, frame, sizeof(apng.frame));
-            fwrite(apng.frame, 1, sizeof(apng.frame), apng.tmp);
-            apng.n++;
-        }
+    apng->n = 0;
+    apng->remainder = 0;
+    apng->info_ptr = NULL;
+    if (!(apng->png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL)) ||
+        !(apng->info_ptr = png_create_info_struct(apng->png_ptr)) ||
+        setjmp(png_jmpbuf(apng->png_ptr))) {
+        apng_abort(apng);
+        return false;
     }
-}
+    png_init_io(apng->png_ptr, apng->file);
+
+    /* with no way to pick a palette up front, optimizing means compressing harder */
+    png_set_compression_level(apng->png_ptr, optimize ? 9 : 1);
+    png_set_IHDR(apng->png_ptr, apng->info_ptr, LCD_WIDTH, LCD_HEIGHT, 8, PNG_COLOR_TYPE_RGB_ALPHA,
+                 PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+
+    /* the frame count isn't known yet, apng_close patches it in */
+    png_set_acTL(apng->png_ptr, apng->info_ptr, 1, 0);
+    png_write_info(apng->png_ptr, apng->info_ptr);
 
-bool apng_stop(void) {
-    apng_write_delay();
-    apng.recording = false;
     return true;
 }
 
-bool apng_save(const char *filename, bool optimize) {
-    png_structp png_ptr;
-    png_infop info_ptr;
-    png_bytep dst;
+bool apng_write_frame(apng_t *apng, const uint32_t *frame, uint64_t ticks, uint64_t rate) {
+    const uint32_t *cur = frame;
+    uint32_t *prev = &apng->prev[0][0];
+    uint32_t *dst = &apng->frame[0][0];
     png_uint_16 num, den;
-    uint32_t *prev, *cur;
-    png_colorp palette;
-    png_color_16 trans;
-    FILE *f;
-    uint32_t count = ~0, pixel = 0;
-    bool have_trans = false;
-    uint32_t i, j, probe, hash;
-    int x, y;
-    struct { int x[2], y[2]; } frame;
+    uint64_t shift;
+    int logo, x, y;
+    struct { int x[2], y[2]; } rect;
 
-    if (optimize) {
-        rewind(apng.tmp);
-        memset(apng.table, 0, sizeof(apng.table));
-        have_trans = true;
-        count = 1;
-        for (i = 0; i != apng.n; i++) {
-            for (j = 0; j != LCD_SIZE; j++) {
-                size_t size = fread(&pixel, sizeof(pixel), 1, apng.tmp);
-                if (size != 1) {
-                    fclose(apng.tmp);
-                    apng.tmp = NULL;
-                    return false;
+    if (!apng->file) {
+        return false;
+    }
+    if (setjmp(png_jmpbuf(apng->png_ptr))) {
+        apng_abort(apng);
+        return false;
+    }
+
+    /* the delay has to fit in 16 bits, what gets rounded off is carried over to the next frame */
+    ticks += apng->remainder;
+    logo = ticks ? 48 - clzll(ticks) : 0;
+    shift = logo > 10 ? (uint64_t)logo : 10;
+    num = ticks >> shift;
+    den = rate >> shift;
+    apng->remainder = ticks - ((uint64_t)num << shift);
+
+    /* only the rectangle around changed pixels is written, unchanged ones inside it are transparent */
+    rect.x[0] = LCD_WIDTH - 1;
+    rect.y[0] = LCD_HEIGHT - 1;
+    rect.x[1] = rect.y[1] = 0;
+    for (y = 0; y != LCD_HEIGHT; y++) {
+        apng->row_ptrs[y] = (png_bytep)dst;
+        for (x = 0; x != LCD_WIDTH; x++) {
+            if (apng->n && !((*cur ^ *prev) & UINT32_C(0xFFFFFF))) {
+                *dst = 0;
+            } else {
+                if (rect.x[0] > x) {
+                    rect.x[0] = x;
                 }
-                if (pixel == UINT32_C(0xFFFEFEFE)) {
-                    have_trans = false;
+                if (rect.x[1] < x) {
+                    rect.x[1] = x;
                 }
-                if (count > 1 << 8) {
-                    if (have_trans) {
-                        continue;
-                    } else {
-                        break;
-                    }
+                if (rect.y[0] > y) {
+                    rect.y[0] = y;
                 }
-                hash = pixel % TABLE_SIZE;
-                probe = 1;
-                while (true) {
-                    if (!apng.table[hash]) { /* empty */
-                        apng.table[hash] = count++ << 24 | (pixel & UINT32_C(0xFFFFFF));
-                        break;
-                    }
-                    if (!((apng.table[hash] ^ pixel) & UINT32_C(0xFFFFFF))) {
-                        break;
-                    }
-                    if (!probe) {
-                        assert(count & ~0xFF);
-                        break;
-                    }
-                    hash += probe;
-                    if (hash >= TABLE_SIZE) {
-                        hash -= TABLE_SIZE;
-                    }
-                    probe += 2;
-                    if (probe >= TABLE_SIZE) {
-                        probe -= TABLE_SIZE;
-                    }
+                if (rect.y[1] < y) {
+                    rect.y[1] = y;
                 }
+                *dst = *cur | UINT32_C(0xFF000000);
+                *prev = *cur;
             }
-            fseek(apng.tmp, sizeof(num) + sizeof(den), SEEK_CUR);
+            prev++;
+            cur++;
+            dst++;
         }
     }
-    rewind(apng.tmp);
 
-    if (!(f = fopen(filename, "wb"))) {
-        fclose(apng.tmp);
-        apng.tmp = NULL;
-        return false;
+    if (rect.x[0] > rect.x[1] || rect.y[0] > rect.y[1]) {
+        rect.x[0] = rect.x[1] = rect.y[0] = rect.y[1] = 0;
     }
 
-    png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-    info_ptr = png_create_info_struct(png_ptr);
-    if (setjmp(png_jmpbuf(png_ptr))) { goto err; }
-    png_init_io(png_ptr, f);
-
-    png_set_IHDR(png_ptr, info_ptr, LCD_WIDTH, LCD_HEIGHT, count <= 1 << 1 ? 1 : count <= 1 << 2 ? 2 : count <= 1 << 4 ? 4 : 8,
-                 count <= 1 << 8 ? PNG_COLOR_TYPE_PALETTE : PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
-    if (count <= 1 << 8) {
-        palette = (png_colorp)apng.prev;
-        for (i = 0; i != TABLE_SIZE; i++) {
-            if (apng.table[i]) {
-                j = apng.table[i] >> 24;
-                palette[j].red = apng.table[i];
-                palette[j].green = apng.table[i] >> 8;
-                palette[j].blue = apng.table[i] >> 16;
-            }
+    /* Hack around libpng-apng bug that doesn't like 1 row frames */
+    if (rect.y[0] == rect.y[1]) {
+        if (rect.y[0]) {
+            --rect.y[0];
+        } else {
+            ++rect.y[1];
         }
-        palette[0].red = palette[0].green = palette[0].blue = 0; /* transparent */
-        png_set_PLTE(png_ptr, info_ptr, palette, count);
-        png_set_tRNS(png_ptr, info_ptr, &palette[0].red, 1, NULL);
-    } else if (have_trans) {
-        trans.red = trans.green = trans.blue = 0xFE; /* transparent */
-        png_set_tRNS(png_ptr, info_ptr, NULL, 0, &trans);
     }
 
-    png_set_acTL(png_ptr, info_ptr, apng.n, 0);
-    png_write_info(png_ptr, info_ptr);
-    if (count <= 1 << 8) {
-        png_set_packing(png_ptr);
-    } else {
-        png_set_filler(png_ptr, 0, PNG_FILLER_AFTER);
+    for (y = rect.y[0]; y <= rect.y[1]; y++) {
+        apng->row_ptrs[y] += rect.x[0] * sizeof(uint32_t);
     }
 
-    for (i = 0; i != apng.n; i++) {
-        if (fread(apng.frame, 1, sizeof(apng.frame), apng.tmp) != sizeof(apng.frame) ||
-            fread(&num, sizeof(num), 1, apng.tmp) != 1 ||
-            fread(&den, sizeof(den), 1, apng.tmp) != 1) { goto err; }
+    png_write_frame_head(apng->png_ptr, apng->info_ptr, &apng->row_ptrs[rect.y[0]], rect.x[1] - rect.x[0] + 1, rect.y[1] - rect.y[0] + 1,
+                         rect.x[0], rect.y[0], num, den, PNG_DISPOSE_OP_NONE, PNG_BLEND_OP_OVER);
+    png_write_image(apng->png_ptr, &apng->row_ptrs[rect.y[0]]);
+    png_write_frame_tail(apng->png_ptr, apng->info_ptr);
+    apng->n++;
 
-        frame.x[0] = LCD_WIDTH - 1;
-        frame.y[0] = LCD_HEIGHT - 1;
-        frame.x[1] = frame.y[1] = 0;
-        prev = &apng.prev[0][0];
-        cur = &apng.frame[0][0];
-	if (count <= 1 << 8) {
-            dst = (png_bytep)cur;
-            for (y = 0; y != LCD_HEIGHT; y++) {
-                apng.row_ptrs[y] = dst;
-                for (x = 0; x != LCD_WIDTH; x++) {
-                    if (i && !((*cur ^ *prev) & UINT32_C(0xFFFFFF))) {
-                        *dst++ = 0;
-                    } else {
-                        if (frame.x[0] > x) {
-                            frame.x[0] = x;
-                        }
-                        if (frame.x[1] < x) {
-                            frame.x[1] = x;
-                        }
-                        if (frame.y[0] > y) {
-                            frame.y[0] = y;
-                        }
-                        if (frame.y[1] < y) {
-                            frame.y[1] = y;
-                        }
-                        hash = *cur % TABLE_SIZE;
-                        probe = 1;
-                        while (true) {
-                            assert(apng.table[hash]);
-                            if (!((apng.table[hash] ^ *cur) & UINT32_C(0xFFFFFF))) {
-                                *dst++ = apng.table[hash] >> 24;
-                                break;
-                            }
-                            hash += probe;
-                            if (hash >= TABLE_SIZE) {
-                                hash -= TABLE_SIZE;
-                            }
-                            probe += 2;
-                            if (probe >= TABLE_SIZE) {
-                                probe -= TABLE_SIZE;
-                            }
-                        }
-                        *prev = *cur;
-                    }
-                    prev++;
-                    cur++;
-                }
-            }
+    return true;
+}
 
-            /* Hack around libpng-apng bug that doesn't like 1 row frames */
-            if (frame.y[0] == frame.y[1]) {
-                if (frame.y[0]) {
-                    --frame.y[0];
-                } else {
-                    ++frame.y[1];
-                }
-            }
+bool apng_close(apng_t *apng) {
+    uint8_t chunk[16];
+    uint32_t length, crc;
+    long offset = 8;
+    bool success;
 
-            if (frame.x[0] > frame.x[1] || frame.y[0] > frame.y[1]) {
-                frame.x[0] = frame.y[0] = 0;
-                frame.x[1] = frame.y[1] = -1;
-            }
-            for (y = frame.y[0]; y <= frame.y[1]; y++) {
-                apng.row_ptrs[y] += frame.x[0];
-            }
-        } else {
-            for (y = 0; y != LCD_HEIGHT; y++) {
-                apng.row_ptrs[y] = (png_bytep)cur;
-                for (x = 0; x != LCD_WIDTH; x++) {
-                    if (i && !((*cur ^ *prev) & UINT32_C(0xFFFFFF))) {
-                        if (have_trans) {
-                            *cur = trans.red << 16 | trans.green << 8 | trans.blue;
-                        }
-                    } else {
-                        if (frame.x[0] > x) {
-                            frame.x[0] = x;
-                        }
-                        if (frame.x[1] < x) {
-                            frame.x[1] = x;
-                        }
-                        if (frame.y[0] > y) {
-                            frame.y[0] = y;
-                        }
-                        if (frame.y[1] < y) {
-                            frame.y[1] = y;
-                        }
-                        *prev = *cur;
-                    }
-                    prev++;
-                    cur++;
-                }
-            }
+    if (!apng->file) {
+        return false;
+    }
+    if (setjmp(png_jmpbuf(apng->png_ptr))) {
+        apng_abort(apng);
+        return false;
+    }
 
-            /* Hack around libpng-apng bug that doesn't like 1 row frames */
-            if (frame.y[0] == frame.y[1]) {
-                if (frame.y[0]) {
-                    --frame.y[0];
-                } else {
-                    ++frame.y[1];
-                }
-            }
+    /* png_write_end would insist on the placeholder frame count, so end the file directly */
+    success = apng->n != 0;
+    if (success) {
+        png_write_chunk(apng->png_ptr, (png_const_bytep)"IEND", NULL, 0);
+    }
+    png_destroy_write_struct(&apng->png_ptr, &apng->info_ptr);
 
-            if (frame.x[0] > frame.x[1] || frame.y[0] > frame.y[1]) {
-                frame.x[0] = frame.y[0] = 0;
-                frame.x[1] = frame.y[1] = -1;
-            }
-            for (y = frame.y[0]; y <= frame.y[1]; y++) {
-                apng.row_ptrs[y] += frame.x[0] * sizeof(uint32_t);
-            }
+    /* walk the chunks up to acTL, then rewrite its frame count and crc */
+    while (success) {
+        if (fseek(apng->file, offset, SEEK_SET) || fread(chunk, 1, 8, apng->file) != 8 || !memcmp(&chunk[4], "IDAT", 4)) {
+            success = false;
+            break;
         }
-
-        png_write_frame_head(png_ptr, info_ptr, &apng.row_ptrs[frame.y[0]], frame.x[1] - frame.x[0] + 1, frame.y[1] - frame.y[0] + 1,
-                             frame.x[0], frame.y[0], num, den, PNG_DISPOSE_OP_NONE, PNG_BLEND_OP_OVER);
-        png_write_image(png_ptr, &apng.row_ptrs[frame.y[0]]);
-        png_write_frame_tail(png_ptr, info_ptr);
+        length = (uint32_t)chunk[0] << 24 | (uint32_t)chunk[1] << 16 | (uint32_t)chunk[2] << 8 | chunk[3];
+        if (!memcmp(&chunk[4], "acTL", 4)) {
+            memcpy(&chunk[0], "acTL", 4);
+            chunk[4] = apng->n >> 24;
+            chunk[5] = apng->n >> 16;
+            chunk[6] = apng->n >> 8;
+            chunk[7] = apng->n;
+            memset(&chunk[8], 0, 4);
+            crc = apng_crc(chunk, 12);
+            chunk[12] = crc >> 24;
+            chunk[13] = crc >> 16;
+            chunk[14] = crc >> 8;
+            chunk[15] = crc;
+            success = !fseek(apng->file, offset + 4, SEEK_SET) && fwrite(chunk, 1, sizeof(chunk), apng->file) == sizeof(chunk);
+            break;
+        }
+        offset += 12 + (long)length;
     }
-    png_write_end(png_ptr, info_ptr);
-
-err:
-    png_destroy_write_struct(&png_ptr, &info_ptr);
-    fclose(f);
 
-    fclose(apng.tmp);
-    apng.tmp = NULL;
+    success &= !fclose(apng->file);
+    apng->file = NULL;
 
-    return true;
+    return success;
 }
 
 #endif
@@ -17,23 +17,20 @@ extern "C" {
 
 #ifdef PNG_WRITE_APNG_SUPPORTED
 
-#define TABLE_SIZE 521 /* should be a prime >= 256*2 */
-
+/* frames are written as they come, only the frame count in the acTL chunk is patched when closing */
 typedef struct {
-    FILE *tmp;
+    FILE *file;
+    png_structp png_ptr;
+    png_infop info_ptr;
     uint32_t n;
-    bool recording;
-    unsigned int frameskip;
-    unsigned int skipped;
-    uint32_t table[TABLE_SIZE], frame[LCD_HEIGHT][LCD_WIDTH], prev[LCD_HEIGHT][LCD_WIDTH];
-    uint64_t prev_time;
+    uint64_t remainder;
+    uint32_t frame[LCD_HEIGHT][LCD_WIDTH], prev[LCD_HEIGHT][LCD_WIDTH];
     png_bytep row_ptrs[LCD_HEIGHT];
 } apng_t;
 
-bool apng_start(const char *tmp_name, int frameskip);
-void apng_add_frame(const void *frame);
-bool apng_stop(void);
-bool apng_save(const char *filename, bool optimize);
+bool apng_open(apng_t *apng, const char *filename, bool optimize);
+bool apng_write_frame(apng_t *apng, const uint32_t *frame, uint64_t ticks, uint64_t rate); /* frame shown for ticks of a clock running at rate */
+bool apng_close(apng_t *apng);
 
 #endif
 
@@ -0,0 +1,174 @@
+#include "recorder.h"
+
+#include "../../../core/schedule.h"
+
+#include <QtCore/QFile>
+#include <QtCore/QMutexLocker>
+
+#include <cmath>
+#include <cstring>
+
+QMutex Recorder::m_activeMutex;
+Recorder *Recorder::m_active = Q_NULLPTR;
+
+Recorder::Recorder(QObject *parent) : QThread{parent}, m_free{RECORDER_QUEUE_SIZE} {
+#ifdef PNG_WRITE_APNG_SUPPORTED
+    m_apng.file = Q_NULLPTR;
+#endif
+    m_y4m.file = Q_NULLPTR;
+}
+
+Recorder::~Recorder() {
+    stop();
+    wait();
+    close();
+}
+
+bool Recorder::record(const QString &filename, Format format, bool optimize, int frameskip) {
+    m_path = filename.toLocal8Bit();
+    m_format = format;
+    if (format == Format::Y4m) {
+        // y4m needs a constant frame rate, use the one the lcd is configured for
+        uint64_t period = static_cast<uint64_t>(lcd.PCD) * (lcd.HSW + lcd.HBP + lcd.CPL + lcd.HFP) *
+                          (lcd.VSW + lcd.VBP + lcd.LPP + lcd.VFP) * static_cast<unsigned int>(frameskip + 1);
+        if (period && period <= UINT32_MAX) {
+            m_y4mNum = 24000000;
+            m_y4mDen = static_cast<uint32_t>(period);
+        }
+        if (!y4m_open(&m_y4m, m_path.constData(), m_y4mNum, m_y4mDen)) {
+            return false;
+        }
+    } else {
+#ifdef PNG_WRITE_APNG_SUPPORTED
+        if (!apng_open(&m_apng, m_path.constData(), optimize)) {
+            return false;
+        }
+#else
+        (void)optimize;
+        return false;
+#endif
+    }
+
+    m_frameskip = static_cast<unsigned int>(frameskip);
+    m_skip = 0;
+    start();
+
+    QMutexLocker locker(&m_activeMutex);
+    m_active = this;
+    return true;
+}
+
+// the end of the last frame isn't known, so it is assumed to last as long as the one before it
+void Recorder::stop() {
+    {
+        QMutexLocker locker(&m_activeMutex);
+        if (m_active != this) {
+            return;
+        }
+        m_active = Q_NULLPTR;
+    }
+
+    m_free.acquire();
+    Slot &slot = m_slots[m_writePos];
+    slot.time = m_lastTime + m_interval;
+    slot.last = true;
+    m_used.release();
+}
+
+void Recorder::addFrame(const uint32_t *frame) {
+    QMutexLocker locker(&m_activeMutex);
+    Recorder *recorder = m_active;
+
+    if (!recorder) {
+        return;
+    }
+    if (recorder->m_skip) {
+        recorder->m_skip--;
+        return;
+    }
+    recorder->m_skip = recorder->m_frameskip;
+
+    uint64_t time = sched_total_time(CLOCK_48M);
+    if (recorder->m_haveTime) {
+        recorder->m_interval = time - recorder->m_lastTime;
+    } else {
+        recorder->m_rate = sched.clockRates[CLOCK_48M];
+        recorder->m_haveTime = true;
+    }
+    recorder->m_lastTime = time;
+
+    if (!recorder->m_free.tryAcquire()) {
+        recorder->m_dropped++;
+        return;
+    }
+    Slot &slot = recorder->m_slots[recorder->m_writePos];
+    memcpy(slot.pixels, frame, sizeof(slot.pixels));
+    slot.time = time;
+    slot.last = false;
+    recorder->m_writePos = (recorder->m_writePos + 1) % RECORDER_QUEUE_SIZE;
+    recorder->m_used.release();
+}
+
+bool Recorder::writeFrame(const uint32_t *frame, uint64_t ticks) {
+#ifdef PNG_WRITE_APNG_SUPPORTED
+    if (m_format == Format::Apng) {
+        return apng_write_frame(&m_apng, frame, ticks, m_rate);
+    }
+#endif
+
+    // repeat the frame for as many slots as it covers at the fixed rate
+    m_y4mElapsed += ticks;
+    uint64_t target = static_cast<uint64_t>(std::llround(static_cast<double>(m_y4mElapsed) * m_y4mNum / (static_cast<double>(m_y4mDen) * m_rate)));
+    uint32_t count = target > m_y4mWritten ? static_cast<uint32_t>(target - m_y4mWritten) : 0;
+    m_y4mWritten += count;
+    return y4m_write_frame(&m_y4m, frame, count);
+}
+
+bool Recorder::close() {
+#ifdef PNG_WRITE_APNG_SUPPORTED
+    if (m_format == Format::Apng) {
+        return apng_close(&m_apng);
+    }
+#endif
+    return y4m_close(&m_y4m);
+}
+
+// identical frames are merged into one longer frame before being encoded
+void Recorder::run() {
+    bool success = true;
+    bool pending = false;
+    uint64_t pendingTime = 0;
+
+    for (;;) {
+        m_used.acquire();
+        const Slot &slot = m_slots[m_readPos];
+        m_readPos = (m_readPos + 1) % RECORDER_QUEUE_SIZE;
+
+        if (slot.last) {
+            if (pending) {
+                success &= writeFrame(m_pending, slot.time - pendingTime);
+            }
+            m_free.release();
+            break;
+        }
+
+        if (!pending || memcmp(slot.pixels, m_pending, sizeof(m_pending))) {
+            if (pending) {
+                success &= writeFrame(m_pending, slot.time - pendingTime);
+            }
+            memcpy(m_pending, slot.pixels, sizeof(m_pending));
+            pendingTime = slot.time;
+            pending = true;
+        }
+        m_free.release();
+    }
+
+    success &= close();
+    success &= pending;
+
+    // an empty or partly written file isn't a usable recording
+    if (!success) {
+        QFile::remove(QString::fromLocal8Bit(m_path));
+    }
+    emit done(success);
+}
@@ -0,0 +1,86 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include "animated-png.h"
+#include "y4m.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QMutex>
+#include <QtCore/QSemaphore>
+#include <QtCore/QString>
+#include <QtCore/QThread>
+
+#define RECORDER_QUEUE_SIZE 8
+
+// encodes lcd frames to a file on its own thread while the emulation keeps running
+// the emu thread only copies frames into a small queue, frames are dropped if the encoder falls behind
+// y4m is always available, apng only when libpng supports it
+class Recorder : public QThread {
+    Q_OBJECT
+
+public:
+    enum class Format {
+        Apng,
+        Y4m
+    };
+
+    explicit Recorder(QObject *parent = Q_NULLPTR);
+    ~Recorder() Q_DECL_OVERRIDE;
+
+    bool record(const QString &filename, Format format, bool optimize, int frameskip);
+    void stop();
+    unsigned int dropped() const { return m_dropped; }
+
+    // called by the emu thread for every drawn frame
+    static void addFrame(const uint32_t *frame);
+
+signals:
+    void done(bool success);
+
+protected:
+    void run() Q_DECL_OVERRIDE;
+
+private:
+    struct Slot {
+        uint32_t pixels[LCD_SIZE];
+        uint64_t time;
+        bool last;
+    };
+
+    bool writeFrame(const uint32_t *frame, uint64_t ticks);
+    bool close();
+
+    static QMutex m_activeMutex;
+    static Recorder *m_active;
+
+    Format m_format = Format::Y4m;
+    QByteArray m_path;
+#ifdef PNG_WRITE_APNG_SUPPORTED
+    apng_t m_apng;
+#endif
+    y4m_t m_y4m;
+    uint32_t m_y4mNum = 60;
+    uint32_t m_y4mDen = 1;
+    uint64_t m_y4mElapsed = 0;
+    uint64_t m_y4mWritten = 0;
+    uint64_t m_rate = 0;
+
+    // producer side, only touched under m_activeMutex or after the recorder was deactivated
+    unsigned int m_frameskip = 0;
+    unsigned int m_skip = 0;
+    unsigned int m_dropped = 0;
+    unsigned int m_writePos = 0;
+    bool m_haveTime = false;
+    uint64_t m_lastTime = 0;
+    uint64_t m_interval = 0;
+
+    // consumer side
+    unsigned int m_readPos = 0;
+    uint32_t m_pending[LCD_SIZE];
+
+    Slot m_slots[RECORDER_QUEUE_SIZE];
+    QSemaphore m_free;
+    QSemaphore m_used;
+};
+
+#endif
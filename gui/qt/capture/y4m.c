@@ -0,0 +1,50 @@
+#include "y4m.h"
+
+bool y4m_open(y4m_t *y4m, const char *filename, uint32_t rate_num, uint32_t rate_den) {
+    if (!(y4m->file = fopen(filename, "wb"))) {
+        return false;
+    }
+    if (fprintf(y4m->file, "YUV4MPEG2 W%u H%u F%u:%u Ip A1:1 C444\n", LCD_WIDTH, LCD_HEIGHT, rate_num, rate_den) < 0) {
+        y4m_close(y4m);
+        return false;
+    }
+    return true;
+}
+
+bool y4m_write_frame(y4m_t *y4m, const uint32_t *frame, uint32_t count) {
+    unsigned int i;
+
+    if (!y4m->file) {
+        return false;
+    }
+
+    /* bt.601 studio range */
+    for (i = 0; i != LCD_SIZE; i++) {
+        int r = frame[i] >> 0 & 0xFF;
+        int g = frame[i] >> 8 & 0xFF;
+        int b = frame[i] >> 16 & 0xFF;
+        y4m->planes[0][i] = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+        y4m->planes[1][i] = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+        y4m->planes[2][i] = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+    }
+
+    while (count--) {
+        if (fwrite("FRAME\n", 1, 6, y4m->file) != 6 ||
+            fwrite(y4m->planes, 1, sizeof(y4m->planes), y4m->file) != sizeof(y4m->planes)) {
+            y4m_close(y4m);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool y4m_close(y4m_t *y4m) {
+    bool success;
+
+    if (!y4m->file) {
+        return false;
+    }
+    success = !fclose(y4m->file);
+    y4m->file = NULL;
+    return success;
+}
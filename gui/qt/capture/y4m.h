@@ -0,0 +1,28 @@
+#ifndef Y4M_H
+#define Y4M_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "../../../core/lcd.h"
+
+/* uncompressed 4:4:4 yuv video, readable by ffmpeg and most players */
+typedef struct {
+    FILE *file;
+    uint8_t planes[3][LCD_SIZE];
+} y4m_t;
+
+bool y4m_open(y4m_t *y4m, const char *filename, uint32_t rate_num, uint32_t rate_den);
+bool y4m_write_frame(y4m_t *y4m, const uint32_t *frame, uint32_t count); /* frame is repeated count times */
+bool y4m_close(y4m_t *y4m);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
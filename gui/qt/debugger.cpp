@@ -393,8 +393,7 @@ void MainWindow::debugCommand(int reason, uint32_t data) {
                 emu.resume();
                 return;
             } else {
-                debug.stepBasic = false;
-                debug.stepBasicNext = false;
+                debug_clear_basic_step();
                 prevReason = reason;
                 return;
             }
@@ -2808,6 +2807,7 @@ void MainWindow::setCalcId() {
         if (ok && id.length() == 10) {
             QByteArray ba = QByteArray::fromHex(id.toLatin1());
             memcpy(ptr, ba.data(), subSize);
+            mem_invalidate_ptr(ptr, subSize);
         }
     }
 }
@@ -11,6 +11,7 @@
 
 #include <QtCore/QVector>
 
+#include <algorithm>
 #include <cassert>
 #include <cstdarg>
 #include <thread>
@@ -53,9 +54,29 @@ EmuThread::EmuThread(QObject *parent) : QThread{parent}, write{CONSOLE_BUFFER_SI
     emu = this;
 }
 
+EmuThread::~EmuThread() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutexRewind);
+        m_rewindQuit = true;
+    }
+    m_cvRewind.notify_all();
+    if (m_rewindThread.joinable()) {
+        m_rewindThread.join();
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutexSave);
+        m_saveQuit = true;
+    }
+    m_cvSave.notify_all();
+    if (m_saveThread.joinable()) {
+        m_saveThread.join();
+    }
+}
+
 void EmuThread::run() {
     while (cpu.abort != CPU_ABORT_EXIT) {
         emu_run(1u);
+        rewindCapture();
         doStuff();
         throttleWait();
     }
@@ -150,11 +171,18 @@ void EmuThread::doStuff() {
                 debug_open(DBG_BASIC_USER, 0);
                 break;
             case RequestSave:
-                emit saved(emu_save(m_saveType, m_savePath.toStdString().c_str()));
+                if (m_saveType == EMU_DATA_IMAGE) {
+                    saveImage(m_savePath);
+                } else {
+                    emit saved(emu_save(m_saveType, m_savePath.toStdString().c_str()));
+                }
                 break;
             case RequestLoad:
                 emit loaded(emu_load(m_loadType, m_loadPath.toStdString().c_str()), m_loadType);
                 break;
+            case RequestRewind:
+                rewindRestore();
+                break;
             case RequestAutoTester:
                 uint32_t run_rate_prev = emu_get_run_rate();
                 emu_set_run_rate(1000);
@@ -242,17 +270,32 @@ void EmuThread::sendFiles() {
         utf8Vars.push_back(string.toUtf8());
         args.push_back(utf8Vars.back());
     }
-    m_backupThrottleForTransfers = m_throttle;
-    setThrottle(false);
+    {
+        std::unique_lock<std::mutex> lockSpeed(m_mutexSpeed);
+        m_backupThrottleForTransfers = m_throttle;
+        m_throttle = false;
+        emu_set_link_turbo(m_linkTurbo);
+    }
+    m_sendBytes = 0;
+    m_sendStart = std::chrono::steady_clock::now();
     emu_send_variables(args.data(), args.size(), m_sendLoc, &EmuThread::progressHandler, this);
 }
 
 bool EmuThread::progressHandler(void *context, int value, int total) {
     EmuThread* emuThread = reinterpret_cast<EmuThread *>(context);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - emuThread->m_sendStart;
+    int rate = 0;
     if (value == 1 && total == 1) {
         emuThread->setThrottle(emuThread->m_backupThrottleForTransfers);
+        if (emuThread->m_sendBytes && elapsed.count() > 0) {
+            gui_console_printf("[CEmu] Sent %d bytes in %.2f seconds (%.1f KiB/s).\n", emuThread->m_sendBytes,
+                               elapsed.count(), emuThread->m_sendBytes / elapsed.count() / 1024);
+        }
+    } else if (total && elapsed.count() > 0) {
+        emuThread->m_sendBytes = value;
+        rate = static_cast<int>(value / elapsed.count());
     }
-    emit emuThread->linkProgress(value, total);
+    emit emuThread->linkProgress(value, total, rate);
     return false;
 }
 
@@ -280,6 +323,234 @@ void EmuThread::save(emu_data_t fileType, const QString &filePath) {
     req(RequestSave);
 }
 
+void EmuThread::setRewind(bool state, int interval, int limit) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutexRewind);
+        m_rewindInterval = state ? std::max(interval, 1) : 0;
+        m_rewindLimit = static_cast<size_t>(std::max(limit, 1)) << 20;
+        if (!state) {
+            rewindClear();
+        }
+        if (state && !m_rewindThread.joinable()) {
+            m_rewindThread = std::thread(&EmuThread::rewindWorker, this);
+        }
+    }
+    emit rewindChanged(0);
+}
+
+void EmuThread::rewind(int steps) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutexRewind);
+        m_rewindSteps = steps;
+    }
+    req(RequestRewind);
+}
+
+// must hold m_mutexRewind
+void EmuThread::rewindClear() {
+    m_rewindGeneration++;
+    m_rewindPending.clear();
+    m_rewindStates.clear();
+    m_rewindBytes = 0;
+}
+
+// must hold m_mutexRewind, starts a segment with a full snapshot of the new base
+bool EmuThread::rewindRebase() {
+    size_t size;
+
+    if (!emu_snapshot_set_base() || !(size = emu_snapshot_size())) {
+        return false;
+    }
+    QByteArray state(static_cast<int>(size), Qt::Uninitialized);
+    if (!emu_snapshot_save(state.data(), size)) {
+        return false;
+    }
+    m_rewindSegment++;
+    m_rewindDeltas = 0;
+    m_rewindFullSize = size;
+    m_rewindPending.push_back({std::move(state), m_rewindSegment, true});
+    return true;
+}
+
+void EmuThread::rewindCapture() {
+    size_t size;
+    unsigned int segment;
+    {
+        std::lock_guard<std::mutex> lock(m_mutexRewind);
+        if (!m_rewindInterval || ++m_rewindFrame < m_rewindInterval) {
+            return;
+        }
+        m_rewindFrame = 0;
+
+        // rather skip a capture than stall emulation when compression can't keep up
+        if (m_rewindPending.size() > 1) {
+            return;
+        }
+
+        // loading a state or rom drops the base, so the old deltas are useless
+        size = emu_snapshot_delta_size();
+        if (!size) {
+            rewindClear();
+        }
+
+        // deltas grow with every page written since the base, so start over from a new one
+        if (!size || m_rewindDeltas >= RewindSegmentDeltas || size > m_rewindFullSize / 4) {
+            if (rewindRebase()) {
+                m_cvRewind.notify_one();
+            }
+            return;
+        }
+        m_rewindDeltas++;
+        segment = m_rewindSegment;
+    }
+
+    QByteArray state(static_cast<int>(size), Qt::Uninitialized);
+    if (!emu_snapshot_save_delta(state.data(), size)) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutexRewind);
+        m_rewindPending.push_back({std::move(state), segment, false});
+    }
+    m_cvRewind.notify_one();
+}
+
+void EmuThread::rewindWorker() {
+    std::unique_lock<std::mutex> lock(m_mutexRewind);
+    while (true) {
+        m_cvRewind.wait(lock, [this]{ return m_rewindQuit || !m_rewindPending.empty(); });
+        if (m_rewindQuit) {
+            break;
+        }
+        RewindState state = std::move(m_rewindPending.front());
+        unsigned int generation = m_rewindGeneration;
+        m_rewindPending.pop_front();
+
+        lock.unlock();
+        state.data = qCompress(state.data, 1);
+        lock.lock();
+
+        if (generation != m_rewindGeneration || state.data.isEmpty()) {
+            continue;
+        }
+        m_rewindBytes += static_cast<size_t>(state.data.size());
+        m_rewindStates.push_back(std::move(state));
+
+        // deltas need the full snapshot their segment starts with, so drop whole segments but the last one
+        while (m_rewindBytes > m_rewindLimit && m_rewindStates.front().segment != m_rewindStates.back().segment) {
+            unsigned int oldest = m_rewindStates.front().segment;
+            while (m_rewindStates.front().segment == oldest) {
+                m_rewindBytes -= static_cast<size_t>(m_rewindStates.front().data.size());
+                m_rewindStates.pop_front();
+            }
+        }
+        emit rewindChanged(static_cast<int>(m_rewindStates.size()));
+    }
+}
+
+// only the capture stalls emulation, saved is emitted once the image is on disk
+void EmuThread::saveImage(const QString &path) {
+    image_t *capture;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutexSave);
+        emu_set_image_mappable(m_imageMappable);
+    }
+    capture = emu_save_capture(path.toStdString().c_str());
+    if (!capture) {
+        emit saved(false);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutexSave);
+        m_savePending.emplace_back(capture, path);
+        if (!m_saveThread.joinable()) {
+            m_saveThread = std::thread(&EmuThread::saveWorker, this);
+        }
+    }
+    m_cvSave.notify_all();
+}
+
+// loading the file being written would see half an image
+void EmuThread::saveWait() {
+    std::unique_lock<std::mutex> lock(m_mutexSave);
+    m_cvSave.wait(lock, [this]{ return m_savePending.empty() && !m_saveBusy; });
+}
+
+void EmuThread::saveWorker() {
+    std::unique_lock<std::mutex> lock(m_mutexSave);
+    while (true) {
+        m_cvSave.wait(lock, [this]{ return m_saveQuit || !m_savePending.empty(); });
+        // finish writing everything before quitting
+        if (m_savePending.empty()) {
+            break;
+        }
+        std::pair<image_t*, QString> pending = std::move(m_savePending.front());
+        m_savePending.pop_front();
+        m_saveBusy = true;
+
+        lock.unlock();
+        bool success = emu_save_finish(pending.first, pending.second.toStdString().c_str());
+        emit saved(success);
+        lock.lock();
+
+        m_saveBusy = false;
+        m_cvSave.notify_all();
+    }
+}
+
+void EmuThread::rewindRestore() {
+    RewindState state;
+    QByteArray base;
+    bool restored;
+    int count;
+    {
+        std::lock_guard<std::mutex> lock(m_mutexRewind);
+        int steps = std::min(m_rewindSteps, static_cast<int>(m_rewindStates.size()));
+        if (steps <= 0) {
+            return;
+        }
+
+        // everything newer than the restored state is a future that no longer happens
+        m_rewindGeneration++;
+        m_rewindPending.clear();
+        while (steps--) {
+            state = std::move(m_rewindStates.back());
+            m_rewindBytes -= static_cast<size_t>(state.data.size());
+            m_rewindStates.pop_back();
+        }
+        // segments are only dropped whole, so a delta's full snapshot is still the first of its segment
+        if (!state.full) {
+            auto first = std::find_if(m_rewindStates.begin(), m_rewindStates.end(),
+                                      [&state](const RewindState &other) { return other.segment == state.segment; });
+            if (first != m_rewindStates.end() && first->full) {
+                base = first->data;
+            }
+        }
+        // the restored state may have been the full snapshot, so start a new segment
+        m_rewindDeltas = RewindSegmentDeltas;
+        m_rewindFrame = 0;
+        count = static_cast<int>(m_rewindStates.size());
+    }
+
+    state.data = qUncompress(state.data);
+    if (state.full) {
+        restored = !state.data.isEmpty() &&
+                   emu_snapshot_restore(state.data.constData(), static_cast<size_t>(state.data.size()));
+    } else {
+        base = qUncompress(base);
+        restored = !state.data.isEmpty() && !base.isEmpty() &&
+                   emu_snapshot_restore_delta_from(base.constData(), static_cast<size_t>(base.size()),
+                                                   state.data.constData(), static_cast<size_t>(state.data.size()));
+    }
+    if (!restored) {
+        gui_console_err_printf("[CEmu] Rewind failed.\n");
+    }
+    emit rewindChanged(count);
+}
+
 void EmuThread::setSpeed(int value) {
     {
         std::unique_lock<std::mutex> lockSpeed(m_mutexSpeed);
@@ -295,6 +566,17 @@ void EmuThread::setThrottle(bool state) {
     m_throttle = state;
 }
 
+void EmuThread::setLinkTurbo(bool state) {
+    std::unique_lock<std::mutex> lockSpeed(m_mutexSpeed);
+    m_linkTurbo = state;
+}
+
+// takes effect with the next saved image
+void EmuThread::setImageMappable(bool state) {
+    std::lock_guard<std::mutex> lock(m_mutexSave);
+    m_imageMappable = state;
+}
+
 void EmuThread::debugOpen(int reason, uint32_t data) {
     std::unique_lock<std::mutex> lock(m_mutexDebug);
     m_debug = true;
@@ -330,6 +612,7 @@ void EmuThread::load(emu_data_t fileType, const QString &filePath) {
     if (fileType == EMU_DATA_IMAGE || fileType == EMU_DATA_ROM) {
         setTerminationEnabled();
         stop();
+        saveWait();
 
         emit loaded(emu_load(fileType, filePath.toStdString().c_str()), fileType);
     } else if (fileType == EMU_DATA_RAM) {
@@ -5,6 +5,7 @@
 #include "../../core/emu.h"
 #include "../../core/link.h"
 
+#include <QtCore/QByteArray>
 #include <QtCore/QMutex>
 #include <QtCore/QQueue>
 #include <QtCore/QSemaphore>
@@ -13,6 +14,9 @@
 
 #include <chrono>
 #include <condition_variable>
+#include <deque>
+#include <thread>
+#include <utility>
 
 #define CONSOLE_BUFFER_SIZE 512
 
@@ -21,6 +25,7 @@ class EmuThread : public QThread {
 
 public:
     explicit EmuThread(QObject *parent = Q_NULLPTR);
+    ~EmuThread();
     void stop();
     void reset();
     void resume();
@@ -31,12 +36,16 @@ public:
     void throttleWait();
     void setSpeed(int value);
     void setThrottle(bool state);
+    void setLinkTurbo(bool state);
+    void setImageMappable(bool state);
     void writeConsole(int console, const char *format, va_list args);
     void debugOpen(int reason, uint32_t addr);
     void save(emu_data_t fileType, const QString &filePath);
     void setRam(const QString &path);
     void load(emu_data_t fileType, const QString &filePath);
     void test(const QString &config, bool run);
+    void setRewind(bool state, int interval, int limit);
+    void rewind(int steps);
 
     enum {
         ConsoleNorm,
@@ -54,7 +63,8 @@ public:
         RequestCancelTransfer,
         RequestAutoTester,
         RequestDebugger,
-        RequestBasicDebugger
+        RequestBasicDebugger,
+        RequestRewind
     };
 
     int type = ConsoleNorm;
@@ -81,7 +91,8 @@ signals:
     void saved(bool success);
     void loaded(emu_state_t state, emu_data_t type);
     void blocked(int req);
-    void linkProgress(int value, int total);
+    void linkProgress(int value, int total, int rate);
+    void rewindChanged(int count);
 
 public slots:
     void send(const QStringList &names, int location);
@@ -95,6 +106,14 @@ private:
 
     void sendFiles();
     static bool progressHandler(void *context, int value, int amount);
+    void rewindCapture();
+    void rewindRestore();
+    void rewindClear();
+    bool rewindRebase();
+    void rewindWorker();
+    void saveImage(const QString &path);
+    void saveWait();
+    void saveWorker();
 
     void req(int req) {
         m_reqQueue.enqueue(req);
@@ -112,6 +131,7 @@ private:
 
     int m_speed, m_actualSpeed;
     bool m_throttle, m_backupThrottleForTransfers;
+    bool m_linkTurbo = false; // protected by m_mutexSpeed
     std::chrono::steady_clock::time_point m_lastTime;
     std::mutex m_mutexSpeed;
     std::condition_variable m_cvSpeed;
@@ -125,6 +145,8 @@ private:
     QString m_loadPath;
     QStringList m_vars;
     int m_sendLoc;
+    int m_sendBytes;
+    std::chrono::steady_clock::time_point m_sendStart;
 
     std::mutex m_mutex;
     std::condition_variable m_cv;
@@ -133,6 +155,39 @@ private:
 
     QQueue<quint16> m_keyQueue;
     QMutex m_keyQueueMutex;
+
+    // delta snapshots are taken every m_rewindInterval frames and compressed by m_rewindThread
+    // every segment starts with a full snapshot taken when the base was set, deltas restore on top of it
+    struct RewindState {
+        QByteArray data;
+        unsigned int segment;
+        bool full;
+    };
+    static const int RewindSegmentDeltas = 60; // at most, before the next full snapshot
+    int m_rewindInterval = 0; // 0 if disabled, protected by m_mutexRewind
+    int m_rewindFrame = 0;
+    int m_rewindDeltas = 0; // taken since the base was set, protected by m_mutexRewind
+    size_t m_rewindFullSize = 0; // of the last full snapshot, protected by m_mutexRewind
+    unsigned int m_rewindSegment = 0; // protected by m_mutexRewind
+    int m_rewindSteps = 0; // protected by m_mutexRewind
+    unsigned int m_rewindGeneration = 0; // protected by m_mutexRewind
+    bool m_rewindQuit = false; // protected by m_mutexRewind
+    size_t m_rewindLimit = 0; // protected by m_mutexRewind
+    size_t m_rewindBytes = 0; // protected by m_mutexRewind
+    std::deque<RewindState> m_rewindPending; // protected by m_mutexRewind
+    std::deque<RewindState> m_rewindStates; // oldest first, protected by m_mutexRewind
+    std::thread m_rewindThread;
+    std::mutex m_mutexRewind;
+    std::condition_variable m_cvRewind; // protected by m_mutexRewind
+
+    // images are captured on this thread, then compressed, written and synced by m_saveThread
+    bool m_saveQuit = false; // protected by m_mutexSave
+    bool m_saveBusy = false; // protected by m_mutexSave
+    bool m_imageMappable = false; // protected by m_mutexSave
+    std::deque<std::pair<image_t*, QString>> m_savePending; // protected by m_mutexSave
+    std::thread m_saveThread;
+    std::mutex m_mutexSave;
+    std::condition_variable m_cvSave; // protected by m_mutexSave
 };
 
 #endif
@@ -1,7 +1,7 @@
 #include "lcdwidget.h"
 #include "sendinghandler.h"
 #include "keypad/qtkeypadbridge.h"
-#include "capture/animated-png.h"
+#include "capture/recorder.h"
 #include "utils.h"
 #include "../../core/link.h"
 #include "../../core/lcd.h"
@@ -17,11 +17,14 @@
 #include <QtWidgets/QMenu>
 #include <QtWidgets/QApplication>
 
+// the widget reads lcd state while painting on the gui thread, which a per thread core would hide from it
+#ifdef MULTI_INSTANCE
+#error "the Qt gui needs the core built without MULTI_INSTANCE"
+#endif
+
 LCDWidget::LCDWidget(QWidget *parent) : QWidget{parent} {
     installEventFilter(keypadBridge);
-    m_mutex.lock();
-    m_image = QImage(LCD_WIDTH, LCD_HEIGHT, QImage::Format_RGBX8888);
-    m_mutex.unlock();
+    emu_lcd_frames_init(&m_frames);
 }
 
 void LCDWidget::paintEvent(QPaintEvent*) {
@@ -35,9 +38,8 @@ void LCDWidget::paintEvent(QPaintEvent*) {
     // Interpolation only for < 100% scale
     c.setRenderHint(QPainter::SmoothPixmapTransform, cw.width() < LCD_WIDTH);
     if ((control.ports[5] & 1 << 4) && (lcd.control & 1 << 11)) {
-        m_mutex.lock();
-        c.drawImage(cw, m_image);
-        m_mutex.unlock();
+        const uint32_t *frame = emu_lcd_frames_front(&m_frames, Q_NULLPTR);
+        c.drawImage(cw, QImage(reinterpret_cast<const uchar*>(frame), LCD_WIDTH, LCD_HEIGHT, QImage::Format_RGBX8888));
         if (backlight.factor < 1) {
             c.fillRect(cw, QColor(0, 0, 0, (1 - backlight.factor) * 255));
         }
@@ -132,6 +134,7 @@ void LCDWidget::mouseMoveEvent(QMouseEvent *e) {
 }
 
 double LCDWidget::refresh() {
+    m_pending = false;
     unsigned int msNFramesAgo = m_array[m_index];
     m_array[m_index] = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
     double guiFps = (1e3*ArraySize) / (m_array[m_index] - msNFramesAgo);
@@ -141,9 +144,7 @@ double LCDWidget::refresh() {
 }
 
 void LCDWidget::setMain() {
-    m_mutex.lock();
-    m_image.fill(Qt::black);
-    m_mutex.unlock();
+    emu_lcd_frames_init(&m_frames);
     emu_set_lcd_callback([](void *lcd) { reinterpret_cast<LCDWidget*>(lcd)->draw(); }, this);
 }
 
@@ -157,19 +158,29 @@ void LCDWidget::setFrameskip(int value) {
 }
 
 // called by the emu thread to draw the lcd
+// only damaged rows are converted, and frames go through the triple buffer so neither thread waits on the other
+// an update is queued only when something visible changed and the last one was handled
 void LCDWidget::draw() {
     if (m_skip) {
         m_skip--;
     } else {
         m_skip = m_frameskip;
-        m_mutex.lock();
-        emu_lcd_drawframe(m_image.bits());
-        m_mutex.unlock();
-#ifdef PNG_WRITE_APNG_SUPPORTED
-        apng_add_frame(m_image.constBits());
-#endif
-        double guiFps = 24e6 / (lcd.PCD * (lcd.HSW + lcd.HBP + lcd.CPL + lcd.HFP) * (lcd.VSW + lcd.VBP + lcd.LPP + lcd.VFP));
-        emit updateLcd(guiFps / (m_frameskip + 1));
+        lcd_damage_t damage;
+        bool shown = (control.ports[5] & 1 << 4) && (lcd.control & 1 << 11);
+        emu_lcd_drawframe_damage(m_frame, &damage);
+        Recorder::addFrame(m_frame);
+        if (damage.count) {
+            memcpy(emu_lcd_frames_back(&m_frames), m_frame, sizeof(m_frame));
+            emu_lcd_frames_publish(&m_frames);
+        } else if (shown == m_shown && backlight.factor == m_shownFactor) {
+            return;
+        }
+        m_shown = shown;
+        m_shownFactor = backlight.factor;
+        if (!m_pending.exchange(true)) {
+            double guiFps = 24e6 / (lcd.PCD * (lcd.HSW + lcd.HBP + lcd.CPL + lcd.HFP) * (lcd.VSW + lcd.VBP + lcd.LPP + lcd.VFP));
+            emit updateLcd(guiFps / (m_frameskip + 1));
+        }
     }
 }
 
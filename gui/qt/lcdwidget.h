@@ -3,7 +3,7 @@
 
 #include <QtWidgets/QWidget>
 #include <QtCore/QTimer>
-#include <QtCore/QMutex>
+#include <atomic>
 #include <chrono>
 
 #include "../../core/lcd.h"
@@ -51,8 +51,11 @@ private:
     bool m_transferDrag = false;
     bool m_screenshotDrag = false;
     QRect m_left, m_right;
-    QImage m_image;
-    QMutex m_mutex;
+    lcd_frames_t m_frames;
+    uint32_t m_frame[LCD_SIZE];
+    std::atomic<bool> m_pending{false};
+    bool m_shown = false;
+    float m_shownFactor = 1;
 
     // for dragable roms
     QString m_dragRom;
@@ -106,6 +106,7 @@ MainWindow::MainWindow(CEmuOpts &cliOpts, QWidget *p) : QMainWindow(p), ui(new U
     ui->centralWidget->hide();
     ui->statusBar->addWidget(&m_speedLabel);
     ui->statusBar->addPermanentWidget(&m_msgLabel);
+    ui->statusBar->addPermanentWidget(&m_rewindSlider);
     ui->statusBar->addPermanentWidget(&m_fpsLabel);
 
     m_watchpoints = ui->watchpoints;
@@ -141,6 +142,7 @@ MainWindow::MainWindow(CEmuOpts &cliOpts, QWidget *p) : QMainWindow(p), ui(new U
     connect(&emu, &EmuThread::consoleStr, this, &MainWindow::consoleStr, Qt::UniqueConnection);
     connect(&emu, &EmuThread::consoleClear, this, &MainWindow::consoleClear, Qt::QueuedConnection);
     connect(&emu, &EmuThread::sendSpeed, this, &MainWindow::showEmuSpeed, Qt::QueuedConnection);
+    connect(&emu, &EmuThread::rewindChanged, this, &MainWindow::showRewind, Qt::QueuedConnection);
     connect(&emu, &EmuThread::debugDisable, this, &MainWindow::debugDisable, Qt::QueuedConnection);
     connect(&emu, &EmuThread::debugCommand, this, &MainWindow::debugCommand, Qt::QueuedConnection);
     connect(&emu, &EmuThread::saved, this, &MainWindow::emuSaved, Qt::QueuedConnection);
@@ -270,9 +272,7 @@ MainWindow::MainWindow(CEmuOpts &cliOpts, QWidget *p) : QMainWindow(p), ui(new U
     connect(ui->actionSetup, &QAction::triggered, this, &MainWindow::runSetup);
     connect(ui->actionExit, &QAction::triggered, this, &MainWindow::close);
     connect(ui->actionScreenshot, &QAction::triggered, this, &MainWindow::screenshot);
-#ifdef PNG_WRITE_APNG_SUPPORTED
     connect(ui->actionRecordAnimated, &QAction::triggered, this, &MainWindow::recordAnimated);
-#endif
     connect(ui->actionSaveState, &QAction::triggered, [this]{ stateToPath(m_pathImage); });
     connect(ui->actionExportCalculatorState, &QAction::triggered, this, &MainWindow::stateToFile);
     connect(ui->actionExportRomImage, &QAction::triggered, this, &MainWindow::romExport);
@@ -286,6 +286,8 @@ MainWindow::MainWindow(CEmuOpts &cliOpts, QWidget *p) : QMainWindow(p), ui(new U
     connect(ui->actionResetCalculator, &QAction::triggered, this, &MainWindow::resetEmu);
     connect(ui->actionHideMenuBar, &QAction::triggered, this, &MainWindow::setMenuBarState);
     connect(ui->actionHideStatusBar, &QAction::triggered, this, &MainWindow::setStatusBarState);
+    connect(ui->actionRewind, &QAction::triggered, this, &MainWindow::setRewind);
+    connect(ui->actionTurboTransfers, &QAction::triggered, this, &MainWindow::setTurboTransfers);
     connect(ui->buttonResetCalculator, &QPushButton::clicked, this, &MainWindow::resetEmu);
     connect(ui->buttonReloadROM, &QPushButton::clicked, [this]{ emuLoad(EMU_DATA_ROM); });
 
@@ -342,14 +344,11 @@ MainWindow::MainWindow(CEmuOpts &cliOpts, QWidget *p) : QMainWindow(p), ui(new U
     connect(ui->buttonSavePNG, &QPushButton::clicked, this, &MainWindow::screenshot);
     connect(ui->buttonCopyPNG, &QPushButton::clicked, this, &MainWindow::lcdCopy);
     connect(ui->actionClipScreen, &QAction::triggered, this, &MainWindow::lcdCopy);
-#ifdef PNG_WRITE_APNG_SUPPORTED
     connect(ui->buttonRecordAnimated, &QPushButton::clicked, this, &MainWindow::recordAnimated);
     connect(ui->apngSkip, &QSlider::valueChanged, this, &MainWindow::setFrameskip);
+#ifdef PNG_WRITE_APNG_SUPPORTED
     connect(ui->checkOptimizeRecording, &QCheckBox::stateChanged, this, &MainWindow::setOptimizeRecord);
 #else
-    ui->actionRecordAnimated->setEnabled(false);
-    ui->buttonRecordAnimated->setEnabled(false);
-    ui->apngSkip->setEnabled(false);
     ui->checkOptimizeRecording->setEnabled(false);
 #endif
 
@@ -372,6 +371,7 @@ MainWindow::MainWindow(CEmuOpts &cliOpts, QWidget *p) : QMainWindow(p), ui(new U
     connect(ui->checkThrottle, &QCheckBox::stateChanged, this, &MainWindow::setThrottle);
     connect(ui->checkAutoEquates, &QCheckBox::stateChanged, this, &MainWindow::setDebugAutoEquates);
     connect(ui->checkSaveRestore, &QCheckBox::stateChanged, this, &MainWindow::setAutoSave);
+    connect(ui->checkImageMappable, &QCheckBox::stateChanged, this, &MainWindow::setImageMappable);
     connect(ui->checkPortable, &QCheckBox::stateChanged, this, &MainWindow::setPortable);
     connect(ui->checkSaveRecent, &QCheckBox::stateChanged, this, &MainWindow::setRecentSave);
     connect(ui->checkSaveLoadDebug, &QCheckBox::stateChanged, this, &MainWindow::setDebugAutoSave);
@@ -481,6 +481,7 @@ MainWindow::MainWindow(CEmuOpts &cliOpts, QWidget *p) : QMainWindow(p), ui(new U
     m_shortcutFullscreen = new QShortcut(QKeySequence(Qt::Key_F11), this);
     m_shortcutAsm = new QShortcut(QKeySequence(Qt::Key_Pause), this);
     m_shortcutResend = new QShortcut(QKeySequence(Qt::CTRL + Qt::Key_X), this);
+    m_shortcutRewind = new QShortcut(QKeySequence(Qt::CTRL + Qt::Key_Z), this);
 
     m_shortcutFullscreen->setAutoRepeat(false);
     m_shortcutDebug->setAutoRepeat(false);
@@ -489,6 +490,14 @@ MainWindow::MainWindow(CEmuOpts &cliOpts, QWidget *p) : QMainWindow(p), ui(new U
 
     connect(m_shortcutFullscreen, &QShortcut::activated, [this]{ setFullscreen(m_fullscreen + 1); });
     connect(m_shortcutResend, &QShortcut::activated, this, &MainWindow::varResend);
+    connect(m_shortcutRewind, &QShortcut::activated, [this]{ emu.rewind(1); });
+
+    m_rewindSlider.setOrientation(Qt::Horizontal);
+    m_rewindSlider.setMaximumWidth(150);
+    m_rewindSlider.setRange(0, 0);
+    connect(&m_rewindSlider, &QSlider::sliderReleased, [this]{
+        emu.rewind(m_rewindSlider.maximum() - m_rewindSlider.value());
+    });
     connect(m_shortcutAsm, &QShortcut::activated, [this]{ sendEmuKey(CE_KEY_ASM); });
     connect(m_shortcutDebug, &QShortcut::activated, this, &MainWindow::debugToggle);
     connect(m_shortcutStepIn, &QShortcut::activated, this, &MainWindow::stepIn);
@@ -568,6 +577,7 @@ MainWindow::MainWindow(CEmuOpts &cliOpts, QWidget *p) : QMainWindow(p), ui(new U
     setKeypadHolding(m_config->value(SETTING_KEYPAD_HOLDING, true).toBool());
     setEmuSpeed(m_config->value(SETTING_EMUSPEED, 100).toInt());
     ui->checkSaveRestore->setChecked(m_config->value(SETTING_SAVE_ON_CLOSE, true).toBool());
+    setImageMappable(m_config->value(SETTING_IMAGE_MAPPABLE, false).toBool());
     setFont(m_config->value(SETTING_DEBUGGER_TEXT_SIZE, 9).toInt());
     setDebugDisasmSpace(m_config->value(SETTING_DEBUGGER_DISASM_SPACE, false).toBool());
     setDebugDisasmAddrCol(m_config->value(SETTING_DEBUGGER_ADDR_COL, true).toBool());
@@ -585,6 +595,8 @@ MainWindow::MainWindow(CEmuOpts &cliOpts, QWidget *p) : QMainWindow(p), ui(new U
     setLcdDma(m_config->value(SETTING_DEBUGGER_IGNORE_DMA, true).toBool());
     setFocusSetting(m_config->value(SETTING_PAUSE_FOCUS, false).toBool());
     setRecentSave(m_config->value(SETTING_RECENT_SAVE, true).toBool());
+    setRewind(m_config->value(SETTING_REWIND_ENABLE, false).toBool());
+    setTurboTransfers(m_config->value(SETTING_TURBO_TRANSFERS, false).toBool());
     setDockGroupDrag(m_config->value(SETTING_WINDOW_GROUP_DRAG, false).toBool());
     setMenuBarState(m_config->value(SETTING_WINDOW_MENUBAR, false).toBool());
     setStatusBarState(m_config->value(SETTING_WINDOW_STATUSBAR, false).toBool());
@@ -1599,79 +1611,76 @@ void MainWindow::lcdCopy() {
     QApplication::clipboard()->setImage(ui->lcd->getImage(), QClipboard::Clipboard);
 }
 
-#ifdef PNG_WRITE_APNG_SUPPORTED
 void MainWindow::recordAnimated() {
-    static QString path;
+    // frames are encoded while recording, so stopping only has to flush the last few
+    if (m_recorder) {
+        ui->actionRecordAnimated->setEnabled(false);
+        ui->buttonRecordAnimated->setEnabled(false);
+        m_recorder->stop();
+        return;
+    }
 
     if (guiDebug || guiReceive || guiSend) {
         return;
     }
 
-    if (path.isEmpty()) {
-        if (m_recording) {
-            return;
-        }
-        path = QDir::tempPath() + QDir::separator() + QStringLiteral("apng_tmp.png");
-        apng_start(path.toStdString().c_str(), ui->apngSkip->value());
-        showStatusMsg(tr("Recording..."));
-    } else {
-        showStatusMsg(tr("Saving Recording..."));
-        if (apng_stop()) {
-            int res;
-
-            QFileDialog dialog(this);
-
-            dialog.setAcceptMode(QFileDialog::AcceptSave);
-            dialog.setFileMode(QFileDialog::AnyFile);
-            dialog.setDirectory(m_dir);
-            dialog.setNameFilter(tr("PNG images (*.png)"));
-            dialog.setWindowTitle(tr("Save Recorded PNG"));
-            dialog.setDefaultSuffix(QStringLiteral("png"));
-            res = dialog.exec();
-
-            QFile(path).remove();
-            m_dir = dialog.directory();
-            path.clear();
-
-            if (res == QDialog::Accepted) {
-                QStringList selected = dialog.selectedFiles();
-                QString filename = selected.first();
-                recordSave(filename);
-            } else {
-                recordControlUpdate();
-            }
-        } else {
-            QMessageBox::critical(this, MSG_ERROR, tr("A failure occured during PNG recording."));
-            m_msgLabel.clear();
-            path.clear();
-        }
+    QFileDialog dialog(this);
+
+    dialog.setAcceptMode(QFileDialog::AcceptSave);
+    dialog.setFileMode(QFileDialog::AnyFile);
+    dialog.setDirectory(m_dir);
+#ifdef PNG_WRITE_APNG_SUPPORTED
+    dialog.setNameFilters({tr("PNG images (*.png)"), tr("Y4M video (*.y4m)")});
+    dialog.setDefaultSuffix(QStringLiteral("png"));
+#else
+    dialog.setNameFilters({tr("Y4M video (*.y4m)")});
+    dialog.setDefaultSuffix(QStringLiteral("y4m"));
+#endif
+    dialog.setWindowTitle(tr("Record Screen"));
+    connect(&dialog, &QFileDialog::filterSelected, &dialog, [&dialog](const QString &filter) {
+        dialog.setDefaultSuffix(filter.contains(QStringLiteral("*.y4m")) ? QStringLiteral("y4m") : QStringLiteral("png"));
+    });
+    int res = dialog.exec();
+    m_dir = dialog.directory();
+
+    if (res != QDialog::Accepted) {
+        return;
+    }
+
+    QString filename = dialog.selectedFiles().first();
+#ifdef PNG_WRITE_APNG_SUPPORTED
+    Recorder::Format format = filename.endsWith(QStringLiteral(".y4m"), Qt::CaseInsensitive) ? Recorder::Format::Y4m : Recorder::Format::Apng;
+#else
+    Recorder::Format format = Recorder::Format::Y4m;
+#endif
+    Recorder *recorder = new Recorder(this);
+
+    if (!recorder->record(filename, format, m_optimizeRecording, ui->apngSkip->value())) {
+        delete recorder;
+        QMessageBox::critical(this, MSG_ERROR, tr("Failed to create recording file."));
         return;
     }
 
-    m_recording = true;
+    connect(recorder, &Recorder::done, this, [this, recorder](bool success) {
+        recordControlUpdate();
+        if (!success) {
+            QMessageBox::critical(this, MSG_ERROR, tr("A failure occured during recording."));
+        } else if (recorder->dropped()) {
+            showStatusMsg(tr("Recording saved, %1 frames were dropped.").arg(recorder->dropped()));
+        }
+    });
+    connect(recorder, &Recorder::finished, recorder, &QObject::deleteLater);
+    m_recorder = recorder;
+
+    showStatusMsg(tr("Recording..."));
     ui->apngSkip->setEnabled(false);
     ui->actionRecordAnimated->setChecked(true);
     ui->buttonRecordAnimated->setText(tr("Stop Recording"));
     ui->actionRecordAnimated->setText(tr("Stop Recording..."));
 }
 
-void MainWindow::recordSave(const QString &filename) {
-    ui->apngSkip->setEnabled(false);
-    ui->actionRecordAnimated->setEnabled(false);
-    ui->buttonRecordAnimated->setEnabled(false);
-    ui->buttonRecordAnimated->setText(tr("Saving..."));
-    ui->actionRecordAnimated->setText(tr("Saving Animated PNG..."));
-
-    RecordingThread *thread = new RecordingThread();
-    connect(thread, &RecordingThread::done, this, &MainWindow::recordControlUpdate);
-    connect(thread, &RecordingThread::finished, thread, &QObject::deleteLater);
-    thread->m_filename = filename;
-    thread->m_optimize = m_optimizeRecording;
-    thread->start();
-}
-
 void MainWindow::recordControlUpdate() {
-    m_recording = false;
+    m_recorder = Q_NULLPTR;
     ui->apngSkip->setEnabled(true);
     ui->actionRecordAnimated->setEnabled(true);
     ui->buttonRecordAnimated->setEnabled(true);
@@ -1681,12 +1690,6 @@ void MainWindow::recordControlUpdate() {
     m_msgLabel.clear();
 }
 
-void RecordingThread::run() {
-    apng_save(m_filename.toStdString().c_str(), m_optimize);
-    emit done();
-}
-#endif
-
 void MainWindow::showAbout() {
     QMessageBox *aboutBox = new QMessageBox(this);
 
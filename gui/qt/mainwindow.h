@@ -13,11 +13,12 @@
 #include "keypad/qtkeypadbridge.h"
 #include "debugger/hexwidget.h"
 #include "debugger/disasm.h"
-#include "capture/animated-png.h"
+#include "capture/recorder.h"
 #include "../../core/vat.h"
 #include "../../core/debug/debug.h"
 
 #include <QtWidgets/QProgressBar>
+#include <QtWidgets/QSlider>
 #include <QtWidgets/QMainWindow>
 #include <QtWidgets/QLabel>
 #include <QtWidgets/QTableWidgetItem>
@@ -32,19 +33,7 @@
 #include <QtCore/QTranslator>
 #include <QtCore/QStandardPaths>
 
-#ifdef PNG_WRITE_APNG_SUPPORTED
-class RecordingThread : public QThread {
-    Q_OBJECT
-protected:
-    virtual void run() Q_DECL_OVERRIDE;
-public:
-    QString m_filename;
-    bool m_optimize;
-signals:
-    void done();
-};
-#endif
-
+class Recorder;
 namespace Ui { class MainWindow; }
 
 class MainWindow : public QMainWindow {
@@ -242,11 +231,8 @@ private:
     void setFrameskip(int value);
     void setOptimizeRecord(bool state);
     void setSnapshotPath();
-#ifdef PNG_WRITE_APNG_SUPPORTED
     void recordAnimated();
-    void recordSave(const QString &file);
     void recordControlUpdate();
-#endif
 
     // debugger
     void debugPopulate();
@@ -421,8 +407,12 @@ private:
     void setPreRevisionI(bool state);
     void setNormalOs(bool state);
     void setRecentSave(bool state);
+    void setRewind(bool state);
+    void setTurboTransfers(bool state);
+    void showRewind(int count);
     void setPortable(bool state);
     void setAutoSave(bool state);
+    void setImageMappable(bool state);
     void setAutoUpdates(int value);
     void saveSettings();
     void saveDebug();
@@ -576,6 +566,7 @@ private:
     QLabel m_speedLabel;
     QLabel m_fpsLabel;
     QLabel m_msgLabel;
+    QSlider m_rewindSlider;
     QTextCursor m_disasmOffset;
     bool m_disasmOffsetSet;
     bool m_disasmPane;
@@ -592,7 +583,7 @@ private:
     bool m_portable = false;
     bool m_nativeConsole = false;
     bool m_shutdown = false;
-    bool m_recording = false;
+    Recorder *m_recorder = Q_NULLPTR;
 
     bool m_basicTempOpen = false;
     QString m_basicVariableName;
@@ -629,6 +620,7 @@ private:
     QShortcut *m_shortcutFullscreen;
     QShortcut *m_shortcutAsm;
     QShortcut *m_shortcutResend;
+    QShortcut *m_shortcutRewind;
 
     QAction *m_actionToggleUI;
     QAction *m_actionAddMemory;
@@ -757,6 +749,7 @@ private:
     static const QString SETTING_PAUSE_FOCUS;
     static const QString SETTING_SAVE_ON_CLOSE;
     static const QString SETTING_RESTORE_ON_OPEN;
+    static const QString SETTING_IMAGE_MAPPABLE;
     static const QString SETTING_EMUSPEED;
     static const QString SETTING_AUTOUPDATE;
     static const QString SETTING_ALWAYS_ON_TOP;
@@ -766,6 +759,10 @@ private:
     static const QString SETTING_RECENT_SAVE;
     static const QString SETTING_RECENT_PATHS;
     static const QString SETTING_RECENT_SELECT;
+    static const QString SETTING_REWIND_ENABLE;
+    static const QString SETTING_REWIND_INTERVAL;
+    static const QString SETTING_REWIND_MEMORY;
+    static const QString SETTING_TURBO_TRANSFERS;
 
     static const QString SETTING_KEYPAD_NATURAL;
     static const QString SETTING_KEYPAD_CEMU;
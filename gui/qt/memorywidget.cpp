@@ -215,6 +215,7 @@ void MainWindow::memSync(HexWidget *edit) {
 void MainWindow::flashSyncPressed() {
     if (ui->flashEdit->modifiedCount()) {
         memcpy(mem.flash.block, ui->flashEdit->data(), 0x400000);
+        mem_invalidate_ptr(mem.flash.block, 0x400000);
     }
     memSync(ui->flashEdit);
 }
@@ -222,6 +223,7 @@ void MainWindow::flashSyncPressed() {
 void MainWindow::ramSyncPressed() {
     if (ui->ramEdit->modifiedCount()) {
         memcpy(mem.ram.block, ui->ramEdit->data(), 0x65800);
+        mem_invalidate_ptr(mem.ram.block, 0x65800);
     }
     memSync(ui->ramEdit);
 }
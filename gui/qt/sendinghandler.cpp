@@ -155,11 +155,14 @@ bool SendingHandler::dragOccured(QDragEnterEvent *e) {
     return true;
 }
 
-void SendingHandler::linkProgress(int value, int total) {
+void SendingHandler::linkProgress(int value, int total, int rate) {
     if (total) {
         if (m_progressBar) {
             m_progressBar->setMaximum(total);
             m_progressBar->setValue(value);
+            if (rate) {
+                m_progressBar->setFormat(QStringLiteral("%p% (") + QString::number(rate / 1024.0, 'f', 1) + QStringLiteral(" KiB/s)"));
+            }
         }
         if (value != total) {
             return;
@@ -176,6 +179,7 @@ void SendingHandler::linkProgress(int value, int total) {
         m_progressBar->setVisible(false);
         m_btnCancelTransfer->setVisible(false);
         m_progressBar->setValue(0);
+        m_progressBar->setFormat(QStringLiteral("%p%"));
     }
     guiSend = false;
 }
@@ -32,7 +32,7 @@ public:
     void setLoadEquates(bool state);
 
 public slots:
-    void linkProgress(int amount, int total);
+    void linkProgress(int amount, int total, int rate);
     void resendPressed();
     void removeRow();
 
@@ -84,6 +84,7 @@ const QString MainWindow::SETTING_UI_EDIT_MODE              = QStringLiteral("ui
 const QString MainWindow::SETTING_PAUSE_FOCUS               = QStringLiteral("pause_on_focus_change");
 const QString MainWindow::SETTING_SAVE_ON_CLOSE             = QStringLiteral("save_on_close");
 const QString MainWindow::SETTING_RESTORE_ON_OPEN           = QStringLiteral("restore_on_open");
+const QString MainWindow::SETTING_IMAGE_MAPPABLE            = QStringLiteral("image_mappable");
 const QString MainWindow::SETTING_EMUSPEED                  = QStringLiteral("emulated_speed");
 const QString MainWindow::SETTING_AUTOUPDATE                = QStringLiteral("check_for_updates");
 const QString MainWindow::SETTING_ALWAYS_ON_TOP             = QStringLiteral("always_on_top");
@@ -93,6 +94,10 @@ const QString MainWindow::SETTING_ENABLE_WIN_CONSOLE        = QStringLiteral("en
 const QString MainWindow::SETTING_RECENT_SAVE               = QStringLiteral("Recent/save_paths");
 const QString MainWindow::SETTING_RECENT_PATHS              = QStringLiteral("Recent/paths");
 const QString MainWindow::SETTING_RECENT_SELECT             = QStringLiteral("Recent/selected");
+const QString MainWindow::SETTING_REWIND_ENABLE             = QStringLiteral("Rewind/enabled");
+const QString MainWindow::SETTING_REWIND_INTERVAL           = QStringLiteral("Rewind/interval_frames");
+const QString MainWindow::SETTING_REWIND_MEMORY             = QStringLiteral("Rewind/memory_mb");
+const QString MainWindow::SETTING_TURBO_TRANSFERS           = QStringLiteral("Transfer/turbo");
 
 const QString MainWindow::SETTING_KEYPAD_NATURAL            = QStringLiteral("natural");
 const QString MainWindow::SETTING_KEYPAD_CEMU               = QStringLiteral("cemu");
@@ -415,6 +420,12 @@ void MainWindow::setAutoSave(bool state) {
     m_config->setValue(SETTING_SAVE_ON_CLOSE, state);
 }
 
+void MainWindow::setImageMappable(bool state) {
+    ui->checkImageMappable->setChecked(state);
+    m_config->setValue(SETTING_IMAGE_MAPPABLE, state);
+    emu.setImageMappable(state);
+}
+
 void MainWindow::setDebugAutoSave(bool state) {
     ui->checkSaveLoadDebug->setChecked(state);
     m_config->setValue(SETTING_DEBUGGER_SAVE_ON_CLOSE, state);
@@ -930,6 +941,32 @@ void MainWindow::setRecentSave(bool state) {
     m_config->setValue(SETTING_RECENT_SAVE, state);
 }
 
+void MainWindow::setRewind(bool state) {
+    ui->actionRewind->setChecked(state);
+    m_config->setValue(SETTING_REWIND_ENABLE, state);
+    m_rewindSlider.setVisible(state);
+    m_shortcutRewind->setEnabled(state);
+    emu.setRewind(state, m_config->value(SETTING_REWIND_INTERVAL, 30).toInt(),
+                  m_config->value(SETTING_REWIND_MEMORY, 64).toInt());
+}
+
+void MainWindow::setTurboTransfers(bool state) {
+    ui->actionTurboTransfers->setChecked(state);
+    m_config->setValue(SETTING_TURBO_TRANSFERS, state);
+    emu.setLinkTurbo(state);
+}
+
+void MainWindow::showRewind(int count) {
+    if (m_rewindSlider.isSliderDown()) {
+        return;
+    }
+    m_rewindSlider.blockSignals(true);
+    m_rewindSlider.setRange(0, count);
+    m_rewindSlider.setValue(count);
+    m_rewindSlider.blockSignals(false);
+    m_rewindSlider.setToolTip(tr("Rewind") + QStringLiteral(": ") + QString::number(count));
+}
+
 void MainWindow::setPreRevisionI(bool state) {
     ui->checkPreI->setChecked(state);
     m_config->setValue(SETTING_DEBUGGER_PRE_I, state);
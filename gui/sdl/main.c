@@ -19,6 +19,7 @@ typedef struct {
     int limit;
     int fullscreen;
     sdl_t sdl;
+    lcd_frames_t frames;
 } cemu_sdl_t;
 
 static const cemu_sdl_key_t *keymap = cemu_keymap;
@@ -28,19 +29,15 @@ void gui_console_printf(const char *format, ...) { (void)format; }
 void gui_console_err_printf(const char *format, ...) { (void)format; }
 
 void sdl_update_lcd(void *data) {
-    sdl_t *sdl = (sdl_t*)data;
-    void *pixels;
-    int pitch;
+    lcd_frames_t *frames = (lcd_frames_t*)data;
 
-    if (!SDL_LockTexture(sdl->texture, NULL, &pixels, &pitch)) {
-        emu_lcd_drawframe(pixels);
-        SDL_UnlockTexture(sdl->texture);
-    }
+    emu_lcd_drawframe(emu_lcd_frames_back(frames));
+    emu_lcd_frames_publish(frames);
 }
 
 void sdl_cemu_configure(cemu_sdl_t *cemu) {
     emu_set_run_rate(1000);
-    emu_set_lcd_callback(sdl_update_lcd, &cemu->sdl);
+    emu_set_lcd_callback(sdl_update_lcd, &cemu->frames);
     emu_set_lcd_spi(cemu->spi);
 }
 
@@ -85,6 +82,8 @@ void sdl_event_loop(cemu_sdl_t *cemu) {
         return;
     }
 
+    emu_lcd_frames_init(&cemu->frames);
+
     if (cemu->image) {
         if (EMU_STATE_VALID != emu_load(EMU_DATA_IMAGE, cemu->image)) {
             fprintf(stderr, "could not load image.\n");
@@ -103,6 +102,8 @@ void sdl_event_loop(cemu_sdl_t *cemu) {
     while (done == false) {
         SDL_DisplayMode mode;
         uint32_t max_ticks, ticks, expected_ticks, actual_ticks;
+        const uint32_t *frame;
+        bool fresh;
         int status;
 
         SDL_GetWindowDisplayMode(sdl->window, &mode);
@@ -117,6 +118,12 @@ void sdl_event_loop(cemu_sdl_t *cemu) {
         speed_count++;
         emu_run(actual_ticks);
 
+        /* only upload the newest of the frames drawn during this run */
+        frame = emu_lcd_frames_front(&cemu->frames, &fresh);
+        if (fresh) {
+            SDL_UpdateTexture(sdl->texture, NULL, frame, LCD_WIDTH * sizeof(uint32_t));
+        }
+
         if (control.ports[5] & 1 << 4) {
             uint8_t brightness = backlight.factor < 1 ? backlight.factor * 255 : 255;
             SDL_SetTextureColorMod(sdl->texture, brightness, brightness, brightness);
@@ -15,6 +15,8 @@
 #include <functional>
 #include <unordered_map>
 #include <regex>
+#include <random>
+#include <cstdio>
 
 #if defined(WIN32) || defined(_WIN32) || defined(__WIN32) && !defined(__CYGWIN__)
   #include <windows.h>
@@ -62,6 +64,23 @@ unsigned int hashesFailed = 0;
 /* Will be incremented at each `hash` command */
 unsigned int hashesTested = 0;
 
+/* Emulated ms between checks of a hashWait region */
+static const int32_t hashWaitStepMs = 1;
+
+/* CRC of a memory region, straight from emulated memory when it is contiguous */
+static uint32_t hashRegion(uint32_t start, uint32_t size)
+{
+    const void *ptr = cemucore::phys_mem_ptr(start, static_cast<int32_t>(size));
+    if (ptr)
+    {
+        return crc32(ptr, size);
+    }
+    void *temp_buffer = cemucore::virt_mem_dup(start, static_cast<int32_t>(size));
+    const uint32_t crc = crc32(temp_buffer, size);
+    ::free(temp_buffer);
+    return crc;
+}
+
 struct coord2d { uint8_t x; uint8_t y; };
 // Note: we could just store the string in a char*[8][8], then search for it and calculate its row/col at runtime, but meh.
 static const std::unordered_map<std::string, coord2d> valid_keys = {
@@ -162,29 +181,29 @@ static const std::unordered_map<std::string, seq_cmd_func_t> valid_seq_commands
             const auto& tmp = config.hashes.find(which_hash);
             if (tmp != config.hashes.end())
             {
-                void *temp_buffer = nullptr;
-                void *temp_buffer_dup = nullptr;
                 uint32_t real_hash;
                 const hash_params_t& param = tmp->second;
-                bool match = false;
+                bool match;
 
                 int32_t delay = param.timeout_ms;
 
-                do
+                // Whatever was written before now is covered by this first hash
+                cemucore::mem_written(param.start, param.size);
+                real_hash = hashRegion(param.start, param.size);
+                match = (std::find(param.expected_CRCs.begin(), param.expected_CRCs.end(), real_hash) != param.expected_CRCs.end());
+
+                // Step finely, but only re-hash once something wrote to the region
+                while (delay > 0 && !match)
                 {
-                    temp_buffer = cemucore::virt_mem_dup(param.start, static_cast<int32_t>(param.size));
-                    real_hash = crc32(temp_buffer, param.size);
-                    match = (std::find(param.expected_CRCs.begin(), param.expected_CRCs.end(), real_hash) != param.expected_CRCs.end());
-                    if (debugMode && !match) {
-                        ::free(temp_buffer_dup);
-                        temp_buffer_dup = malloc(param.size);
-                        memcpy(temp_buffer_dup, temp_buffer, param.size);
-                    }
-                    ::free(temp_buffer);
-                    int32_t amount = (std::min)(delay, 100);
-                    cemucore::emu_run(amount);
+                    int32_t amount = (std::min)(delay, hashWaitStepMs);
+                    cemucore::emu_run(static_cast<uint64_t>(amount));
                     delay -= amount;
-                } while (delay > 0 && !match);
+                    if (cemucore::mem_written(param.start, param.size))
+                    {
+                        real_hash = hashRegion(param.start, param.size);
+                        match = (std::find(param.expected_CRCs.begin(), param.expected_CRCs.end(), real_hash) != param.expected_CRCs.end());
+                    }
+                }
 
                 if (match)
                 {
@@ -204,16 +223,16 @@ static const std::unordered_map<std::string, seq_cmd_func_t> valid_seq_commands
                     if (debugMode) {
                         char dump_path[150] = {0};
                         snprintf(dump_path, sizeof(dump_path), "failure_hash%s_num%d_dump.bin", which_hash.c_str(), hashesTested+1);
+                        // The region has not been written since it was last hashed
+                        void *temp_buffer = cemucore::virt_mem_dup(param.start, static_cast<int32_t>(param.size));
                         FILE *dump_file = fopen(dump_path, "wb");
-                        fwrite(temp_buffer_dup, param.size, 1, dump_file);
+                        fwrite(temp_buffer, param.size, 1, dump_file);
                         fclose(dump_file);
+                        ::free(temp_buffer);
                         std::cout << "\tDumped memory into " << dump_path << std::endl;
                     }
                     hashesFailed++;
                 }
-                if (debugMode) {
-                    ::free(temp_buffer_dup);
-                }
                 hashesTested++;
             } else {
                 std::cerr << "\t[Error] hash #" << which_hash << " was not declared in the JSON file. Ignoring." << std::endl;
@@ -327,6 +346,7 @@ bool launchCommand(const std::pair<std::string, std::string>& command)
 
 /****** Utility functions ******/
 inline bool file_exists(const std::string& name);
+bool read_file(const std::string& name, std::string& contents);
 std::string str_replace_all(std::string str, const std::string& from, const std::string& to);
 
 inline bool file_exists(const std::string& name)
@@ -334,6 +354,19 @@ inline bool file_exists(const std::string& name)
     return std::ifstream(name.c_str()).good();
 }
 
+bool read_file(const std::string& name, std::string& contents)
+{
+    std::ifstream ifs(name.c_str(), std::ios::binary | std::ios::ate);
+    const std::streamoff size = ifs.tellg();
+    if (!ifs.good() || size <= 0)
+    {
+        return false;
+    }
+    contents.resize(static_cast<size_t>(size));
+    ifs.seekg(0);
+    return static_cast<bool>(ifs.read(&contents[0], size));
+}
+
 std::string str_replace_all(std::string str, const std::string& from, const std::string& to)
 {
     size_t start_pos = 0;
@@ -447,6 +480,18 @@ bool loadJSONConfig(const std::string& jsonContents)
         return false;
     }
 
+    if (configJson.object_items().count("inject_files"))
+    {
+        tmp = configJson["inject_files"];
+        if (tmp.is_bool())
+        {
+            config.inject_files = tmp.bool_value();
+        } else {
+            std::cerr << "[Error] bad type for \"inject_files\", boolean needed." << std::endl;
+            return false;
+        }
+    }
+
     if (configJson.object_items().count("delay_after_key"))
     {
         tmp = configJson["delay_after_key"];
@@ -649,9 +694,9 @@ std::vector<std::string> globVector(const std::string& pattern)
     return files;
 }
 
-bool sendFilesForTest()
+/* Library files forced by the environment, sent before the config's own files */
+static bool forcedFilesForTest(std::vector<std::string>& forced_files)
 {
-    std::vector<std::string> forced_files;
     const char* forced_libs_group = getenv("AUTOTESTER_LIBS_GROUP");
     const char* forced_libs_dir   = getenv("AUTOTESTER_LIBS_DIR");
 
@@ -675,6 +720,27 @@ bool sendFilesForTest()
     {
         std::cerr << "[Error] Env var for libs-dir/group given, but no files found...?" << std::endl;
         return false;
+    }
+    return true;
+}
+
+static bool transferFile(const std::string& file)
+{
+    if (config.inject_files)
+    {
+        const char* path = file.c_str();
+        return cemucore::emu_inject_variables(&path, 1, cemucore::LINK_FILE) != cemucore::LINK_ERR;
+    }
+    return cemucore::emu_send_variable(file.c_str(), cemucore::LINK_FILE) == cemucore::LINK_GOOD;
+}
+
+bool sendFilesForTest()
+{
+    std::vector<std::string> forced_files;
+
+    if (!forcedFilesForTest(forced_files))
+    {
+        return false;
     } else {
         for (const auto& file : forced_files)
         {
@@ -682,7 +748,7 @@ bool sendFilesForTest()
             {
                 std::cout << "- Sending forced file " << file << "... ";
             }
-            if (cemucore::emu_send_variable(file.c_str(), cemucore::LINK_FILE) != cemucore::LINK_GOOD)
+            if (!transferFile(file))
             {
                 if (debugMode)
                 {
@@ -704,7 +770,7 @@ bool sendFilesForTest()
         {
             std::cout << "- Sending file " << file << "... ";
         }
-        if (cemucore::emu_send_variable(file.c_str(), cemucore::LINK_FILE) != cemucore::LINK_GOOD)
+        if (!transferFile(file))
         {
             if (debugMode)
             {
@@ -721,6 +787,79 @@ bool sendFilesForTest()
     return true;
 }
 
+std::string bootCachePath(const std::string& cacheDir)
+{
+    std::vector<std::string> files;
+    uint32_t rom_crc = 0, files_crc = 0;
+
+    // forced files are only sent along with the config's own files, so only they change the booted state
+    if (!config.transfer_files.empty() && !forcedFilesForTest(files))
+    {
+        return "";
+    }
+    files.insert(files.end(), config.transfer_files.begin(), config.transfer_files.end());
+    files.insert(files.begin(), config.rom);
+
+    for (const auto& file : files)
+    {
+        std::string contents;
+        if (!read_file(file, contents))
+        {
+            return "";
+        }
+
+        const uint32_t size = static_cast<uint32_t>(contents.size());
+        const uint32_t crc = crc32(contents.data(), contents.size());
+        if (&file == &files.front()) {
+            rom_crc = crc;
+        }
+        files_crc = crc32_append(files_crc, &crc, sizeof(crc));
+        files_crc = crc32_append(files_crc, &size, sizeof(size));
+    }
+    if (config.inject_files)
+    {
+        const uint32_t inject = 1;
+        files_crc = crc32_append(files_crc, &inject, sizeof(inject));
+    }
+
+    char name[40];
+    snprintf(name, sizeof(name), "boot_%08X_%08X.img", rom_crc, files_crc);
+    return cacheDir + "/" + name;
+}
+
+bool restoreBootCache(const std::string& path)
+{
+    std::string image;
+    return read_file(path, image) && cemucore::emu_snapshot_restore(image.data(), image.size());
+}
+
+bool saveBootCache(const std::string& path)
+{
+    std::vector<char> image(cemucore::emu_snapshot_size());
+    if (image.empty() || !cemucore::emu_snapshot_save(image.data(), image.size()))
+    {
+        return false;
+    }
+
+    // Parallel runs may save the same entry, so write it elsewhere and move it in place
+    const std::string tmp_path = path + "." + std::to_string(std::random_device()()) + ".tmp";
+    {
+        std::ofstream ofs(tmp_path, std::ios::binary);
+        ofs.write(image.data(), static_cast<std::streamsize>(image.size()));
+        if (!ofs.good())
+        {
+            std::remove(tmp_path.c_str());
+            return false;
+        }
+    }
+    if (std::rename(tmp_path.c_str(), path.c_str()))
+    {
+        std::remove(tmp_path.c_str());
+        return file_exists(path);
+    }
+    return true;
+}
+
 bool doTestSequence()
 {
     hashesPassed = hashesFailed = hashesTested = 0;
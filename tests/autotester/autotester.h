@@ -42,6 +42,7 @@ namespace autotester
     struct config_t {
         std::string rom;
         std::vector<std::string> transfer_files;
+        bool inject_files = false; /* write the transfer files straight into the VAT instead of sending them */
         unsigned int delay_after_key  =  0; /* delay in ms after each "key" action (after release) */
         unsigned int delay_after_step = 80; /* delay in ms after each sequence step */
         struct {
@@ -84,6 +85,11 @@ namespace autotester
 
     bool sendFilesForTest();
 
+    /* Post-boot states, keyed by the ROM and the files sent before the test. Returns an empty path on error. */
+    std::string bootCachePath(const std::string& cacheDir);
+    bool restoreBootCache(const std::string& path);
+    bool saveBootCache(const std::string& path);
+
     bool doTestSequence();
 
     /* The global config variable */
@@ -12,12 +12,20 @@
 #include <chrono>
 #include <cstdarg>
 #include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <atomic>
+#include <mutex>
+#include <thread>
 
 #if defined(WIN32) || defined(_WIN32) || defined(__WIN32) && !defined(__CYGWIN__)
   #include <direct.h>
   #define chdir _chdir
+  #define popen _popen
+  #define pclose _pclose
 #else
   #include <unistd.h>
+  #include <sys/wait.h>
 #endif
 
 #include "autotester.h"
@@ -30,10 +38,290 @@ extern "C"
     void gui_console_err_printf(const char *format, ...) { (void)format; }
 }
 
+/* Suite mode: each config runs in its own autotester process, a worker thread per job waits on one */
+struct suite_result_t {
+    std::string path;
+    std::string output;
+    std::string status;
+    int exitCode = -1;
+    unsigned int hashesTested = 0;
+    unsigned int hashesPassed = 0;
+    unsigned int hashesFailed = 0;
+    unsigned long long cycles = 0;
+    double seconds = 0;
+};
+
+static const char suiteSummaryTag[] = "[Autotest summary]";
+
+static std::string shellQuote(const std::string& str)
+{
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32) && !defined(__CYGWIN__)
+    // cmd has no single quotes, but '"' can't be part of a Windows path either
+    return "\"" + str + "\"";
+#else
+    std::string quoted = "'";
+    for (const char c : str)
+    {
+        if (c == '\'')
+        {
+            quoted += "'\\''";
+        } else {
+            quoted += c;
+        }
+    }
+    return quoted + "'";
+#endif
+}
+
+static std::vector<std::string> expandSuiteArgs(int argc, char* argv[])
+{
+    std::vector<std::string> configs;
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg(argv[i]);
+        if (arg.find_first_of("*?") != std::string::npos)
+        {
+            const std::vector<std::string> matches = autotester::globVector(arg);
+            configs.insert(configs.end(), matches.begin(), matches.end());
+        } else if (arg.size() > 5 && arg.compare(arg.size() - 5, 5, ".json") == 0) {
+            configs.push_back(arg);
+        } else {
+            const std::vector<std::string> matches = autotester::globVector(arg + "/*.json");
+            configs.insert(configs.end(), matches.begin(), matches.end());
+        }
+    }
+    return configs;
+}
+
+static void runSuiteTest(const std::string& command, suite_result_t& result)
+{
+    const auto start = std::chrono::steady_clock::now();
+    FILE *pipe = popen(command.c_str(), "r");
+    if (pipe)
+    {
+        char buf[512];
+        while (fgets(buf, sizeof(buf), pipe))
+        {
+            result.output += buf;
+        }
+        int status = pclose(pipe);
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32) && !defined(__CYGWIN__)
+        result.exitCode = status;
+#else
+        result.exitCode = WIFEXITED(status) ? static_cast<int8_t>(WEXITSTATUS(status)) : -1;
+#endif
+    } else {
+        result.output = "Couldn't start the autotester process\n";
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    const size_t pos = result.output.rfind(suiteSummaryTag);
+    if (pos != std::string::npos && sscanf(result.output.c_str() + pos + sizeof(suiteSummaryTag) - 1, "%u %u %u %llu",
+                                           &result.hashesTested, &result.hashesPassed, &result.hashesFailed, &result.cycles) == 4)
+    {
+        // the exit code is the failure count, which wraps at 256
+        result.status = result.exitCode == 0 && result.hashesFailed == 0 ? "passed" : "failed";
+    } else {
+        result.status = "error";
+    }
+}
+
+static std::string xmlEscape(const std::string& str)
+{
+    std::string escaped;
+    for (const char c : str)
+    {
+        switch (c)
+        {
+            case '&':  escaped += "&amp;";  break;
+            case '<':  escaped += "&lt;";   break;
+            case '>':  escaped += "&gt;";   break;
+            case '"':  escaped += "&quot;"; break;
+            default:
+                if (static_cast<unsigned char>(c) >= 0x20 || c == '\n' || c == '\t') {
+                    escaped += c;
+                }
+                break;
+        }
+    }
+    return escaped;
+}
+
+static std::string jsonEscape(const std::string& str)
+{
+    std::string escaped;
+    for (const char c : str)
+    {
+        switch (c)
+        {
+            case '"':  escaped += "\\\""; break;
+            case '\\': escaped += "\\\\"; break;
+            case '\n': escaped += "\\n";  break;
+            case '\t': escaped += "\\t";  break;
+            default:
+                if (static_cast<unsigned char>(c) >= 0x20) {
+                    escaped += c;
+                }
+                break;
+        }
+    }
+    return escaped;
+}
+
+static bool writeSuiteReport(const std::string& path, const std::vector<suite_result_t>& results, double seconds)
+{
+    std::ofstream ofs(path);
+    unsigned int failures = 0, errors = 0;
+
+    for (const auto& result : results)
+    {
+        failures += result.status == "failed";
+        errors += result.status == "error";
+    }
+
+    if (path.size() > 4 && path.compare(path.size() - 4, 4, ".xml") == 0)
+    {
+        ofs << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+            << "<testsuite name=\"autotester\" tests=\"" << results.size() << "\" failures=\"" << failures
+            << "\" errors=\"" << errors << "\" time=\"" << seconds << "\">\n";
+        for (const auto& result : results)
+        {
+            ofs << "  <testcase classname=\"autotester\" name=\"" << xmlEscape(result.path) << "\" time=\"" << result.seconds << "\">\n"
+                << "    <properties>\n"
+                << "      <property name=\"cycles\" value=\"" << result.cycles << "\"/>\n"
+                << "      <property name=\"hashes_tested\" value=\"" << result.hashesTested << "\"/>\n"
+                << "    </properties>\n";
+            if (result.status == "failed")
+            {
+                ofs << "    <failure message=\"" << result.hashesFailed << " of " << result.hashesTested << " hashes failed\"/>\n";
+            } else if (result.status == "error") {
+                ofs << "    <error message=\"exit code " << result.exitCode << "\"/>\n";
+            }
+            ofs << "    <system-out>" << xmlEscape(result.output) << "</system-out>\n"
+                << "  </testcase>\n";
+        }
+        ofs << "</testsuite>\n";
+    } else {
+        ofs << "{\"tests\":[";
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            const suite_result_t& result = results[i];
+            ofs << (i ? "," : "") << "\n {\"config\":\"" << jsonEscape(result.path) << "\",\"status\":\"" << result.status
+                << "\",\"exit_code\":" << result.exitCode << ",\"hashes_tested\":" << result.hashesTested
+                << ",\"hashes_passed\":" << result.hashesPassed << ",\"hashes_failed\":" << result.hashesFailed
+                << ",\"cycles\":" << result.cycles << ",\"seconds\":" << result.seconds
+                << ",\"output\":\"" << jsonEscape(result.output) << "\"}";
+        }
+        ofs << "\n],\"total\":" << results.size() << ",\"failures\":" << failures << ",\"errors\":" << errors
+            << ",\"seconds\":" << seconds << "}" << std::endl;
+    }
+
+    return ofs.good();
+}
+
+static int runSuite(const std::string& self, const std::string& childOptions, const std::vector<std::string>& configs,
+                    unsigned int jobs, const std::string& reportPath)
+{
+    std::vector<suite_result_t> results(configs.size());
+    std::vector<std::thread> workers;
+    std::atomic<size_t> next(0);
+    std::mutex outputMutex;
+    unsigned int notPassed = 0;
+
+    const auto start = std::chrono::steady_clock::now();
+
+    for (unsigned int i = 0; i < jobs && i < configs.size(); i++)
+    {
+        workers.emplace_back([&] {
+            size_t index;
+            while ((index = next++) < configs.size())
+            {
+                suite_result_t& result = results[index];
+                std::string command = shellQuote(self) + childOptions + " -s " + shellQuote(configs[index]) + " 2>&1";
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32) && !defined(__CYGWIN__)
+                command = "\"" + command + "\"";
+#endif
+                result.path = configs[index];
+                runSuiteTest(command, result);
+
+                std::lock_guard<std::mutex> lock(outputMutex);
+                std::cout << "[" << result.status << "] " << result.path << " (" << result.hashesPassed << "/" << result.hashesTested
+                          << " hashes, " << result.seconds << "s)" << std::endl;
+            }
+        });
+    }
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    for (const auto& result : results)
+    {
+        notPassed += result.status != "passed";
+    }
+
+    if (!reportPath.empty() && !writeSuiteReport(reportPath, results, seconds))
+    {
+        std::cerr << "[Error] Couldn't write the report to " << reportPath << std::endl;
+    }
+
+    std::cout << (notPassed ? "[Autotest suite failed] " : "[Autotest suite passed] ") << "Out of " << results.size()
+              << " configs, " << results.size() - notPassed << " passed, and " << notPassed << " did not, in " << seconds << "s." << std::endl;
+
+    return static_cast<int>(std::min(notPassed, 255u));
+}
+
 int main(int argc, char* argv[])
 {
     // Used if the coreThread has been started (need to exit properly ; uses gotos)
     int retVal = 0;
+    unsigned long long cycles = 0;
+
+    const std::string self(argv[0]);
+    const char* cacheDir = getenv("AUTOTESTER_CACHE_DIR");
+    std::string cachePath;
+    std::string childOptions;
+    std::string reportPath;
+    unsigned int jobs = 0;
+    bool suiteSummary = false;
+
+    autotester::debugMode = false;
+
+    // Options: -d for debug output, -v to self-check the cpu instruction fetch cache against memory,
+    // -t to run hot code through the recompiler, -T to also check each recompiled block against the interpreter,
+    // -j N to run configs on N parallel jobs, -r file to write a JSON (or JUnit if *.xml) suite report,
+    // -s to print a summary line for the suite runner
+    for (; argc > 2 && argv[1][0] == '-'; argc--, argv++)
+    {
+        if (strcmp(argv[1], "-d") == 0)
+        {
+            autotester::debugMode = true;
+            childOptions += " -d";
+        } else if (strcmp(argv[1], "-v") == 0) {
+            cemucore::cpu_set_cache_mode(cemucore::CPU_CACHE_VERIFY);
+            childOptions += " -v";
+        } else if (strcmp(argv[1], "-t") == 0 || strcmp(argv[1], "-T") == 0) {
+            const bool verify = argv[1][1] == 'T';
+            if (!cemucore::cpu_set_jit_mode(verify ? cemucore::CPU_JIT_VERIFY : cemucore::CPU_JIT_ON))
+            {
+                std::cerr << "[Warning] No recompiler for this host, running the interpreter only" << std::endl;
+            }
+            childOptions += verify ? " -T" : " -t";
+        } else if (strcmp(argv[1], "-s") == 0) {
+            suiteSummary = true;
+        } else if (strcmp(argv[1], "-j") == 0 && argc > 3) {
+            jobs = static_cast<unsigned int>(std::max(atoi(argv[2]), 1));
+            argc--, argv++;
+        } else if (strcmp(argv[1], "-r") == 0 && argc > 3) {
+            reportPath = argv[2];
+            argc--, argv++;
+        } else {
+            std::cerr << "[Error] Unknown option " << argv[1] << std::endl;
+            return -1;
+        }
+    }
 
     if (argc < 2)
     {
@@ -41,12 +329,20 @@ int main(int argc, char* argv[])
         return -1;
     }
 
-    if (strcmp(argv[1], "-d") == 0)
+    // Several configs, a glob or a directory: run them all as a suite
+    if (argc > 2 || jobs || !reportPath.empty() || std::string(argv[1]).find_first_of("*?") != std::string::npos)
     {
-        autotester::debugMode = true;
-        argv++;
-    } else {
-        autotester::debugMode = false;
+        const std::vector<std::string> configs = expandSuiteArgs(argc, argv);
+        if (configs.empty())
+        {
+            std::cerr << "[Error] No test config JSON files found" << std::endl;
+            return -1;
+        }
+        if (!jobs)
+        {
+            jobs = std::max(std::thread::hardware_concurrency(), 1u);
+        }
+        return runSuite(self, childOptions, configs, jobs, reportPath);
     }
 
     const std::string jsonPath(argv[1]);
@@ -78,6 +374,12 @@ int main(int argc, char* argv[])
         return -1;
     }
 
+    // Relative cache paths are from the config file's directory, like the other paths
+    if (cacheDir)
+    {
+        cachePath = autotester::bootCachePath(cacheDir);
+    }
+
     if (cemucore::EMU_STATE_VALID != cemucore::emu_load(cemucore::EMU_DATA_ROM, autotester::config.rom.c_str()))
     {
         std::cerr << "[Error] Couldn't start emulation!" << std::endl;
@@ -85,24 +387,38 @@ int main(int argc, char* argv[])
     }
 
     cemucore::emu_set_run_rate(1000);
-    cemucore::emu_run(10000);
 
-    // Clear home screen
-    autotester::sendKey(0x09);
-    cemucore::emu_run(300);
-
-    // Transfer things if needed
-    if (!autotester::config.transfer_files.empty())
+    if (!cachePath.empty() && autotester::restoreBootCache(cachePath))
     {
-        if (!autotester::sendFilesForTest())
+        if (autotester::debugMode)
         {
-            std::cerr << "[Error] Error while in sendFilesForTest!" << std::endl;
-            retVal = -1;
-            goto cleanExit;
+            std::cout << "Restored the booted state from " << cachePath << std::endl;
+        }
+    } else {
+        cemucore::emu_run(10000);
+
+        // Clear home screen
+        autotester::sendKey(0x09);
+        cemucore::emu_run(300);
+
+        // Transfer things if needed
+        if (!autotester::config.transfer_files.empty())
+        {
+            if (!autotester::sendFilesForTest())
+            {
+                std::cerr << "[Error] Error while in sendFilesForTest!" << std::endl;
+                retVal = -1;
+                goto cleanExit;
+            }
         }
-    }
 
-    cemucore::emu_run(500);
+        cemucore::emu_run(500);
+
+        if (!cachePath.empty() && !autotester::saveBootCache(cachePath))
+        {
+            std::cerr << "[Error] Couldn't save the booted state to " << cachePath << std::endl;
+        }
+    }
 
     // Follow the sequence
     if (!autotester::doTestSequence())
@@ -115,9 +431,28 @@ int main(int argc, char* argv[])
     }
 
 cleanExit:
+    cycles = cemucore::sched_total_cycles();
     cemucore::emu_exit();
     cemucore::asic_free();
 
+    if (cemucore::cpu_cache_mismatches())
+    {
+        std::cerr << "[Error] " << cemucore::cpu_cache_mismatches() << " instruction cache mismatches" << std::endl;
+        retVal = -1;
+    }
+
+    if (cemucore::cpu_jit_mismatches())
+    {
+        std::cerr << "[Error] " << cemucore::cpu_jit_mismatches() << " recompiler mismatches" << std::endl;
+        retVal = -1;
+    }
+
+    if (suiteSummary)
+    {
+        std::cout << suiteSummaryTag << " " << autotester::hashesTested << " " << autotester::hashesPassed << " "
+                  << autotester::hashesFailed << " " << cycles << std::endl;
+    }
+
     // If no JSON/program/misc. error, return the hash failure count.
     if (retVal == 0)
     {
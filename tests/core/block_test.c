@@ -0,0 +1,254 @@
+/*
+ * Runs block transfer and compare instructions with and without the bulk shortcuts,
+ * and checks that registers, flags, R, cycles and memory stay identical every step,
+ * including with BC starting at 0, wrapping 16 bit addresses, dma and interrupts mid-block.
+ * Part of the CEmu project
+ * License: GPLv3
+ */
+
+#include "harness.h"
+
+#include "../../core/emu.h"
+#include "../../core/cpu.h"
+#include "../../core/mem.h"
+#include "../../core/bus.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#define STEPS 300
+
+#define RAM_LOOPS     0xD00300 /* times the main loop ran */
+#define RAM_INTS      0xD00400 /* interrupts taken */
+#define RAM_INT_BC    0xD00403 /* BC when the last interrupt hit */
+#define RAM_RESULTS   0xD00410 /* HL, BC and AF after the compares */
+#define RAM_NEEDLE    0xD00500 /* what the compares look for */
+#define RAM_STACK     0xD00800
+
+typedef struct snapshot {
+    eZ80registers_t registers;
+    uint64_t cycles;
+    uint32_t seconds;
+    uint64_t ram;
+} snapshot_t;
+
+static uint8_t *rom;
+static uint32_t pc;
+
+static void emit(int count, ...) {
+    va_list args;
+    va_start(args, count);
+    while (count--) {
+        rom[pc++] = (uint8_t)va_arg(args, int);
+    }
+    va_end(args);
+}
+
+/* an instruction ending with a 24 bit immediate or address */
+static void emit24(int count, ...) {
+    uint32_t value;
+    va_list args;
+    va_start(args, count);
+    while (count--) {
+        rom[pc++] = (uint8_t)va_arg(args, int);
+    }
+    value = va_arg(args, uint32_t);
+    va_end(args);
+    emit(3, value & 0xFF, value >> 8 & 0xFF, value >> 16 & 0xFF);
+}
+
+static void emit_block(uint8_t opcode, uint32_t hl, uint32_t de, uint32_t bc) {
+    emit24(1, 0x21, hl);            /* ld hl,hl */
+    emit24(1, 0x11, de);            /* ld de,de */
+    emit24(1, 0x01, bc);            /* ld bc,bc */
+    emit(2, 0xED, opcode);
+}
+
+static void emit_compare(uint8_t opcode, uint32_t hl, uint32_t bc) {
+    emit24(1, 0x3A, RAM_NEEDLE);    /* ld a,(needle) */
+    emit24(1, 0x21, hl);            /* ld hl,hl */
+    emit24(1, 0x01, bc);            /* ld bc,bc */
+    emit(2, 0xED, opcode);
+    emit24(1, 0x22, RAM_RESULTS);   /* ld (results),hl */
+    emit24(2, 0xED, 0x43, RAM_RESULTS + 3); /* ld (results+3),bc */
+    emit(2, 0xF5, 0xE1);            /* push af \ pop hl */
+    emit24(1, 0x22, RAM_RESULTS + 6); /* ld (results+6),hl */
+}
+
+static void build_rom(void) {
+    static const uint32_t timing[3] = { 0x1F0A0338, 0x0402093F, 0x00EF780C };
+    uint32_t loop, i, seed = 0x2468ACE1;
+
+    memset(rom, 0xFF, SIZE_FLASH);
+    for (i = 0x1000; i < 0x40000; i++) {
+        seed = seed * 1103515245 + 12345;
+        rom[i] = seed >> 16;
+    }
+
+    /* reset: switch to adl mode */
+    pc = 0;
+    emit24(2, 0x5B, 0xC3, 0x000100); /* jp.lil main */
+
+    /* lcd interrupt: acknowledge it, count it and record where the block was */
+    pc = 0x38;
+    emit(1, 0xF5);                  /* push af */
+    emit(2, 0x3E, 0x04);            /* ld a,4 */
+    emit24(1, 0x32, 0xE30028);      /* ld (lcd icr),a */
+    emit24(1, 0x3A, RAM_INTS);      /* ld a,(ints) */
+    emit(1, 0x3C);                  /* inc a */
+    emit24(1, 0x32, RAM_INTS);      /* ld (ints),a */
+    emit24(2, 0xED, 0x43, RAM_INT_BC); /* ld (int bc),bc */
+    emit(1, 0xF1);                  /* pop af */
+    emit(1, 0xFB);                  /* ei */
+    emit(2, 0xED, 0x4D);            /* reti */
+
+    pc = 0x100;
+    emit24(1, 0x31, RAM_STACK);     /* ld sp,stack */
+    for (i = 0; i < 12; i++) {
+        emit(2, 0x3E, timing[i / 4] >> (i % 4 * 8) & 0xFF); /* ld a,timing */
+        emit24(1, 0x32, 0xE30000 + i); /* ld (lcd timing),a */
+    }
+    emit24(1, 0x21, 0xD40000);      /* ld hl,vram */
+    emit24(1, 0x22, 0xE30010);      /* ld (lcd upbase),hl */
+    emit24(1, 0x21, 0x00092D);      /* ld hl,16bpp */
+    emit24(1, 0x22, 0xE30018);      /* ld (lcd control),hl */
+    emit(2, 0xED, 0x56);            /* im 1 */
+    emit(2, 0x3E, 0x04);            /* ld a,4 */
+    emit24(1, 0x32, 0xE3001C);      /* ld (lcd imsc),a */
+    emit(2, 0x3E, 0x08);            /* ld a,8 */
+    emit24(1, 0x32, 0xF00005);      /* ld (int enable + 1),a */
+    emit(1, 0xFB);                  /* ei */
+
+    /* flash to ram, with wait states */
+    emit_block(0xB0, 0x001000, 0xD10000, 0x4000);
+    emit_block(0xB0, 0x005000, 0xD28000, 0x1000);
+
+    loop = pc;
+    emit_block(0xB0, 0xD10000, 0xD14000, 0x3000); /* ldir, separate */
+    emit_block(0xB0, 0xD10000, 0xD10001, 0x1000); /* ldir, one byte behind */
+    emit_block(0xB0, 0xD11000, 0xD11007, 0x2000); /* ldir, repeating a pattern */
+    emit_block(0xB8, 0xD13FFF, 0xD13FF0, 0x1800); /* lddr, overlapping */
+    emit_block(0xB0, 0xD40000, 0xD41000, 0x9000); /* ldir, in vram while the lcd reads it */
+    emit_compare(0xB1, 0xD10000, 0x5000);         /* cpir */
+    emit_compare(0xB9, 0xD17FFF, 0x6000);         /* cpdr */
+    emit_compare(0xB9, 0x03FFF0, 0x4000);         /* cpdr, in flash */
+    emit_compare(0xB1, 0xD28000, 0);              /* cpir, bc wrapping to 0xFFFFFF */
+
+    /* 16 bit blocks at mbase $D2, bc of 0 is 64K and addresses wrap within the segment */
+    emit(2, 0x3E, 0xD2);            /* ld a,$D2 */
+    emit(2, 0xED, 0x6D);            /* ld mb,a */
+    emit24(1, 0x21, 0x008000);
+    emit24(1, 0x11, 0x00F000);
+    emit24(1, 0x01, 0x000000);
+    emit(3, 0x40, 0xED, 0xB0);      /* ldir.sis */
+    emit24(1, 0x3A, RAM_NEEDLE);    /* ld a,(needle) */
+    emit24(1, 0x21, 0x00C000);
+    emit24(1, 0x01, 0x000000);
+    emit(3, 0x40, 0xED, 0xB1);      /* cpir.sis */
+    emit24(1, 0x22, RAM_RESULTS + 9); /* ld (results+9),hl */
+    emit(3, 0x40, 0xED, 0xB9);      /* cpdr.sis, carries on from there */
+    emit24(1, 0x22, RAM_RESULTS + 12); /* ld (results+12),hl */
+
+    /* look for something else next time */
+    emit24(1, 0x3A, RAM_NEEDLE);    /* ld a,(needle) */
+    emit(2, 0xC6, 0x35);            /* add a,$35 */
+    emit24(1, 0x32, RAM_NEEDLE);    /* ld (needle),a */
+    emit24(1, 0x2A, RAM_LOOPS);     /* ld hl,(loops) */
+    emit(1, 0x23);                  /* inc hl */
+    emit24(1, 0x22, RAM_LOOPS);     /* ld (loops),hl */
+    emit24(1, 0xC3, loop);          /* jp loop */
+}
+
+static uint64_t hash(const uint8_t *data, size_t size) {
+    uint64_t h = 1469598103934665603ULL;
+    while (size--) {
+        h ^= *data++;
+        h *= 0x100000001B3ULL;
+    }
+    return h;
+}
+
+static bool run(const char *path, bool shortcuts, snapshot_t *snapshots) {
+    int step;
+
+    cpu_set_shortcuts(shortcuts);
+    if (emu_load(EMU_DATA_ROM, path) == EMU_STATE_INVALID) {
+        return false;
+    }
+    bus_init_rand(1, 2, 3);
+    emu_set_run_rate(1000);
+    for (step = 0; step < STEPS; step++) {
+        emu_run(1);
+        memcpy(&snapshots[step].registers, &cpu.registers, sizeof(eZ80registers_t));
+        snapshots[step].cycles = cpu.cycles;
+        snapshots[step].seconds = cpu.seconds;
+        snapshots[step].ram = hash(mem.ram.block, SIZE_RAM);
+    }
+    return true;
+}
+
+static void print_registers(const char *name, const eZ80registers_t *r) {
+    printf("  %-9s AF=%04X BC=%06X DE=%06X HL=%06X IX=%06X IY=%06X SPL=%06X PC=%06X R=%02X MB=%02X\n", name,
+           r->AF, r->BC, r->DE, r->HL, r->IX, r->IY, r->SPL, r->PC, r->R, r->MBASE);
+}
+
+int main(int argc, char *argv[]) {
+    const char *dir = argc > 1 ? argv[1] : ".";
+    snapshot_t *reference = calloc(STEPS, sizeof(snapshot_t));
+    snapshot_t *bulk = calloc(STEPS, sizeof(snapshot_t));
+    char path[512];
+    unsigned int loops = 0, ints = 0;
+    int step, status = 1;
+
+    test_path(path, sizeof(path), dir, "block_test.rom");
+    rom = malloc(SIZE_FLASH);
+    if (!rom || !reference || !bulk) {
+        goto done;
+    }
+    build_rom();
+    if (!test_write_rom(path, rom, SIZE_FLASH)) {
+        printf("[Block test failed] couldn't write %s\n", path);
+        goto done;
+    }
+
+    if (!run(path, false, reference)) {
+        printf("[Block test failed] couldn't load the test rom\n");
+        goto done;
+    }
+    loops = mem_peek_short(RAM_LOOPS);
+    ints = mem_peek_byte(RAM_INTS);
+    if (!run(path, true, bulk)) {
+        printf("[Block test failed] couldn't load the test rom\n");
+        goto done;
+    }
+
+    for (step = 0; step < STEPS; step++) {
+        if (memcmp(&reference[step].registers, &bulk[step].registers, sizeof(eZ80registers_t)) ||
+            reference[step].cycles != bulk[step].cycles || reference[step].seconds != bulk[step].seconds ||
+            reference[step].ram != bulk[step].ram) {
+            printf("[Block test failed] the runs differ after step %d\n", step);
+            print_registers("reference", &reference[step].registers);
+            print_registers("bulk", &bulk[step].registers);
+            printf("  cycles %llu and %llu, ram %s\n", (unsigned long long)reference[step].cycles,
+                   (unsigned long long)bulk[step].cycles, reference[step].ram == bulk[step].ram ? "equal" : "differs");
+            goto done;
+        }
+    }
+    /* the comparison means little if the program didn't get far */
+    if (loops < 2 || !ints) {
+        printf("[Block test failed] only %u loops and %u interrupts ran\n", loops, ints);
+        goto done;
+    }
+    printf("[Block test passed] %u loops and %u interrupts matched over %d steps\n", loops, ints, STEPS);
+    status = 0;
+
+done:
+    remove(path);
+    free(rom);
+    free(reference);
+    free(bulk);
+    return status;
+}
@@ -0,0 +1,79 @@
+/*
+ * Shared scaffolding of the core tests
+ * Part of the CEmu project
+ * License: GPLv3
+ */
+
+#include "harness.h"
+
+#include "../../core/mem.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+unsigned int test_failures;
+
+void gui_console_clear(void) {}
+void gui_console_printf(const char *format, ...) { (void)format; }
+void gui_console_err_printf(const char *format, ...) { (void)format; }
+#ifdef DEBUG_SUPPORT
+void gui_debug_open(int reason, uint32_t data) { (void)reason; (void)data; }
+void gui_debug_close(void) {}
+#endif
+
+void test_path(char *path, size_t size, const char *dir, const char *name) {
+    snprintf(path, size, "%s/%s", dir, name);
+}
+
+bool test_write_rom(const char *path, const uint8_t *code, size_t size) {
+    uint8_t *rom;
+    bool success;
+
+    if (size > SIZE_FLASH || !(rom = malloc(SIZE_FLASH))) {
+        return false;
+    }
+    memset(rom, 0xFF, SIZE_FLASH);
+    memcpy(rom, code, size);
+    success = test_write_file(path, rom, SIZE_FLASH);
+    free(rom);
+    return success;
+}
+
+bool test_write_file(const char *path, const void *data, long size) {
+    FILE *file = fopen(path, "wb");
+    bool success;
+
+    if (!file) {
+        return false;
+    }
+    success = fwrite(data, size, 1, file) == 1;
+    return !fclose(file) && success;
+}
+
+long test_file_size(FILE *file) {
+    return fseek(file, 0, SEEK_END) ? -1 : ftell(file);
+}
+
+uint8_t *test_read_file(const char *path, long *size) {
+    uint8_t *data = NULL;
+    FILE *file = fopen(path, "rb");
+
+    if (file) {
+        if ((*size = test_file_size(file)) > 0 && !fseek(file, 0, SEEK_SET) && (data = malloc(*size)) &&
+            fread(data, *size, 1, file) != 1) {
+            free(data);
+            data = NULL;
+        }
+        fclose(file);
+    }
+    return data;
+}
+
+int test_finish(const char *name) {
+    if (test_failures) {
+        printf("[%s failed] %u checks failed.\n", name, test_failures);
+        return 1;
+    }
+    printf("[%s passed]\n", name);
+    return 0;
+}
@@ -0,0 +1,39 @@
+/*
+ * Shared scaffolding of the core tests: the gui callbacks the core needs,
+ * failure counting and the files the tests write their roms and images to.
+ * Part of the CEmu project
+ * License: GPLv3
+ */
+
+#ifndef TEST_HARNESS_H
+#define TEST_HARNESS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+extern unsigned int test_failures;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        test_failures++; \
+        printf("[Failed] " __VA_ARGS__); \
+        printf("\n"); \
+    } \
+} while (0)
+
+/* dir/name into path, the tests take the directory for their files as their argument */
+void test_path(char *path, size_t size, const char *dir, const char *name);
+
+/* a flash image with code at address 0 and the rest erased, size may be the whole flash */
+bool test_write_rom(const char *path, const uint8_t *code, size_t size);
+
+bool test_write_file(const char *path, const void *data, long size);
+uint8_t *test_read_file(const char *path, long *size);   /* malloc'd, NULL if it can't be read */
+long test_file_size(FILE *file);
+
+/* prints the result line for name, returns the exit status */
+int test_finish(const char *name);
+
+#endif
@@ -0,0 +1,327 @@
+/*
+ * Checks the compressed image format: chunk round trips through the codec,
+ * saving and loading a running state, and rejection of damaged files.
+ * Part of the CEmu project
+ * License: GPLv3
+ */
+
+#include "harness.h"
+
+#include "../../core/emu.h"
+#include "../../core/mem.h"
+#include "../../core/image.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#define CHUNK_SIZE 0x30000
+
+static uint32_t rng = 0x12345678;
+
+static uint8_t random_byte(void) {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return (uint8_t)rng;
+}
+
+/* random bytes with runs and copies of earlier data mixed in, so every kind of sequence shows up */
+static void fill_mixed(uint8_t *data, size_t size) {
+    size_t i = 0, length, offset;
+    while (i < size) {
+        length = 1 + random_byte() % 64;
+        if (length > size - i) {
+            length = size - i;
+        }
+        switch (random_byte() % 3) {
+            case 0:
+                while (length--) {
+                    data[i++] = random_byte();
+                }
+                break;
+            case 1:
+                memset(data + i, random_byte(), length);
+                i += length;
+                break;
+            default:
+                offset = 1 + (random_byte() | random_byte() << 8) % (i ? i : 1);
+                if (offset > i) {
+                    data[i++] = random_byte();
+                    break;
+                }
+                while (length--) {
+                    data[i] = data[i - offset];
+                    i++;
+                }
+                break;
+        }
+    }
+}
+
+/* the chunks written in order, tagged 'T' '0' + index */
+static const size_t chunk_sizes[] = { 0, 1, 3, 4, 5, 1000, CHUNK_SIZE };
+
+static bool write_chunks(FILE *file, uint8_t *const *data, size_t count) {
+    image_t image;
+    size_t i;
+    bool success = true;
+
+    image_open_capture(&image);
+    for (i = 0; i < count && success; i++) {
+        success = image_write_chunk(&image, IMAGE_TAG('T', '0' + i, ' ', ' '), 1) &&
+                  image_write(&image, data[i], chunk_sizes[i]);
+    }
+    success = success && image_save_capture(&image, file) && !fflush(file);
+    image_close(&image);
+    return success;
+}
+
+static bool read_chunks(FILE *file, uint8_t *const *data, size_t count) {
+    image_t image;
+    uint8_t *buffer = malloc(CHUNK_SIZE);
+    size_t i;
+    bool success = buffer != NULL;
+
+    rewind(file);
+    image_open_chunked(&image, file);
+    for (i = 0; i < count && success; i++) {
+        success = image_read_chunk(&image, IMAGE_TAG('T', '0' + i, ' ', ' '), 1) &&
+                  image_read(&image, buffer, chunk_sizes[i]) &&
+                  !memcmp(buffer, data[i], chunk_sizes[i]);
+    }
+    success = success && image_end(&image);
+    image_close(&image);
+    free(buffer);
+    return success;
+}
+
+static void test_codec(void) {
+    static const char *const kinds[] = { "incompressible", "all zero", "mixed" };
+    const size_t count = sizeof(chunk_sizes) / sizeof(chunk_sizes[0]);
+    uint8_t *data[sizeof(chunk_sizes) / sizeof(chunk_sizes[0])];
+    size_t kind, i, j, total = 0;
+    FILE *file;
+
+    for (i = 0; i < count; i++) {
+        data[i] = malloc(chunk_sizes[i] ? chunk_sizes[i] : 1);
+        total += chunk_sizes[i];
+    }
+
+    for (kind = 0; kind < 3; kind++) {
+        for (i = 0; i < count; i++) {
+            switch (kind) {
+                case 0:
+                    for (j = 0; j < chunk_sizes[i]; j++) {
+                        data[i][j] = random_byte();
+                    }
+                    break;
+                case 1:
+                    memset(data[i], 0, chunk_sizes[i]);
+                    break;
+                default:
+                    fill_mixed(data[i], chunk_sizes[i]);
+                    break;
+            }
+        }
+        if (!(file = tmpfile())) {
+            CHECK(false, "couldn't create a temporary file");
+            break;
+        }
+        CHECK(write_chunks(file, data, count), "writing %s chunks", kinds[kind]);
+        if (kind == 1) {
+            CHECK(test_file_size(file) < (long)total / 16, "all zero chunks weren't compressed");
+        }
+        CHECK(read_chunks(file, data, count), "%s chunks didn't read back unchanged", kinds[kind]);
+        fclose(file);
+    }
+
+    for (i = 0; i < count; i++) {
+        free(data[i]);
+    }
+}
+
+/* a rom that leaves z80 mode and keeps incrementing bytes of the first 64K of ram */
+static bool write_rom(const char *path) {
+    static const uint8_t boot[] = {
+        0x5B, 0xC3, 0x05, 0x00, 0x00, /* jp.lil $000005 */
+        0x21, 0x00, 0x00, 0xD0,       /* ld hl,$D00000 */
+        0x34,                         /* inc (hl) */
+        0x23,                         /* inc hl */
+        0xCB, 0xA4,                   /* res 4,h */
+        0x18, 0xFA,                   /* jr $-4 */
+    };
+
+    return test_write_rom(path, boot, sizeof(boot));
+}
+
+static void test_state(const char *dir) {
+    char rom[512], saved[512], resaved[512], damaged[512];
+    uint8_t *before = malloc(SIZE_RAM), *after = malloc(SIZE_RAM), *first;
+    long first_size = 0;
+
+    test_path(rom, sizeof(rom), dir, "image_test.rom");
+    test_path(saved, sizeof(saved), dir, "image_test.cemu");
+    test_path(resaved, sizeof(resaved), dir, "image_test2.cemu");
+    test_path(damaged, sizeof(damaged), dir, "image_test3.cemu");
+
+    if (!before || !after || !write_rom(rom) || emu_load(EMU_DATA_ROM, rom) == EMU_STATE_INVALID) {
+        CHECK(false, "couldn't boot the test rom");
+        free(before);
+        free(after);
+        return;
+    }
+    emu_set_run_rate(1000);
+    emu_run(20);
+
+    /* a loaded state matches the one saved, and carries on exactly like it */
+    memcpy(before, mem.ram.block, SIZE_RAM);
+    CHECK(emu_save(EMU_DATA_IMAGE, saved), "saving the running state");
+    emu_run(20);
+    memcpy(after, mem.ram.block, SIZE_RAM);
+    CHECK(memcmp(before, after, SIZE_RAM), "the test rom didn't change ram");
+
+    CHECK(emu_load(EMU_DATA_IMAGE, saved) == EMU_STATE_VALID, "loading the saved state");
+    CHECK(!memcmp(before, mem.ram.block, SIZE_RAM), "the loaded ram differs from the saved one");
+    CHECK(emu_save(EMU_DATA_IMAGE, resaved), "saving the loaded state");
+    emu_run(20);
+    CHECK(!memcmp(after, mem.ram.block, SIZE_RAM), "the loaded state ran differently");
+
+    /* saving a loaded state loses nothing either */
+    CHECK(emu_load(EMU_DATA_IMAGE, resaved) == EMU_STATE_VALID, "loading the saved loaded state");
+    emu_run(20);
+    CHECK(!memcmp(after, mem.ram.block, SIZE_RAM), "the saved loaded state ran differently");
+    free(before);
+    free(after);
+
+    first = test_read_file(saved, &first_size);
+    if (first && first_size > 24) {
+        /* the first chunk header follows the version, its crc is the last field */
+        first[4 + 16] ^= 1;
+        CHECK(test_write_file(damaged, first, first_size) && emu_load(EMU_DATA_IMAGE, damaged) == EMU_STATE_INVALID,
+              "an image with a flipped crc byte was accepted");
+        first[4 + 16] ^= 1;
+
+        first[first_size - 1] ^= 0x80;
+        CHECK(test_write_file(damaged, first, first_size) && emu_load(EMU_DATA_IMAGE, damaged) == EMU_STATE_INVALID,
+              "an image with a flipped data byte was accepted");
+        first[first_size - 1] ^= 0x80;
+
+        CHECK(test_write_file(damaged, first, first_size / 2) && emu_load(EMU_DATA_IMAGE, damaged) == EMU_STATE_INVALID,
+              "a truncated image was accepted");
+        CHECK(test_write_file(damaged, first, first_size - 1) && emu_load(EMU_DATA_IMAGE, damaged) == EMU_STATE_INVALID,
+              "an image missing its last byte was accepted");
+    }
+    free(first);
+
+    remove(rom);
+    remove(saved);
+    remove(resaved);
+    remove(damaged);
+}
+
+/* flash saved uncompressed is mapped back in, and runs exactly like the state that was saved */
+static void test_mapped(const char *dir) {
+    char rom[512], saved[512], other[512];
+    uint8_t *ram = malloc(SIZE_RAM), *flash = malloc(SIZE_FLASH), *after = malloc(SIZE_RAM);
+
+    test_path(rom, sizeof(rom), dir, "image_test.rom");
+    test_path(saved, sizeof(saved), dir, "image_test_mapped.cemu");
+    test_path(other, sizeof(other), dir, "image_test_other.cemu");
+
+    if (!ram || !flash || !after || !write_rom(rom) || emu_load(EMU_DATA_ROM, rom) == EMU_STATE_INVALID) {
+        CHECK(false, "couldn't boot the test rom");
+        free(ram);
+        free(flash);
+        free(after);
+        return;
+    }
+    emu_set_run_rate(1000);
+    emu_run(20);
+
+    emu_set_image_mappable(true);
+    memcpy(ram, mem.ram.block, SIZE_RAM);
+    memcpy(flash, mem.flash.block, SIZE_FLASH);
+    CHECK(emu_save(EMU_DATA_IMAGE, saved), "saving a mappable state");
+    emu_run(20);
+    memcpy(after, mem.ram.block, SIZE_RAM);
+
+    CHECK(emu_load(EMU_DATA_IMAGE, saved) == EMU_STATE_VALID, "loading the mappable state");
+    CHECK(mem_flash_shared(), "flash of the mappable state wasn't mapped");
+    CHECK(!memcmp(ram, mem.ram.block, SIZE_RAM), "the mapped state's ram differs from the saved one");
+    CHECK(!memcmp(flash, mem.flash.block, SIZE_FLASH), "the mapped flash differs from the saved one");
+
+    /* only saving over the file flash is mapped from needs a private copy of it */
+    CHECK(emu_save(EMU_DATA_IMAGE, other) && mem_flash_shared(), "saving elsewhere stopped mapping flash");
+    CHECK(emu_save(EMU_DATA_IMAGE, saved) && !mem_flash_shared(), "saving over the mapped state kept it mapped");
+    CHECK(!memcmp(flash, mem.flash.block, SIZE_FLASH), "saving over the mapped file changed flash");
+    emu_run(20);
+    CHECK(!memcmp(after, mem.ram.block, SIZE_RAM), "the mapped state ran differently");
+
+    CHECK(emu_load(EMU_DATA_IMAGE, saved) == EMU_STATE_VALID && mem_flash_shared(), "reloading the mappable state");
+    emu_run(20);
+    CHECK(!memcmp(after, mem.ram.block, SIZE_RAM), "the reloaded mapped state ran differently");
+    emu_set_image_mappable(false);
+
+    free(ram);
+    free(flash);
+    free(after);
+    remove(rom);
+    remove(saved);
+    remove(other);
+}
+
+/* a delta still restores after the base moved on, given the full snapshot taken with its base */
+static void test_rebase(const char *dir) {
+    char rom[512];
+    uint8_t *ram = malloc(SIZE_RAM), *after = malloc(SIZE_RAM), *full = NULL, *delta = NULL;
+    size_t full_size = 0, delta_size = 0;
+
+    test_path(rom, sizeof(rom), dir, "image_test.rom");
+    if (!ram || !after || !write_rom(rom) || emu_load(EMU_DATA_ROM, rom) == EMU_STATE_INVALID) {
+        CHECK(false, "couldn't boot the test rom");
+        free(ram);
+        free(after);
+        return;
+    }
+    emu_set_run_rate(1000);
+    emu_run(20);
+
+    CHECK(emu_snapshot_set_base(), "setting the base");
+    full_size = emu_snapshot_size();
+    full = malloc(full_size);
+    CHECK(full && emu_snapshot_save(full, full_size), "saving the base snapshot");
+    emu_run(20);
+    delta_size = emu_snapshot_delta_size();
+    delta = malloc(delta_size);
+    CHECK(delta && emu_snapshot_save_delta(delta, delta_size), "saving a delta");
+    memcpy(ram, mem.ram.block, SIZE_RAM);
+    emu_run(20);
+    memcpy(after, mem.ram.block, SIZE_RAM);
+
+    CHECK(emu_snapshot_set_base(), "setting a new base");
+    emu_run(20);
+    CHECK(!emu_snapshot_restore_delta(delta, delta_size), "a delta restored against the wrong base");
+    CHECK(emu_snapshot_restore_delta_from(full, full_size, delta, delta_size), "restoring a delta on its old base");
+    CHECK(!memcmp(ram, mem.ram.block, SIZE_RAM), "the rebased delta's ram differs from the saved one");
+    emu_run(20);
+    CHECK(!memcmp(after, mem.ram.block, SIZE_RAM), "the rebased delta ran differently");
+
+    free(ram);
+    free(after);
+    free(full);
+    free(delta);
+    remove(rom);
+}
+
+int main(int argc, char *argv[]) {
+    const char *dir = argc > 1 ? argv[1] : ".";
+
+    test_codec();
+    test_state(dir);
+    test_mapped(dir);
+    test_rebase(dir);
+
+    return test_finish("Image test");
+}
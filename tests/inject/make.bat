@@ -0,0 +1 @@
+spasm -E -I .. inject.ez80 INJECT.8xp